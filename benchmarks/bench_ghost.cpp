@@ -9,11 +9,12 @@
 #include <fstream>
 #include <iostream>
 #include <ostream>
+#include <vector>
 
 #include "gcache/ghost_cache.h"
 #include "workload.h"
 
-// use compile-time macro to set this
+// default of --sample_shift; may also be set by the compile-time macro
 #ifndef SAMPLE_SHIFT
 #define SAMPLE_SHIFT 5
 #endif
@@ -30,11 +31,15 @@ static uint64_t base_offset = 0;    // unit: blocks
 static uint32_t cache_tick = num_blocks / 32;
 static uint32_t cache_min = cache_tick;
 static uint32_t cache_max = num_blocks;
+static uint32_t sample_shift = SAMPLE_SHIFT;
+// if set, the sample rate adapts to keep the tracked blocks within it
+static uint32_t max_tracked = UINT32_MAX;
 
 static std::filesystem::path result_dir = ".";
 
 static bool run_ghost = true;
 static bool run_sampled = true;
+static bool run_batch = true;  // also run access_batch for comparison
 
 void parse_args(int argc, char* argv[]) {
   char junk;
@@ -79,10 +84,16 @@ void parse_args(int argc, char* argv[]) {
       cache_min = n;
     } else if (sscanf(argv[i], "--cache_max=%ld%c", &n, &junk) == 1) {
       cache_max = n;
+    } else if (sscanf(argv[i], "--sample_shift=%ld%c", &n, &junk) == 1) {
+      sample_shift = n;
+    } else if (sscanf(argv[i], "--max_tracked=%ld%c", &n, &junk) == 1) {
+      max_tracked = n;
     } else if (strcmp(argv[i], "--no_ghost") == 0) {
       run_ghost = false;
     } else if (strcmp(argv[i], "--no_sampled") == 0) {
       run_sampled = false;
+    } else if (strcmp(argv[i], "--no_batch") == 0) {
+      run_batch = false;
     } else if (sscanf(argv[i], "--rand_seed=%ld%c", &n, &junk) == 1) {
       rand_seed = n;
       std::mt19937 rng(rand_seed + 0x564);
@@ -101,6 +112,14 @@ void parse_args(int argc, char* argv[]) {
     std::cerr << "Invalid cache configs: Invalid cache_tick" << std::endl;
     exit(1);
   }
+  if (sample_shift > gcache::kMaxSampleShift ||
+      ((cache_tick | cache_min | cache_max) & ((1u << sample_shift) - 1)) ||
+      (cache_min >> sample_shift) <= 1) {
+    std::cerr << "Invalid sample_shift: cache sizes must be multiples of "
+                 "(1 << sample_shift)"
+              << std::endl;
+    exit(1);
+  }
 }
 
 int main(int argc, char* argv[]) {
@@ -111,7 +130,8 @@ int main(int argc, char* argv[]) {
   ofs_perf
       << "workload,num_blocks,num_files,num_blocks_per_op,num_ops,zipf_theta,"
          "cache_tick,cache_min,cache_max,sample_shift,rand_seed,"
-         "baseline_us,ghost_us,sampled_us,avg_err,max_err\n";
+         "baseline_us,ghost_us,sampled_us,ghost_batch_us,sampled_batch_us,"
+         "avg_err,max_err\n";
 
   std::cout << "Config: wl_type=";
   switch (wl_type) {
@@ -134,11 +154,12 @@ int main(int argc, char* argv[]) {
             << ", num_blocks_per_op=" << num_blocks_per_op
             << ", num_ops=" << num_ops << ", zipf_theta=" << zipf_theta
             << ", cache_tick=" << cache_tick << ", cache_min=" << cache_min
-            << ", cache_max=" << cache_max << ", sample_shift=" << SAMPLE_SHIFT
-            << ", rand_seed=" << rand_seed << std::endl;
+            << ", cache_max=" << cache_max << ", sample_shift=" << sample_shift
+            << ", max_tracked=" << max_tracked << ", rand_seed=" << rand_seed
+            << std::endl;
   ofs_perf << ',' << num_blocks << ',' << num_files << ',' << num_blocks_per_op
            << ',' << num_ops << ',' << zipf_theta << ',' << cache_tick << ','
-           << cache_min << ',' << cache_max << ',' << SAMPLE_SHIFT << ','
+           << cache_min << ',' << cache_max << ',' << sample_shift << ','
            << rand_seed;
 
   uint64_t num_blocks_per_file = num_blocks / num_files;
@@ -150,12 +171,27 @@ int main(int argc, char* argv[]) {
                    /*align*/ num_blocks_per_op, zipf_theta, rand_seed);
   Offsets offsets3(num_ops, wl_type, /*size*/ num_blocks_per_file,
                    /*align*/ num_blocks_per_op, zipf_theta, rand_seed);
+  Offsets offsets4(num_ops, wl_type, /*size*/ num_blocks_per_file,
+                   /*align*/ num_blocks_per_op, zipf_theta, rand_seed);
+  Offsets offsets5(num_ops, wl_type, /*size*/ num_blocks_per_file,
+                   /*align*/ num_blocks_per_op, zipf_theta, rand_seed);
 
   uint64_t offset_checksum1 = 0, offset_checksum2 = 0, offset_checksum3 = 0;
+  uint64_t offset_checksum4 = 0, offset_checksum5 = 0;
 
-  gcache::GhostCache<> ghost_cache(cache_tick, cache_min, cache_max);
-  gcache::SampledGhostCache<SAMPLE_SHIFT> sampled_ghost_cache(
-      cache_tick, cache_min, cache_max);
+  // block ids are 64-bit: with base_offset and many files, they may exceed
+  // 2^32 and must not be truncated
+  gcache::GhostCache64<> ghost_cache(cache_tick, cache_min, cache_max);
+  // the sample rate is set at runtime, so one build covers all rates
+  using SampledGhostCache_t =
+      gcache::SampledGhostCache64<gcache::kRuntimeSampleShift>;
+  SampledGhostCache_t sampled_ghost_cache(cache_tick, cache_min, cache_max,
+                                          sample_shift, max_tracked);
+  // same as above but driven by access_batch with all blocks of an op
+  gcache::GhostCache64<> ghost_batch_cache(cache_tick, cache_min, cache_max);
+  SampledGhostCache_t sampled_batch_cache(cache_tick, cache_min, cache_max,
+                                          sample_shift, max_tracked);
+  std::vector<uint64_t> blk_ids(num_blocks_per_op);
 
   // preheat: run a subset of stream to populate the cache
   Offsets prehead_offsets(preheat_num_ops, wl_type,
@@ -171,13 +207,20 @@ int main(int argc, char* argv[]) {
         uint64_t blk_id = begin_blk_id + i;
         if (run_ghost) ghost_cache.access(blk_id);
         if (run_sampled) sampled_ghost_cache.access(blk_id);
+        blk_ids[i] = blk_id;
       }
+      if (run_batch && run_ghost)
+        ghost_batch_cache.access_batch(blk_ids.data(), num_blocks_per_op);
+      if (run_batch && run_sampled)
+        sampled_batch_cache.access_batch(blk_ids.data(), num_blocks_per_op);
       fd = (fd + 1) % num_files;
     }
   }
   auto preheat_end_ts = std::chrono::high_resolution_clock::now();
   ghost_cache.reset_stat();
   sampled_ghost_cache.reset_stat();
+  ghost_batch_cache.reset_stat();
+  sampled_batch_cache.reset_stat();
   // for human's reference only, not used for any data processing purposes
   std::cout << "Preheat completes in "
             << std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -228,8 +271,38 @@ int main(int argc, char* argv[]) {
     }
   }
   auto t3 = std::chrono::high_resolution_clock::now();
+  if (run_batch && run_ghost) {
+    uint64_t fd = 0;
+    for (auto off : offsets4) {
+      uint64_t begin_blk_id = fd * offset_subspace + base_offset + off;
+      for (uint64_t i = 0; i < num_blocks_per_op; ++i) {
+        uint64_t blk_id = begin_blk_id + i;
+        offset_checksum4 ^= blk_id;
+        blk_ids[i] = blk_id;
+      }
+      ghost_batch_cache.access_batch(blk_ids.data(), num_blocks_per_op);
+      fd = (fd + 1) % num_files;
+    }
+  }
+
+  auto t4 = std::chrono::high_resolution_clock::now();
+  if (run_batch && run_sampled) {
+    uint64_t fd = 0;
+    for (auto off : offsets5) {
+      uint64_t begin_blk_id = fd * offset_subspace + base_offset + off;
+      for (uint64_t i = 0; i < num_blocks_per_op; ++i) {
+        uint64_t blk_id = begin_blk_id + i;
+        offset_checksum5 ^= blk_id;
+        blk_ids[i] = blk_id;
+      }
+      sampled_batch_cache.access_batch(blk_ids.data(), num_blocks_per_op);
+      fd = (fd + 1) % num_files;
+    }
+  }
+  auto t5 = std::chrono::high_resolution_clock::now();
 
   int64_t t_base = 0, t_ghost = 0, t_sampled = 0;
+  int64_t t_ghost_batch = 0, t_sampled_batch = 0;
   double ghost_overhead = 0, sampled_overhead = 0;
   t_base =
       std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
@@ -243,13 +316,22 @@ int main(int argc, char* argv[]) {
         std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
     sampled_overhead = double(t_sampled - t_base) / num_ops;
   }
+  if (run_batch && run_ghost)
+    t_ghost_batch =
+        std::chrono::duration_cast<std::chrono::microseconds>(t4 - t3).count();
+  if (run_batch && run_sampled)
+    t_sampled_batch =
+        std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4).count();
 
   std::cout << "Baseline:            " << t_base << " us\n";
   std::cout << "Ghost Cache:         " << t_ghost << " us\n";
   std::cout << "Sampled Ghost Cache: " << t_sampled << " us\n";
+  std::cout << "Ghost Batch:         " << t_ghost_batch << " us\n";
+  std::cout << "Sampled Batch:       " << t_sampled_batch << " us\n";
   std::cout << "Ghost Overhead:      " << ghost_overhead << " us/op\n";
   std::cout << "Sampled Overhead:    " << sampled_overhead << " us/op\n";
-  ofs_perf << ',' << t_base << ',' << t_ghost << ',' << t_sampled;
+  ofs_perf << ',' << t_base << ',' << t_ghost << ',' << t_sampled << ','
+           << t_ghost_batch << ',' << t_sampled_batch;
 
   double avg_err = 0, max_err = 0;
 
@@ -275,6 +357,25 @@ int main(int argc, char* argv[]) {
       ofs_sampled << i << ',' << sampled_ghost_cache.get_hit_rate(i) << '\n';
   }
 
+  if (run_batch) {
+    if ((run_ghost && offset_checksum2 != offset_checksum4) ||
+        (run_sampled && offset_checksum3 != offset_checksum5))
+      std::cerr << "WARNING: offset checksums mismatch; "
+                   "random generator may not be deterministic!\n";
+    // batching must not change the simulation results, unless the sample
+    // rate adapts, which batching may lower at a slightly different time
+    for (size_t i = cache_min; i <= cache_max; i += cache_tick) {
+      if (max_tracked != UINT32_MAX) break;
+      if ((run_ghost &&
+           ghost_cache.get_hit_rate(i) != ghost_batch_cache.get_hit_rate(i)) ||
+          (run_sampled && sampled_ghost_cache.get_hit_rate(i) !=
+                              sampled_batch_cache.get_hit_rate(i))) {
+        std::cerr << "WARNING: batch hit rate mismatch at " << i << "!\n";
+        break;
+      }
+    }
+  }
+
   if (run_ghost && run_sampled) {
     std::vector<double> hit_rate_diff;  // dump the ghost cache status
     for (size_t i = cache_min; i <= cache_max; i += cache_tick) {
@@ -288,6 +389,9 @@ int main(int argc, char* argv[]) {
     max_err = *std::max_element(hit_rate_diff.begin(), hit_rate_diff.end());
   }
 
+  if (run_sampled && max_tracked != UINT32_MAX)
+    std::cout << "Adapted sample_shift: "
+              << sampled_ghost_cache.get_sample_shift() << std::endl;
   std::cout << "Avg Error: " << avg_err << std::endl;
   std::cout << "Max Error: " << max_err << std::endl;
   ofs_perf << ',' << avg_err << ',' << max_err << std::endl;
@@ -0,0 +1,152 @@
+// A bench process will compare eviction policies (LRU, CLOCK, SLRU, S3-FIFO,
+// SIEVE, W-TinyLFU) on 1) hit rate 2) performance
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+
+#include "gcache/clock_cache.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/s3fifo_cache.h"
+#include "gcache/sieve_cache.h"
+#include "gcache/slru_cache.h"
+#include "gcache/tinylfu_cache.h"
+#include "workload.h"
+
+static OffsetType wl_type = OffsetType::ZIPF;
+static uint64_t num_blocks = 1024 * 1024 * 1024 / 4096;  // 1 GB
+static uint64_t num_ops = 4'000'000;                     // 4M
+static double zipf_theta = 0.99;
+static uint64_t rand_seed = 0x537;  // enable different runs
+static uint32_t cache_size = num_blocks / 8;
+
+static std::filesystem::path result_dir = ".";
+
+void parse_args(int argc, char* argv[]) {
+  char junk;
+  uint64_t n;
+  double f;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--workload=", 11) == 0) {
+      if (strcmp(argv[i] + 11, "zipf") == 0) {
+        wl_type = OffsetType::ZIPF;
+      } else if (strcmp(argv[i] + 11, "unif") == 0) {
+        wl_type = OffsetType::UNIF;
+      } else if (strcmp(argv[i] + 11, "seq") == 0) {
+        wl_type = OffsetType::SEQ;
+      } else {
+        std::cerr << "Invalid argument: Unrecognized workload: " << argv[i] + 11
+                  << std::endl;
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "--result_dir=", 13) == 0) {
+      result_dir = argv[i] + 13;
+      if (!std::filesystem::is_directory(result_dir)) {
+        std::cerr << "Invalid argument: result_dir is not a valid directory: "
+                  << result_dir << std::endl;
+        exit(1);
+      }
+    } else if (sscanf(argv[i], "--working_set=%ld%c", &n, &junk) == 1) {
+      num_blocks = n / 4096;  // this is just a shortcut for num_blocks
+    } else if (sscanf(argv[i], "--num_blocks=%ld%c", &n, &junk) == 1) {
+      num_blocks = n;
+    } else if (sscanf(argv[i], "--num_ops=%ld%c", &n, &junk) == 1) {
+      num_ops = n;
+    } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &f, &junk) == 1) {
+      zipf_theta = f;
+    } else if (sscanf(argv[i], "--cache_size=%ld%c", &n, &junk) == 1) {
+      cache_size = n;
+    } else if (sscanf(argv[i], "--rand_seed=%ld%c", &n, &junk) == 1) {
+      rand_seed = n;
+    } else {
+      std::cerr << "Invalid argument: " << argv[i] << std::endl;
+      exit(1);
+    }
+  }
+  if (cache_size == 0) {
+    std::cerr << "Invalid cache configs: cache_size must be positive"
+              << std::endl;
+    exit(1);
+  }
+}
+
+// Run the workload on a cache: lookup each block and insert it on a miss;
+// return the hit rate and report the elapsed time in `us`.
+template <typename Cache_t>
+double run(int64_t& us) {
+  Cache_t cache;
+  cache.init(cache_size);
+  Offsets offsets(num_ops, wl_type, /*size*/ num_blocks, /*align*/ 1,
+                  zipf_theta, rand_seed);
+  uint64_t num_hits = 0;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (auto off : offsets) {
+    if (cache.lookup(off))
+      ++num_hits;
+    else
+      cache.insert(off, /*pin*/ false, /*hint_nonexist*/ true);
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  us = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+  return double(num_hits) / num_ops;
+}
+
+int main(int argc, char* argv[]) {
+  parse_args(argc, argv);
+
+  // we dump all config and data into a csv file for parser
+  std::ofstream ofs_perf(result_dir / "policy.csv");
+  ofs_perf << "workload,num_blocks,num_ops,zipf_theta,cache_size,rand_seed,"
+              "policy,hit_rate,us\n";
+
+  const char* wl_name;
+  switch (wl_type) {
+    case OffsetType::SEQ:
+      wl_name = "seq";
+      break;
+    case OffsetType::UNIF:
+      wl_name = "unif";
+      break;
+    case OffsetType::ZIPF:
+      wl_name = "zipf";
+      break;
+    default:
+      throw std::runtime_error("Unimplemented offset wl_type");
+  }
+  std::cout << "Config: wl_type=" << wl_name << ", num_blocks=" << num_blocks
+            << ", num_ops=" << num_ops << ", zipf_theta=" << zipf_theta
+            << ", cache_size=" << cache_size << ", rand_seed=" << rand_seed
+            << std::endl;
+
+  auto report = [&](const char* policy, double hit_rate, int64_t us) {
+    std::cout << policy << ": hit_rate=" << hit_rate << ", " << us << " us ("
+              << double(us) * 1000 / num_ops << " ns/op)\n";
+    ofs_perf << wl_name << ',' << num_blocks << ',' << num_ops << ','
+             << zipf_theta << ',' << cache_size << ',' << rand_seed << ','
+             << policy << ',' << hit_rate << ',' << us << '\n';
+  };
+
+  int64_t us;
+  double hr;
+  hr = run<gcache::LRUCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("lru", hr, us);
+  hr = run<gcache::ClockCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("clock", hr, us);
+  hr = run<gcache::SLRUCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("slru", hr, us);
+  hr = run<gcache::S3FifoCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("s3fifo", hr, us);
+  hr = run<gcache::SieveCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("sieve", hr, us);
+  hr = run<gcache::TinyLFUCache<uint32_t, uint32_t, gcache::ghash>>(us);
+  report("tinylfu", hr, us);
+
+  return 0;
+}
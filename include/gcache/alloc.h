@@ -0,0 +1,117 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace gcache {
+
+// Allocation policies for the large arrays of a cache, i.e., the node pool and
+// the hash table buckets. An Alloc must provide:
+//   template <typename T> static T* allocate(size_t n);
+//   template <typename T> static void deallocate(T* p, size_t n);
+// where `allocate` returns n default-initialized objects, and `deallocate`
+// must be called with the same n.
+
+// HeapAlloc is the default policy: plain new[]/delete[].
+struct HeapAlloc {
+  template <typename T>
+  static T* allocate(size_t n) {
+    return new T[n];
+  }
+  template <typename T>
+  static void deallocate(T* p, size_t /* n */) {
+    delete[] p;
+  }
+};
+
+enum class HugePage : uint8_t {
+  THP,          // transparent huge pages via madvise(MADV_HUGEPAGE)
+  HUGETLB_2MB,  // explicit 2MB pages from hugetlbfs (vm.nr_hugepages)
+  HUGETLB_1GB,  // explicit 1GB pages from hugetlbfs
+};
+
+// MmapAlloc backs an array with its own anonymous mapping so that it can be
+// mapped by huge pages: random accesses into a multi-GB node pool or table
+// would otherwise miss the TLB almost every time.
+//
+// If the requested hugetlb pages are unavailable (e.g. the hugetlbfs pool is
+// empty), it falls back to THP, which in turn silently degrades to regular
+// pages if THP is disabled; it only throws std::bad_alloc if mmap fails. With
+// Prefault, all pages are populated at allocation instead of on first touch,
+// which moves page faults out of the critical path. Arrays smaller than a THP
+// page (2MB) are allocated from the heap as there is nothing to gain, and
+// hugetlb pages are only tried for arrays of at least one such page; smaller
+// arrays are mapped with THP.
+template <HugePage Kind = HugePage::THP, bool Prefault = false>
+struct MmapAlloc {
+  static constexpr size_t kThpPageSize = size_t{1} << 21;
+  static constexpr size_t kHugePageSize =
+      Kind == HugePage::HUGETLB_1GB ? size_t{1} << 30 : kThpPageSize;
+
+  template <typename T>
+  static T* allocate(size_t n) {
+    if (n * sizeof(T) < kThpPageSize) return HeapAlloc::allocate<T>(n);
+    T* p = static_cast<T*>(map(n * sizeof(T)));
+    std::uninitialized_default_construct_n(p, n);
+    return p;
+  }
+
+  template <typename T>
+  static void deallocate(T* p, size_t n) {
+    if (!p) return;
+    if (n * sizeof(T) < kThpPageSize) return HeapAlloc::deallocate(p, n);
+    std::destroy_n(p, n);
+    munmap(p, map_len(n * sizeof(T)));
+  }
+
+ private:
+  static bool use_hugetlb(size_t size) {
+    return Kind != HugePage::THP && size >= kHugePageSize;
+  }
+
+  // Round size up to the pages it is mapped with; it is the same whether the
+  // hugetlb pages are available or not, so that deallocate can munmap it.
+  static size_t map_len(size_t size) {
+    size_t page = use_hugetlb(size) ? kHugePageSize : kThpPageSize;
+    return (size + page - 1) & ~(page - 1);
+  }
+
+  // Map an array of `used` bytes.
+  static void* map(size_t used) {
+    size_t len = map_len(used);
+    if (use_hugetlb(used)) {
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                  (Kind == HugePage::HUGETLB_1GB ? 30 : 21) << MAP_HUGE_SHIFT;
+      if constexpr (Prefault) flags |= MAP_POPULATE;
+      void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (p != MAP_FAILED) return p;
+    }
+    return map_thp(len, used);
+  }
+
+  static void* map_thp(size_t len, size_t used) {
+    // THP only backs 2MB-aligned ranges, so over-map by one huge page and trim
+    // both ends to make the array start at a 2MB boundary.
+    size_t over_len = len + kThpPageSize;
+    void* m = mmap(nullptr, over_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) throw std::bad_alloc();
+    char* begin = static_cast<char*>(m);
+    char* p = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(begin) + kThpPageSize - 1) &
+        ~(kThpPageSize - 1));
+    if (p > begin) munmap(begin, p - begin);
+    if (begin + over_len > p + len) munmap(p + len, begin + over_len - p - len);
+    madvise(p, len, MADV_HUGEPAGE);  // best effort; fail if THP is disabled
+    if constexpr (Prefault) {
+      for (size_t i = 0; i < used; i += 4096) p[i] = 0;
+    }
+    return p;
+  }
+};
+
+}  // namespace gcache
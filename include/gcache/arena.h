@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gcache {
+
+// ChunkedArena hands out objects from contiguous chunks of (1 << ChunkShift)
+// objects. Unlike std::vector, growing never moves allocated objects, so
+// pointers to them stay valid; an object can also be addressed by the order it
+// is allocated (i.e. its index), which costs one extra load of the chunk
+// pointer. Objects are default-constructed when their chunk is allocated and
+// only destructed with the arena.
+template <typename T, uint32_t ChunkShift = 12>
+class ChunkedArena {
+ public:
+  static constexpr size_t kChunkSize = size_t{1} << ChunkShift;
+
+  ChunkedArena() : chunks_(), size_(0) {}
+  ~ChunkedArena() {
+    for (auto c : chunks_) delete[] c;
+  }
+  ChunkedArena(const ChunkedArena&) = delete;
+  ChunkedArena(ChunkedArena&&) = delete;
+  ChunkedArena& operator=(const ChunkedArena&) = delete;
+  ChunkedArena& operator=(ChunkedArena&&) = delete;
+
+  // Return a new object; its index is the size before this call.
+  T* alloc() {
+    if ((size_ >> ChunkShift) == chunks_.size())
+      chunks_.emplace_back(new T[kChunkSize]);
+    return at(size_++);
+  }
+
+  T* at(size_t idx) const {
+    assert(idx < size_);
+    return &chunks_[idx >> ChunkShift][idx & (kChunkSize - 1)];
+  }
+
+  size_t size() const { return size_; }
+
+  // For each allocated object, call fn(T*) in the order of allocation
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < size_; ++i) fn(at(i));
+  }
+
+ private:
+  std::vector<T*> chunks_;
+  size_t size_;
+};
+
+// SlabArena hands out variable-size byte buffers in power-of-two size classes,
+// carved from chunks of kChunkSize bytes (a buffer larger than that gets its
+// own chunk). A freed buffer goes to the free list of its class and is reused
+// by the next allocation of that class, so once the working set of sizes is
+// stable, no more memory is allocated from the heap. All memory is only
+// returned to the heap with the arena.
+class SlabArena {
+ public:
+  static constexpr uint32_t kMinShift = 4;  // the smallest class is 16 bytes
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  SlabArena() : free_lists_(), chunks_(), cur_(nullptr), left_(0) {}
+  ~SlabArena() {
+    for (auto c : chunks_) delete[] c;
+  }
+  SlabArena(const SlabArena&) = delete;
+  SlabArena(SlabArena&&) = delete;
+  SlabArena& operator=(const SlabArena&) = delete;
+  SlabArena& operator=(SlabArena&&) = delete;
+
+  // Return a buffer of at least `size` (> 0) bytes; `size` is updated to the
+  // actual size of the buffer, which must be passed to `free` later.
+  char* alloc(uint32_t& size) {
+    uint32_t cls = std::max<uint32_t>(kMinShift, std::bit_width(size - 1));
+    assert(cls < 32);
+    size = 1u << cls;
+    if (FreeBuf* b = free_lists_[cls]) {
+      free_lists_[cls] = b->next;
+      return reinterpret_cast<char*>(b);
+    }
+    if (size > kChunkSize) {
+      chunks_.emplace_back(new char[size]);
+      return chunks_.back();
+    }
+    if (left_ < size) {  // the rest of the current chunk is wasted
+      chunks_.emplace_back(new char[kChunkSize]);
+      cur_ = chunks_.back();
+      left_ = kChunkSize;
+    }
+    char* p = cur_;
+    cur_ += size;
+    left_ -= size;
+    return p;
+  }
+
+  void free(char* p, uint32_t size) {
+    assert(std::has_single_bit(size) && size >= (1u << kMinShift));
+    uint32_t cls = std::countr_zero(size);
+    FreeBuf* b = reinterpret_cast<FreeBuf*>(p);
+    b->next = free_lists_[cls];
+    free_lists_[cls] = b;
+  }
+
+ private:
+  struct FreeBuf {
+    FreeBuf* next;
+  };
+
+  FreeBuf* free_lists_[32];
+  std::vector<char*> chunks_;
+  char* cur_;  // the unused part of the last chunk
+  size_t left_;
+};
+
+}  // namespace gcache
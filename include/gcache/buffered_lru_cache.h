@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "lru_cache.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// BufferedLRUCache is a drop-in replacement of LRUCache that defers the LRU
+// promotion of hits, as the read buffers of Caffeine: a hit only records the
+// node in a small ring buffer (and pins it if asked), and the buffered hits
+// are replayed on the LRU list in a batch when the buffer fills or before the
+// next write (insert/erase/install). Since every write drains the buffer
+// first, a buffered node is never recycled before it is replayed, and the
+// eviction order of a single thread is exactly LRU. A replayed hit on the MRU
+// node is skipped, so repeated hits on hot nodes relink once.
+//
+// Lookups never touch the list, so ShardedLRUCache runs them concurrently
+// under a shared lock (see kConcurrentLookup). The buffer is striped by
+// thread, so concurrent readers rarely write the same cache line. The reader
+// that fills a stripe asks for a drain, which ShardedLRUCache only runs if it
+// gets the exclusive lock without waiting; until then, further hits to the
+// full stripe are dropped, so the order is approximately LRU under
+// contention.
+//
+// It provides the same init/insert/lookup/peek/pin/release/erase/install APIs
+// as LRUCache, but not the LRU-specific ones (e.g. for_each_lru); use
+// `get_cache` after `drain` instead.
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class BufferedLRUCache {
+ public:
+  using LRUCache_t = LRUCache<Key_t, Value_t, Hash, Table, Alloc>;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = typename LRUCache_t::Handle_t;
+
+  // Lookup only reads the table, and writes the buffer and pins the node with
+  // atomics.
+  static constexpr bool kConcurrentLookup = true;
+  static constexpr uint32_t kNumStripes = 8;
+  static constexpr uint32_t kStripeSize = 16;
+
+  BufferedLRUCache() : cache_(), stripes_(), drain_pending_(false) {
+    for (auto& s : stripes_) s.tail.store(0, std::memory_order_relaxed);
+  }
+  ~BufferedLRUCache() = default;
+  BufferedLRUCache(const BufferedLRUCache&) = delete;
+  BufferedLRUCache(BufferedLRUCache&&) = delete;
+  BufferedLRUCache& operator=(const BufferedLRUCache&) = delete;
+  BufferedLRUCache& operator=(BufferedLRUCache&&) = delete;
+
+  void init(size_t capacity) { cache_.init(capacity); }
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn) {
+    cache_.init(capacity, fn);
+  }
+
+  size_t size() const { return cache_.size(); }
+  size_t capacity() const { return cache_.capacity(); }
+
+  // For each item in the cache, call fn(handle)
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    cache_.for_each(fn);
+  }
+
+  // Same semantics as LRUCache, except that a hit refreshes LRU later.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    Node_t* e = lookup_impl(key, Hash{}(key), pin);
+    if (drain_pending()) drain();
+    return e;
+  }
+  Handle_t peek(Key_t key, bool pin = false) {
+    return peek_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { cache_.release(handle); }
+  void pin(Handle_t handle) { cache_.pin(handle); }
+  bool erase(Handle_t handle) {
+    drain();
+    return cache_.erase(handle);
+  }
+  Handle_t install(Key_t key) {
+    drain();
+    return cache_.install(key);
+  }
+
+  // Replay the buffered hits on the LRU list; it must not run concurrently
+  // with other operations.
+  void drain();
+  // Whether a stripe of the buffer is full
+  bool drain_pending() const {
+    return drain_pending_.load(std::memory_order_relaxed);
+  }
+
+  // Return a read-only access to the underlying LRUCache, whose LRU list is
+  // only up-to-date after `drain`.
+  const LRUCache_t& get_cache() const { return cache_; }
+
+ private:
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+    drain();
+    return cache_.insert_impl(key, hash, pin, hint_nonexist);
+  }
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  Node_t* peek_impl(Key_t key, uint32_t hash, bool pin) {
+    return cache_.peek_impl(key, hash, pin);
+  }
+
+  // Each thread writes the stripe of its own index, so the stripes of
+  // different threads sit on different cache lines.
+  static uint32_t stripe_idx() {
+    static std::atomic<uint32_t> num_threads{0};
+    thread_local uint32_t idx =
+        num_threads.fetch_add(1, std::memory_order_relaxed) % kNumStripes;
+    return idx;
+  }
+
+  struct alignas(64) Stripe {
+    // Number of hits recorded since the last drain; may exceed kStripeSize,
+    // in which case the extra ones are dropped.
+    std::atomic<uint32_t> tail;
+    std::atomic<Node_t*> slots[kStripeSize];
+  };
+
+  LRUCache_t cache_;
+  Stripe stripes_[kNumStripes];
+  std::atomic<bool> drain_pending_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const {
+    return cache_.print(os, indent);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const BufferedLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename BufferedLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+BufferedLRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(
+    Key_t key, uint32_t hash, bool pin) {
+  Node_t* e = cache_.peek_impl(key, hash, pin);
+  if (!e) return nullptr;
+  // the lock of the caller orders the buffer's writes before the drain
+  Stripe& s = stripes_[stripe_idx()];
+  uint32_t i = s.tail.fetch_add(1, std::memory_order_relaxed);
+  if (i < kStripeSize) s.slots[i].store(e, std::memory_order_relaxed);
+  if (i == kStripeSize - 1)  // the last slot; replay before dropping any
+    drain_pending_.store(true, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void BufferedLRUCache<Key_t, Value_t, Hash, Table, Alloc>::drain() {
+  for (auto& s : stripes_) {
+    uint32_t n = s.tail.load(std::memory_order_relaxed);
+    if (n == 0) continue;
+    n = std::min(n, kStripeSize);
+    for (uint32_t i = 0; i < n; ++i) {
+      Node_t* e = s.slots[i].load(std::memory_order_relaxed);
+      if (cache_.lru_newest() != e) cache_.lookup_refresh(e, /*pin*/ false);
+    }
+    s.tail.store(0, std::memory_order_relaxed);
+  }
+  drain_pending_.store(false, std::memory_order_relaxed);
+}
+
+}  // namespace gcache
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// ClockCache is a drop-in replacement of LRUCache with the CLOCK (second
+// chance) policy, on the same node pool and table. Instead of moving a node to
+// the MRU end, a hit only sets the node's reference bit with a relaxed atomic
+// store; on eviction, a hand sweeps the pool in a circular order, clearing
+// set reference bits and skipping pinned nodes, until it finds a node that is
+// neither referenced nor pinned. A newly inserted node is not referenced.
+//
+// Since a hit never touches any list or the hand, and pinning is an atomic
+// increment, lookups are read-only to the cache structure, so ShardedLRUCache
+// allows them to run concurrently under a shared lock (see kConcurrentLookup).
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but
+// not the LRU-specific ones (e.g. for_each_lru, erase/install).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class ClockCache {
+ public:
+  using Node_t = LRUNode<Key_t, Value_t>;
+  using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Lookup only reads the table, and sets the reference bit and pins the node
+  // with atomics.
+  static constexpr bool kConcurrentLookup = true;
+
+  ClockCache()
+      : size_(0),
+        capacity_(0),
+        hand_(0),
+        pool_(nullptr),
+        ref_bits_(nullptr),
+        table_() {}
+  ~ClockCache() {
+    Alloc::deallocate(pool_, capacity_);
+    Alloc::deallocate(ref_bits_, capacity_);
+  }
+  ClockCache(const ClockCache&) = delete;
+  ClockCache(ClockCache&&) = delete;
+  ClockCache& operator=(const ClockCache&) = delete;
+  ClockCache& operator=(ClockCache&&) = delete;
+
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+  // For each item in the cache, call fn(handle) in the order of the pool
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < size_; ++i) fn(&pool_[i]);
+  }
+
+  // Same semantics as LRUCache, except that a hit sets the reference bit
+  // instead of refreshing LRU.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { handle.node->release(); }
+  void pin(Handle_t handle) {
+    handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  // Advance the hand to find a victim; return nullptr if all are pinned.
+  Node_t* evict();
+
+  size_t index_of(const Node_t* e) const { return e - pool_; }
+
+  // Number of nodes in use; nodes in pool_[size_, capacity_) are free.
+  size_t size_;
+  size_t capacity_;
+  size_t hand_;
+  Node_t* pool_;
+  // One byte per node in pool_, so the hand sweeps a dense array instead of
+  // touching every node.
+  std::atomic<uint8_t>* ref_bits_;
+  Table_t table_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const ClockCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void ClockCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  assert(!capacity_ && !pool_);
+  assert(capacity);
+  capacity_ = capacity;
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  ref_bits_ = Alloc::template allocate<std::atomic<uint8_t>>(capacity);
+  for (size_t i = 0; i < capacity; ++i)
+    ref_bits_[i].store(0, std::memory_order_relaxed);
+  table_.init(capacity);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void ClockCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  init(capacity);
+  for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename ClockCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+ClockCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+  assert(capacity_ > 0);
+  Node_t* e;
+  if (!hint_nonexist) {
+    e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  if (size_ < capacity_) {
+    e = &pool_[size_++];
+  } else {
+    e = evict();
+    if (!e) return nullptr;
+  }
+  e->init(key, hash);
+  ref_bits_[index_of(e)].store(0, std::memory_order_relaxed);
+  table_.insert(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename ClockCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+ClockCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(Key_t key,
+                                                            uint32_t hash,
+                                                            bool pin) {
+  Node_t* e = table_.lookup(key, hash);
+  if (!e) return nullptr;
+  // skip the store if the bit is already set, so a hot node's cache line is
+  // not bounced between cores
+  auto& bit = ref_bits_[index_of(e)];
+  if (!bit.load(std::memory_order_relaxed))
+    bit.store(1, std::memory_order_relaxed);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename ClockCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+ClockCache<Key_t, Value_t, Hash, Table, Alloc>::evict() {
+  // in two rounds, all reference bits are cleared, so any unpinned node must
+  // have been found
+  for (size_t i = 0; i < 2 * capacity_; ++i) {
+    size_t idx = hand_;
+    if (++hand_ == capacity_) hand_ = 0;
+    Node_t* e = &pool_[idx];
+    if (e->refs.load(std::memory_order_acquire) > 1) continue;  // pinned
+    if (ref_bits_[idx].load(std::memory_order_relaxed)) {
+      ref_bits_[idx].store(0, std::memory_order_relaxed);
+      continue;
+    }
+    [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+    assert(e_ == e);
+    return e;
+  }
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& ClockCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "ClockCache (capacity=" << capacity_ << ", hand=" << hand_ << ") {\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "pool: [";
+  for (size_t i = 0; i < size_; ++i) {
+    if (i) os << ", ";
+    os << pool_[i].key;
+    if (ref_bits_[i].load(std::memory_order_relaxed)) os << '*';
+    if (pool_[i].refs.load() > 1) os << " (pinned)";
+  }
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
@@ -0,0 +1,762 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "arena.h"
+#include "node.h"
+
+namespace gcache {
+
+template <typename Key_t, typename Value_t>
+class CompactNodePool;
+
+template <typename Key_t, typename Value_t>
+class CompactNodeTable;
+
+template <typename Key_t, typename Value_t, typename Hash>
+class CompactLRUCache;
+
+// CompactLRUNode is the counterpart of LRUNode that links nodes by 32-bit
+// indices into its CompactNodePool instead of 8-byte pointers, which shrinks
+// the per-node metadata from 32 bytes to 20 bytes, e.g., a GhostCache node
+// takes 28 bytes instead of 40 bytes.
+template <typename Key_t, typename Value_t>
+class CompactLRUNode {
+  uint32_t next_hash;
+  uint32_t next;
+  uint32_t prev;
+  uint32_t refs;  // References, including cache reference, if present.
+
+ protected:
+  friend class CompactNodePool<Key_t, Value_t>;
+  friend class CompactNodeTable<Key_t, Value_t>;
+
+  template <typename K, typename V, typename H>
+  friend class CompactLRUCache;
+
+ public:
+  uint32_t hash;  // Hash of key; used for fast sharding and comparisons
+  Key_t key;
+  Value_t value;
+
+  void init(Key_t k, uint32_t h) {
+    this->refs = 1;
+    this->hash = h;
+    this->key = k;
+  }
+
+  // print for debugging
+  friend std::ostream& operator<<(std::ostream& os, const CompactLRUNode& h) {
+    // value may not be printable...
+    return os << h.key << " (refs=" << h.refs << ", hash=" << h.hash << ")";
+  }
+};
+
+// CompactLRUHandle is essentially just CompactLRUNode*; see LRUHandle.
+template <typename Key_t, typename Value_t>
+class CompactLRUHandle : public BaseHandle<CompactLRUNode<Key_t, Value_t>> {
+ private:
+  using Node_t = CompactLRUNode<Key_t, Value_t>;
+  using BaseHandle<Node_t>::node;  // otherwise `node` will be invisible
+
+ protected:
+  template <typename K, typename V, typename H>
+  friend class CompactLRUCache;
+
+  template <typename H, typename M, typename C>
+  friend class GhostCache;
+
+ public:
+  CompactLRUHandle(Node_t* node) : BaseHandle<Node_t>(node) {}
+  CompactLRUHandle() = default;
+  CompactLRUHandle(const CompactLRUHandle&) = default;
+  CompactLRUHandle(CompactLRUHandle&&) noexcept = default;
+  CompactLRUHandle& operator=(const CompactLRUHandle&) = default;
+  CompactLRUHandle& operator=(CompactLRUHandle&&) noexcept = default;
+
+  // overload -> and * to use CompactLRUHandle like Value_t*
+  Value_t* operator->() { return &node->value; }
+  const Value_t* operator->() const { return &node->value; }
+  Value_t& operator*() { return node->value; }
+  const Value_t& operator*() const { return node->value; }
+
+  Key_t get_key() const { return node->key; }
+};
+
+// CompactNodePool owns all nodes of a CompactLRUCache and maps between a node
+// and its index. Nodes allocated by `init` are in one contiguous array, and
+// nodes added later (by `install`) are in a chunked arena indexed after them.
+// The first kNumHeads nodes are reserved as dummy list heads, so index 0 never
+// refers to a real node and can be used as null.
+template <typename Key_t, typename Value_t>
+class CompactNodePool {
+ private:
+  using Node_t = CompactLRUNode<Key_t, Value_t>;
+
+ public:
+  static constexpr uint32_t kNull = 0;
+  static constexpr uint32_t kNumHeads = 4;
+
+  CompactNodePool() : pool_(nullptr), pool_size_(0), extra_pool_() {}
+  ~CompactNodePool() { delete[] pool_; }
+
+  void init(size_t capacity) {
+    assert(!pool_);
+    assert(capacity + kNumHeads <= UINT32_MAX);
+    pool_size_ = capacity + kNumHeads;
+    pool_ = new Node_t[pool_size_];
+  }
+
+  Node_t* node(uint32_t idx) const {
+    if (idx < pool_size_) [[likely]]
+      return &pool_[idx];
+    return extra_pool_.at(idx - pool_size_);
+  }
+
+  // Every node is in exactly one list (including the free and erased ones),
+  // so a node outside the contiguous array can find its index from its prev.
+  uint32_t index_of(const Node_t* e) const {
+    auto offset = reinterpret_cast<uintptr_t>(e) -
+                  reinterpret_cast<uintptr_t>(pool_);
+    if (offset < pool_size_ * sizeof(Node_t)) [[likely]]
+      return offset / sizeof(Node_t);
+    return node(e->prev)->next;
+  }
+
+  // Allocate a new node outside the contiguous array; return its index.
+  uint32_t alloc_extra() {
+    assert(pool_size_ + extra_pool_.size() < UINT32_MAX);
+    extra_pool_.alloc();
+    return pool_size_ + extra_pool_.size() - 1;
+  }
+
+ private:
+  Node_t* pool_;
+  uint32_t pool_size_;
+  ChunkedArena<Node_t> extra_pool_;
+};
+
+// CompactNodeTable is NodeTable with 4-byte buckets and links: each bucket is
+// the index of the first node in the chain, and the chain is linked by
+// next_hash indices. It grows/shrinks incrementally in the same way.
+template <typename Key_t, typename Value_t>
+class CompactNodeTable {
+ private:
+  using Node_t = CompactLRUNode<Key_t, Value_t>;
+  using Pool_t = CompactNodePool<Key_t, Value_t>;
+  static constexpr uint32_t kNull = Pool_t::kNull;
+
+ public:
+  CompactNodeTable()
+      : pool_(nullptr),
+        length_(0),
+        min_length_(0),
+        elems_(0),
+        list_(nullptr),
+        old_length_(0),
+        migrate_idx_(0),
+        old_list_(nullptr) {}
+  ~CompactNodeTable() {
+    delete[] list_;
+    delete[] old_list_;
+  }
+
+  void init(const Pool_t* pool, size_t size);
+
+  // Caller must ensure e's key does not already present in table!
+  void insert(uint32_t idx);
+  // Return the index of the matched node; kNull if not found.
+  uint32_t lookup(Key_t key, uint32_t hash);
+  uint32_t remove(Key_t key, uint32_t hash);
+
+  void prefetch_bucket(uint32_t hash) { __builtin_prefetch(bucket(hash)); }
+  void prefetch_node(uint32_t hash) {
+    if (uint32_t idx = *bucket(hash)) __builtin_prefetch(pool_->node(idx));
+  }
+
+ private:
+  static constexpr uint32_t kMigrateBuckets = 4;
+
+  uint32_t* bucket(uint32_t hash);
+  // Return a pointer to the slot (a bucket or a next_hash) that holds the
+  // index of the matched node, or the trailing slot of the chain.
+  uint32_t* find_pointer(Key_t key, uint32_t hash);
+
+  bool is_resizing() const { return old_list_ != nullptr; }
+  void resize(uint32_t length);
+  void migrate();
+
+  const Pool_t* pool_;
+  uint32_t length_;
+  uint32_t min_length_;
+  size_t elems_;
+  uint32_t* list_;
+
+  uint32_t old_length_;
+  uint32_t migrate_idx_;
+  uint32_t* old_list_;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+};
+
+// CompactLRUCache has the same semantics and APIs as LRUCache (except those
+// only for SharedCache), but its nodes are CompactLRUNode. Use it when the
+// number of entries is large enough that the metadata dominates the memory,
+// e.g., a GhostCache tracking 100M+ blocks. The cost is an extra branch for
+// every index to pointer translation.
+template <typename Key_t, typename Value_t, typename Hash>
+class CompactLRUCache {
+ public:
+  using Node_t = CompactLRUNode<Key_t, Value_t>;
+  using Handle_t = CompactLRUHandle<Key_t, Value_t>;
+
+  CompactLRUCache() : size_(0), capacity_(0), pool_(), table_() {}
+  ~CompactLRUCache() = default;
+  CompactLRUCache(const CompactLRUCache&) = delete;
+  CompactLRUCache(CompactLRUCache&&) = delete;
+  CompactLRUCache& operator=(const CompactLRUCache&) = delete;
+  CompactLRUCache& operator=(CompactLRUCache&&) = delete;
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+  // Same as LRUCache
+  template <typename Fn>
+  void for_each(Fn&& fn) const;
+  template <typename Fn>
+  void for_each_lru(Fn&& fn) const;
+  template <typename Fn>
+  void for_each_mru(Fn&& fn) const;
+  template <typename Fn>
+  void for_each_in_use(Fn&& fn) const;
+  template <typename Fn>
+  void for_each_until_lru(Fn&& fn) const;
+  template <typename Fn>
+  void for_each_until_mru(Fn&& fn) const;
+
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false);
+  Handle_t lookup(Key_t key, bool pin = false);
+  void release(Handle_t handle);
+  void pin(Handle_t handle);
+  bool erase(Handle_t handle);
+  Handle_t install(Key_t key);
+
+ private:
+  /****************************************************************************/
+  /* Below are intrusive functions that should only be called by GhostCache   */
+  /****************************************************************************/
+
+  // Same as LRUCache::refresh
+  Handle_t refresh(Key_t key, uint32_t hash, Handle_t& successor);
+  Node_t* next_of(Node_t* e) const { return node(e->next); }
+  Node_t* lru_oldest() const { return node(node(kLRU)->next); }
+  void prefetch(const uint32_t* hashes, size_t n);
+  static constexpr size_t kPrefetchBatch = 16;
+  // Same as LRUCache::restore
+  Node_t* restore(Key_t key, uint32_t hash);
+
+ private:
+  // Indices of dummy heads
+  static constexpr uint32_t kLRU = 0;
+  static constexpr uint32_t kInUse = 1;
+  static constexpr uint32_t kFree = 2;
+  static constexpr uint32_t kErased = 3;
+  static constexpr uint32_t kNull = CompactNodePool<Key_t, Value_t>::kNull;
+
+  Node_t* node(uint32_t idx) const { return pool_.node(idx); }
+
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  void lookup_refresh(uint32_t idx, bool pin);
+
+  uint32_t alloc_node();  // return kNull if fails
+  void list_remove(uint32_t idx);
+  void list_append(uint32_t list, uint32_t idx);
+  bool reclaim_in_use();  // same as LRUCache::reclaim_in_use
+  Node_t* lru_refresh(uint32_t idx);
+
+  size_t size_;
+  size_t capacity_;
+  CompactNodePool<Key_t, Value_t> pool_;
+  CompactNodeTable<Key_t, Value_t> table_;
+
+  template <typename H, typename M, typename C>
+  friend class GhostCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  std::ostream& print_list(std::ostream& os, uint32_t list) const;
+  friend std::ostream& operator<<(std::ostream& os, const CompactLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t>
+inline void CompactNodeTable<Key_t, Value_t>::init(const Pool_t* pool,
+                                                   size_t size) {
+  pool_ = pool;
+  size = std::bit_ceil<size_t>(size);
+  length_ = size;
+  min_length_ = size;
+  list_ = new uint32_t[length_];
+  memset(list_, 0, sizeof(list_[0]) * length_);
+}
+
+template <typename Key_t, typename Value_t>
+inline void CompactNodeTable<Key_t, Value_t>::insert(uint32_t idx) {
+  Node_t* e = pool_->node(idx);
+  // Caller must ensure e->key is not present in the table!
+  assert(!lookup(e->key, e->hash));
+  if (is_resizing()) {
+    migrate();
+  } else if (elems_ >= length_) {
+    resize(length_ * 2);
+    migrate();
+  }
+  uint32_t* ptr = bucket(e->hash);
+  e->next_hash = *ptr;
+  *ptr = idx;
+  ++elems_;
+}
+
+template <typename Key_t, typename Value_t>
+inline uint32_t CompactNodeTable<Key_t, Value_t>::lookup(Key_t key,
+                                                         uint32_t hash) {
+  assert(length_ > 0);
+  return *find_pointer(key, hash);
+}
+
+template <typename Key_t, typename Value_t>
+inline uint32_t CompactNodeTable<Key_t, Value_t>::remove(Key_t key,
+                                                         uint32_t hash) {
+  assert(length_ > 0);
+  uint32_t* ptr = find_pointer(key, hash);
+  uint32_t result = *ptr;
+  if (result == kNull) return kNull;
+  *ptr = pool_->node(result)->next_hash;
+  --elems_;
+  if (is_resizing()) {
+    migrate();
+  } else if (elems_ < length_ / 4 && length_ > min_length_) {
+    resize(length_ / 2);
+    migrate();
+  }
+  return result;
+}
+
+template <typename Key_t, typename Value_t>
+inline uint32_t* CompactNodeTable<Key_t, Value_t>::bucket(uint32_t hash) {
+  if (is_resizing()) {
+    uint32_t old_idx = hash & (old_length_ - 1);
+    if (old_idx >= migrate_idx_) return &old_list_[old_idx];
+  }
+  return &list_[hash & (length_ - 1)];
+}
+
+template <typename Key_t, typename Value_t>
+inline uint32_t* CompactNodeTable<Key_t, Value_t>::find_pointer(
+    Key_t key, uint32_t hash) {
+  uint32_t* ptr = bucket(hash);
+  while (*ptr != kNull) {
+    Node_t* e = pool_->node(*ptr);
+    if (e->hash == hash && key == e->key) break;
+    ptr = &e->next_hash;
+  }
+  return ptr;
+}
+
+template <typename Key_t, typename Value_t>
+inline void CompactNodeTable<Key_t, Value_t>::resize(uint32_t length) {
+  assert(!is_resizing());
+  old_list_ = list_;
+  old_length_ = length_;
+  migrate_idx_ = 0;
+  length_ = length;
+  list_ = new uint32_t[length_];
+  memset(list_, 0, sizeof(list_[0]) * length_);
+}
+
+template <typename Key_t, typename Value_t>
+inline void CompactNodeTable<Key_t, Value_t>::migrate() {
+  assert(is_resizing());
+  uint32_t end = std::min(migrate_idx_ + kMigrateBuckets, old_length_);
+  for (; migrate_idx_ < end; ++migrate_idx_) {
+    uint32_t idx = old_list_[migrate_idx_];
+    while (idx != kNull) {
+      Node_t* e = pool_->node(idx);
+      uint32_t next = e->next_hash;
+      uint32_t* ptr = &list_[e->hash & (length_ - 1)];
+      e->next_hash = *ptr;
+      *ptr = idx;
+      idx = next;
+    }
+  }
+  if (migrate_idx_ == old_length_) {
+    delete[] old_list_;
+    old_list_ = nullptr;
+    old_length_ = 0;
+    migrate_idx_ = 0;
+  }
+}
+
+template <typename Key_t, typename Value_t>
+inline std::ostream& CompactNodeTable<Key_t, Value_t>::print(
+    std::ostream& os, int indent) const {
+  os << "CompactNodeTable (length=" << length_ << ", size=" << elems_
+     << ") {\n";
+  auto print_chain = [&](uint32_t idx) {
+    if (idx == kNull) return;
+    for (int j = 0; j < indent; ++j) os << '\t';
+    for (; idx != kNull; idx = pool_->node(idx)->next_hash)
+      os << '\t' << *pool_->node(idx) << ';';
+    os << '\n';
+  };
+  for (size_t i = 0; i < length_; ++i) print_chain(list_[i]);
+  for (size_t i = migrate_idx_; i < old_length_; ++i) print_chain(old_list_[i]);
+  for (int j = 0; j < indent; ++j) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::init(size_t capacity) {
+  assert(!capacity_);
+  assert(capacity);
+  capacity_ = capacity;
+  pool_.init(capacity);
+  // Make empty circular linked lists.
+  for (uint32_t i = 0; i < CompactNodePool<Key_t, Value_t>::kNumHeads; ++i) {
+    node(i)->next = i;
+    node(i)->prev = i;
+  }
+  // Put these entries into free list
+  uint32_t begin = CompactNodePool<Key_t, Value_t>::kNumHeads;
+  for (uint32_t i = begin; i < begin + capacity; ++i) list_append(kFree, i);
+  table_.init(&pool_, capacity);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::init(size_t capacity,
+                                                        Fn&& fn) {
+  init(capacity);
+  for (uint32_t i = node(kFree)->next; i != kFree; i = node(i)->next)
+    fn(node(i));
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each(Fn&& fn) const {
+  for_each_lru(fn);
+  for_each_in_use(fn);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each_lru(
+    Fn&& fn) const {
+  for (uint32_t i = node(kLRU)->next; i != kLRU; i = node(i)->next)
+    fn(node(i));
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each_mru(
+    Fn&& fn) const {
+  for (uint32_t i = node(kLRU)->prev; i != kLRU; i = node(i)->prev)
+    fn(node(i));
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each_in_use(
+    Fn&& fn) const {
+  for (uint32_t i = node(kInUse)->next; i != kInUse; i = node(i)->next)
+    fn(node(i));
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each_until_lru(
+    Fn&& fn) const {
+  for (uint32_t i = node(kLRU)->next; i != kLRU; i = node(i)->next)
+    if (!fn(node(i))) break;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+template <typename Fn>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::for_each_until_mru(
+    Fn&& fn) const {
+  for (uint32_t i = node(kLRU)->prev; i != kLRU; i = node(i)->prev)
+    if (!fn(node(i))) break;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Handle_t
+CompactLRUCache<Key_t, Value_t, Hash>::insert(Key_t key, bool pin,
+                                              bool hint_nonexist) {
+  return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Node_t*
+CompactLRUCache<Key_t, Value_t, Hash>::insert_impl(Key_t key, uint32_t hash,
+                                                   bool pin,
+                                                   bool hint_nonexist) {
+  // Disable support for capacity_ == 0; the user must set capacity first
+  assert(capacity_ > 0);
+
+  if (!hint_nonexist) {  // if not sure whether the key exists, do lookup
+    Node_t* e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  uint32_t idx = alloc_node();
+  if (idx == kNull) return nullptr;
+  Node_t* e = node(idx);
+  e->init(key, hash);
+  table_.insert(idx);
+  if (pin) e->refs++;
+  list_append(kLRU, idx);
+  ++size_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Handle_t
+CompactLRUCache<Key_t, Value_t, Hash>::lookup(Key_t key, bool pin) {
+  return lookup_impl(key, Hash{}(key), pin);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Node_t*
+CompactLRUCache<Key_t, Value_t, Hash>::lookup_impl(Key_t key, uint32_t hash,
+                                                   bool pin) {
+  uint32_t idx = table_.lookup(key, hash);
+  if (idx == kNull) return nullptr;
+  lookup_refresh(idx, pin);
+  return node(idx);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::release(Handle_t handle) {
+  // release can only called if the caller has previously pinned the handle;
+  // pinning a handle must make its refs >= 2; same as LRUCache, it does not
+  // move the node between lists
+  assert(handle.node->refs > 1);
+  --handle.node->refs;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::pin(Handle_t handle) {
+  ++handle.node->refs;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline bool CompactLRUCache<Key_t, Value_t, Hash>::erase(Handle_t handle) {
+  Node_t* e = handle.node;
+  assert(e);
+  if (e->refs != 1) return false;
+  uint32_t idx = pool_.index_of(e);
+  list_remove(idx);
+  list_append(kErased, idx);
+  // decrement refs to detect "double-erase" issue; see LRUCache::erase
+  --e->refs;
+  [[maybe_unused]] uint32_t idx_;
+  idx_ = table_.remove(e->key, e->hash);
+  assert(idx_ == idx);
+  --size_;
+  --capacity_;
+  return true;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Handle_t
+CompactLRUCache<Key_t, Value_t, Hash>::install(Key_t key) {
+  uint32_t idx = node(kErased)->next;
+  if (idx == kErased) {
+    idx = pool_.alloc_extra();  // caller is responsible for setting the value
+  } else {
+    list_remove(idx);
+  }
+  Node_t* e = node(idx);
+  e->init(key, Hash{}(key));
+  table_.insert(idx);
+  list_append(kLRU, idx);
+  ++size_;
+  ++capacity_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Handle_t
+CompactLRUCache<Key_t, Value_t, Hash>::refresh(Key_t key, uint32_t hash,
+                                               Handle_t& successor) {
+  // Disable support for capacity_ == 0; the user must set capacity first
+  assert(capacity_ > 0);
+
+  // Search to see if already exists
+  uint32_t idx = table_.lookup(key, hash);
+  if (idx != kNull) {
+    successor = lru_refresh(idx);
+    return node(idx);
+  }
+
+  successor = nullptr;
+  idx = alloc_node();
+  if (idx == kNull) return nullptr;
+  Node_t* e = node(idx);
+  e->init(key, hash);
+  table_.insert(idx);
+  list_append(kLRU, idx);
+  ++size_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Node_t*
+CompactLRUCache<Key_t, Value_t, Hash>::restore(Key_t key, uint32_t hash) {
+  uint32_t idx = node(kFree)->next;
+  if (idx == kFree) return nullptr;
+  list_remove(idx);
+  Node_t* e = node(idx);
+  e->init(key, hash);
+  table_.insert(idx);
+  list_append(kLRU, idx);
+  ++size_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::prefetch(
+    const uint32_t* hashes, size_t n) {
+  for (size_t i = 0; i < n; ++i) table_.prefetch_bucket(hashes[i]);
+  for (size_t i = 0; i < n; ++i) table_.prefetch_node(hashes[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::lookup_refresh(
+    uint32_t idx, bool pin) {
+  list_remove(idx);
+  list_append(kLRU, idx);
+  if (pin) ++node(idx)->refs;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline uint32_t CompactLRUCache<Key_t, Value_t, Hash>::alloc_node() {
+  uint32_t idx = node(kFree)->next;
+  if (idx != kFree) {  // Allocate from free list
+    list_remove(idx);
+    return idx;
+  }
+
+  // Evict one handle from LRU and recycle it; see LRUCache::evict_lru
+  reclaim_in_use();
+  do {
+    while ((idx = node(kLRU)->next) != kLRU) {
+      Node_t* e = node(idx);
+      list_remove(idx);  // Remove from lru_
+      if (e->refs > 1) {
+        list_append(kInUse, idx);
+        continue;
+      }
+      [[maybe_unused]] uint32_t idx_;
+      idx_ = table_.remove(e->key, e->hash);
+      assert(idx_ == idx);
+      --size_;
+      return idx;
+    }
+  } while (reclaim_in_use());
+  return kNull;  // No more space
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline bool CompactLRUCache<Key_t, Value_t, Hash>::reclaim_in_use() {
+  bool reclaimed = false;
+  for (uint32_t idx = node(kInUse)->next; idx != kInUse;) {
+    uint32_t next = node(idx)->next;
+    if (node(idx)->refs == 1) {
+      list_remove(idx);
+      list_append(kLRU, idx);
+      reclaimed = true;
+    }
+    idx = next;
+  }
+  return reclaimed;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::list_remove(uint32_t idx) {
+  Node_t* e = node(idx);
+  node(e->next)->prev = e->prev;
+  node(e->prev)->next = e->next;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline void CompactLRUCache<Key_t, Value_t, Hash>::list_append(uint32_t list,
+                                                               uint32_t idx) {
+  // Make "e" newest entry by inserting just before *list
+  Node_t* e = node(idx);
+  Node_t* l = node(list);
+  e->next = list;
+  e->prev = l->prev;
+  node(e->prev)->next = idx;
+  l->prev = idx;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline typename CompactLRUCache<Key_t, Value_t, Hash>::Node_t*
+CompactLRUCache<Key_t, Value_t, Hash>::lru_refresh(uint32_t idx) {
+  assert(idx != kLRU);
+  Node_t* e = node(idx);
+  assert(e->refs == 1);
+  uint32_t successor = e->next;
+  if (successor == kLRU) return e;  // no need to move
+  list_remove(idx);
+  list_append(kLRU, idx);
+  return node(successor);
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline std::ostream& CompactLRUCache<Key_t, Value_t, Hash>::print_list(
+    std::ostream& os, uint32_t list) const {
+  for (uint32_t i = node(list)->next; i != list; i = node(i)->next) {
+    assert(node(node(i)->next)->prev == i);
+    if (i != node(list)->next) os << ", ";
+    os << node(i)->key;
+  }
+  return os;
+}
+
+template <typename Key_t, typename Value_t, typename Hash>
+inline std::ostream& CompactLRUCache<Key_t, Value_t, Hash>::print(
+    std::ostream& os, int indent) const {
+  os << "CompactLRUCache (capacity=" << capacity_ << ") {\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "lru:    [";
+  print_list(os, kLRU);
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "in_use: [";
+  print_list(os, kInUse);
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
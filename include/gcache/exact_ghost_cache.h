@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "fenwick_tree.h"
+#include "ghost_cache.h"
+#include "hash.h"
+#include "lru_cache.h"
+#include "stat.h"
+
+namespace gcache {
+
+/**
+ * Simulate LRU caches of every size from 1 to max_size at once, i.e., an exact
+ * miss ratio curve at single-block resolution, with Olken's algorithm: each
+ * block carries the timestamp of its last access, and a Fenwick tree counts
+ * the live timestamps, so the stack distance of a hit is the number of blocks
+ * accessed after it, found in O(log max_size) regardless of the distance.
+ * GhostCache instead moves one boundary per tick below the distance, so its
+ * cost grows with the number of ticks.
+ *
+ * Timestamps live in a window of 2 * max_size; once it is used up, the blocks
+ * are renumbered in LRU order and the tree is rebuilt in O(max_size), which
+ * is amortized O(1) per access. The distance histogram can be read for any
+ * size, or downsampled to any grid of sizes with get_stats.
+ */
+template <typename Hash = ghash,
+          typename Cache = LRUCache<uint32_t, uint32_t, Hash>>
+class ExactGhostCache {
+ public:
+  using Handle_t = typename Cache::Handle_t;
+  using Node_t = typename Cache::Node_t;
+  using Key_t = decltype(Node_t::key);
+
+ protected:
+  const uint32_t max_size;
+  const uint32_t window;  // number of timestamps before renumbering
+  uint32_t now;           // the timestamp of the next access
+
+  // Key is block_id/block number; value is the timestamp of its last access
+  Cache cache;
+  // Counts the timestamps of the blocks in cache
+  FenwickTree timestamps;
+
+  // reuse_distances[d] counts the hits of stack distance d (1 for MRU)
+  std::vector<uint32_t> reuse_distances;
+  uint32_t reuse_count;  // count all access to reuse_distances
+  // hit_cnts[s] is the number of hits of cache size s; built lazily
+  std::vector<uint32_t> hit_cnts;
+  bool hit_cnts_stale;
+
+  Handle_t access_impl(Key_t block_id, uint32_t hash, AccessMode mode);
+  void access_batch_impl(const Key_t* block_ids, const uint32_t* hashes,
+                         size_t n, AccessMode mode);
+
+  static constexpr size_t kPrefetchBatch = Cache::kPrefetchBatch;
+
+  // Renumber the blocks to [0, size) in LRU order and rebuild the tree
+  void renumber();
+  void build_hit_cnts();
+
+ public:
+  explicit ExactGhostCache(uint32_t max_size)
+      : max_size(max_size),
+        window(max_size * 2),
+        now(0),
+        cache(),
+        timestamps(window),
+        reuse_distances(max_size + 1, 0),
+        reuse_count(0),
+        hit_cnts(max_size + 1, 0),
+        hit_cnts_stale(false) {
+    assert(max_size > 0);
+    assert(max_size <= UINT32_MAX / 2);
+    cache.init(max_size);
+  }
+
+  void access(Key_t block_id, AccessMode mode = AccessMode::DEFAULT) {
+    access_impl(block_id, Hash{}(block_id), mode);
+  }
+
+  // Same as calling access on each block in order, but the hash buckets and
+  // nodes of a batch are prefetched first (see GhostCache::access_batch).
+  void access_batch(const Key_t* block_ids, size_t n,
+                    AccessMode mode = AccessMode::DEFAULT) {
+    uint32_t hashes[kPrefetchBatch];
+    for (size_t i = 0; i < n; i += kPrefetchBatch) {
+      size_t m = std::min(n - i, kPrefetchBatch);
+      for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(block_ids[i + j]);
+      access_batch_impl(block_ids + i, hashes, m, mode);
+    }
+  }
+
+  [[nodiscard]] uint32_t get_max_size() const { return max_size; }
+
+  // Stat of any cache size in [1, max_size]
+  [[nodiscard]] CacheStat get_stat(uint32_t cache_size) {
+    assert(cache_size > 0);
+    assert(cache_size <= max_size);
+    if (hit_cnts_stale) build_hit_cnts();
+    CacheStat stat;
+    stat.hit_cnt = hit_cnts[cache_size];
+    stat.miss_cnt = reuse_count - hit_cnts[cache_size];
+    return stat;
+  }
+  [[nodiscard]] double get_hit_rate(uint32_t cache_size) {
+    return get_stat(cache_size).get_hit_rate();
+  }
+  [[nodiscard]] double get_miss_rate(uint32_t cache_size) {
+    return get_stat(cache_size).get_miss_rate();
+  }
+  // Stats of the sizes min_size, min_size + tick, ..., max_size, i.e., the
+  // same grid as a GhostCache(tick, min_size, max_size)
+  [[nodiscard]] std::vector<CacheStat> get_stats(uint32_t tick,
+                                                 uint32_t min_size,
+                                                 uint32_t max_size) {
+    assert(tick > 0);
+    assert((max_size - min_size) % tick == 0);
+    std::vector<CacheStat> stats;
+    stats.reserve((max_size - min_size) / tick + 1);
+    for (uint64_t s = min_size; s <= max_size; s += tick)
+      stats.emplace_back(get_stat(s));
+    return stats;
+  }
+
+  // Stats of any sorted sizes, e.g., the grid of a non-uniform GhostCache
+  [[nodiscard]] std::vector<CacheStat> get_stats(
+      const std::vector<uint32_t>& sizes) {
+    std::vector<CacheStat> stats;
+    stats.reserve(sizes.size());
+    for (auto s : sizes) stats.emplace_back(get_stat(s));
+    return stats;
+  }
+
+  void reset_stat() {
+    reuse_count = 0;
+    std::fill(reuse_distances.begin(), reuse_distances.end(), 0);
+    hit_cnts_stale = true;
+  }
+
+  // For each item in the LRU list, call fn in LRU order
+  template <typename Fn>
+  void for_each_lru(Fn&& fn) const {
+    cache.for_each_lru([&fn](Handle_t h) { fn(h.get_key()); });
+  }
+
+  // For each item in the LRU list, call fn in MRU order
+  template <typename Fn>
+  void for_each_mru(Fn&& fn) const {
+    cache.for_each_mru([&fn](Handle_t h) { fn(h.get_key()); });
+  }
+
+  std::ostream& print(std::ostream& os, int indent = 0);
+  friend std::ostream& operator<<(std::ostream& os, ExactGhostCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Hash, typename Cache>
+inline typename ExactGhostCache<Hash, Cache>::Handle_t
+ExactGhostCache<Hash, Cache>::access_impl(Key_t block_id, uint32_t hash,
+                                          AccessMode mode) {
+  if (now == window) renumber();
+
+  // if the block is a miss, refresh recycles the LRU node, so read its
+  // timestamp first
+  Node_t* oldest = cache.size() == max_size ? cache.lru_oldest() : nullptr;
+  uint32_t oldest_ts = oldest ? oldest->value : 0;
+
+  Handle_t s;  // successor
+  Handle_t h = cache.refresh(block_id, hash, s);
+  assert(h);  // Since there is no handle in use, allocation must never fail.
+
+  uint32_t distance = 0;  // 0 if it is a miss for all cache sizes
+  if (s) {
+    // blocks accessed after this one have larger timestamps
+    uint32_t ts = *h;
+    distance = cache.size() - timestamps.prefix(ts) + 1;
+    timestamps.add(ts, -1);
+  } else if (oldest) {
+    timestamps.add(oldest_ts, -1);
+  }
+  *h = now;
+  timestamps.add(now, 1);
+  ++now;
+
+  switch (mode) {
+    case AccessMode::DEFAULT:
+      if (distance) ++reuse_distances[distance];
+      ++reuse_count;
+      break;
+    case AccessMode::AS_MISS:
+      ++reuse_count;
+      break;
+    case AccessMode::AS_HIT:
+      ++reuse_distances[1];
+      ++reuse_count;
+      break;
+    case AccessMode::NOOP:
+      return h;
+  }
+  hit_cnts_stale = true;
+  return h;
+}
+
+template <typename Hash, typename Cache>
+inline void ExactGhostCache<Hash, Cache>::access_batch_impl(
+    const Key_t* block_ids, const uint32_t* hashes, size_t n,
+    AccessMode mode) {
+  assert(n <= kPrefetchBatch);
+  cache.prefetch(hashes, n);
+  for (size_t i = 0; i < n; ++i) access_impl(block_ids[i], hashes[i], mode);
+}
+
+template <typename Hash, typename Cache>
+inline void ExactGhostCache<Hash, Cache>::renumber() {
+  uint32_t ts = 0;
+  cache.for_each_lru([&ts](Handle_t h) { *h = ts++; });
+  assert(ts == cache.size());
+  timestamps.assign_ones(ts);
+  now = ts;
+}
+
+template <typename Hash, typename Cache>
+inline void ExactGhostCache<Hash, Cache>::build_hit_cnts() {
+  uint32_t accum_hit_cnt = 0;
+  for (size_t d = 1; d <= max_size; ++d) {
+    accum_hit_cnt += reuse_distances[d];
+    hit_cnts[d] = accum_hit_cnt;
+  }
+  hit_cnts_stale = false;
+}
+
+template <typename Hash, typename Cache>
+inline std::ostream& ExactGhostCache<Hash, Cache>::print(std::ostream& os,
+                                                         int indent) {
+  os << "ExactGhostCache (max=" << max_size << ", size=" << cache.size()
+     << ") {\n";
+  // the full curve is too long to print; print it at powers of two
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "Stat: [1: " << get_stat(1);
+  for (uint64_t s = 2; s < max_size; s *= 2)
+    os << ", " << s << ": " << get_stat(s);
+  if (max_size > 1) os << ", " << max_size << ": " << get_stat(max_size);
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  cache.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+// ExactGhostCache for 64-bit block ids
+template <typename Hash = ghash>
+using ExactGhostCache64 =
+    ExactGhostCache<Hash, LRUCache<uint64_t, uint32_t, Hash>>;
+
+}  // namespace gcache
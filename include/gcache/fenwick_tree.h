@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gcache {
+
+// FenwickTree (binary indexed tree) keeps counters at positions [0, n) and
+// answers prefix sums in O(log n). Node i covers the positions
+// [i & (i + 1), i], so both add and prefix walk at most log(n) nodes.
+class FenwickTree {
+ public:
+  FenwickTree() = default;
+  explicit FenwickTree(size_t n) : tree_(n, 0) {}
+
+  [[nodiscard]] size_t size() const { return tree_.size(); }
+
+  // Add delta to the counter at position i
+  void add(size_t i, int32_t delta) {
+    assert(i < tree_.size());
+    for (; i < tree_.size(); i |= i + 1) tree_[i] += delta;
+  }
+
+  // Sum of the counters at positions [0, i]
+  [[nodiscard]] uint32_t prefix(size_t i) const {
+    assert(i < tree_.size());
+    uint32_t sum = 0;
+    for (size_t j = i + 1; j > 0; j &= j - 1) sum += tree_[j - 1];
+    return sum;
+  }
+
+  // Reset to 1 at positions [0, k) and 0 elsewhere in O(n), without n adds
+  void assign_ones(size_t k) {
+    assert(k <= tree_.size());
+    for (size_t i = 0; i < tree_.size(); ++i) {
+      size_t lo = i & (i + 1);
+      tree_[i] = k > lo ? static_cast<uint32_t>(std::min(i + 1, k) - lo) : 0;
+    }
+  }
+
+ private:
+  std::vector<uint32_t> tree_;
+};
+
+}  // namespace gcache
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  // for _mm_cmpeq_epi8/_mm_movemask_epi8
+#endif
+
+#include "alloc.h"
+#include "node.h"
+
+namespace gcache {
+
+// FlatNodeTable is an open-addressing alternative to NodeTable with the same
+// interface, so it can be plugged into LRUCache/SharedCache as the `Table`
+// template argument.
+//
+// The design follows SwissTable: each slot has one control byte that is either
+// kEmpty, kDeleted, or the low 7 bits of the hash (H2); a mixed version of the
+// hash (H1) selects the starting group. A probe compares H2 against all control
+// bytes of a group with one SIMD instruction, so a node is only dereferenced if
+// its H2 matches, and there is no chain of dependent pointers to chase as in
+// NodeTable. Similar to F14, the control bytes and the node pointers of a
+// group are packed into a single cache line, so a lookup usually costs one miss
+// on the table plus one miss on the matched node.
+template <typename Key_t, typename Value_t, typename Alloc = HeapAlloc>
+class FlatNodeTable {
+ private:
+  using Node_t = LRUNode<Key_t, Value_t>;
+
+ public:
+  FlatNodeTable()
+      : num_groups_(0), num_elems_(0), growth_left_(0), groups_(nullptr) {}
+  ~FlatNodeTable() { Alloc::deallocate(groups_, num_groups_); }
+
+  void init(size_t size);  // must be called before any r/w
+
+  // Caller must ensure e's key does not already present in table!
+  void insert(Node_t* e);
+  Node_t* lookup(Key_t key, uint32_t hash);
+  Node_t* remove(Key_t key, uint32_t hash);
+
+  // Prefetch the first group in the probe sequence of the hash, and the nodes
+  // in that group whose H2 matches; the latter should be called after the
+  // group is prefetched.
+  void prefetch_bucket(uint32_t hash) const {
+    __builtin_prefetch(&groups_[h1(hash) & (num_groups_ - 1)]);
+  }
+  void prefetch_node(uint32_t hash) const {
+    const Group& g = groups_[h1(hash) & (num_groups_ - 1)];
+    for (uint32_t m = match(g, h2(hash)); m; m &= m - 1)
+      __builtin_prefetch(g.slots[std::countr_zero(m)]);
+  }
+
+ private:
+  static constexpr uint32_t kGroupWidth = 7;
+  static constexpr int8_t kEmpty = -128;       // 0b10000000
+  static constexpr int8_t kDeleted = -2;       // 0b11111110
+  static constexpr int8_t kSentinel = -1;      // 0b11111111; padding byte
+  static constexpr uint32_t kFullMask = 0x7F;  // mask of valid slots
+
+  struct alignas(64) Group {
+    int8_t ctrl[kGroupWidth + 1];  // the last one is always kSentinel
+    Node_t* slots[kGroupWidth];
+  };
+  static_assert(sizeof(Group) == 64);
+
+  // H1 is the upper half of a Fibonacci hash, which depends on all bits of
+  // the hash, so a weak hash (e.g. idhash on sequential keys) or a hash with
+  // fixed top bits (e.g. sampled or sharded keys) still spreads over groups.
+  static size_t h1(uint32_t hash) {
+    return (uint64_t{hash} * 0x9E3779B97F4A7C15ull) >> 32;
+  }
+  static int8_t h2(uint32_t hash) { return hash & 0x7F; }
+
+  // Bitmask of slots in the group whose control byte equals to `b`
+  static uint32_t match(const Group& g, int8_t b);
+  // Bitmask of slots in the group that is empty or deleted
+  static uint32_t match_empty_or_deleted(const Group& g);
+
+  // Return the group and the slot index that points to the node with matched
+  // key/hash; return nullptr if not found.
+  Group* find(Key_t key, uint32_t hash, uint32_t& slot) const;
+  // Return the first group with an empty or deleted slot in the probe sequence
+  Group* find_insert_slot(uint32_t hash, uint32_t& slot) const;
+
+  // Allocate groups and reset all slots to be empty.
+  void alloc(size_t num_groups);
+  // Rebuild the table to drop deleted slots and/or grow the capacity. This is
+  // O(n), but only happens if insertion keeps exceeding the initial size.
+  void rehash(size_t num_groups);
+
+  size_t num_groups_;   // always 2^n
+  size_t num_elems_;    // number of nodes in the table
+  size_t growth_left_;  // number of insertions allowed before rehash
+  Group* groups_;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+};
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline uint32_t FlatNodeTable<Key_t, Value_t, Alloc>::match(const Group& g,
+                                                           int8_t b) {
+#if defined(__SSE2__)
+  __m128i ctrl = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(g.ctrl));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(b), ctrl)) & kFullMask;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < kGroupWidth; ++i)
+    if (g.ctrl[i] == b) mask |= 1u << i;
+  return mask;
+#endif
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline uint32_t FlatNodeTable<Key_t, Value_t, Alloc>::match_empty_or_deleted(
+    const Group& g) {
+#if defined(__SSE2__)
+  // both kEmpty and kDeleted are smaller than kSentinel, while a full slot's
+  // control byte is always non-negative
+  __m128i ctrl = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(g.ctrl));
+  return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(kSentinel), ctrl)) &
+         kFullMask;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < kGroupWidth; ++i)
+    if (g.ctrl[i] < kSentinel) mask |= 1u << i;
+  return mask;
+#endif
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void FlatNodeTable<Key_t, Value_t, Alloc>::init(size_t size) {
+  assert(!groups_);
+  // keep max load factor at 7/8
+  size_t num_slots = (size * 8 + 6) / 7;
+  alloc(std::bit_ceil<size_t>((num_slots + kGroupWidth - 1) / kGroupWidth));
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void FlatNodeTable<Key_t, Value_t, Alloc>::alloc(size_t num_groups) {
+  assert(std::has_single_bit(num_groups));
+  num_groups_ = num_groups;
+  groups_ = Alloc::template allocate<Group>(num_groups);
+  for (size_t i = 0; i < num_groups; ++i) {
+    memset(groups_[i].ctrl, kEmpty, kGroupWidth);
+    groups_[i].ctrl[kGroupWidth] = kSentinel;
+  }
+  growth_left_ = num_groups * kGroupWidth * 7 / 8 - num_elems_;
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename FlatNodeTable<Key_t, Value_t, Alloc>::Group*
+FlatNodeTable<Key_t, Value_t, Alloc>::find(Key_t key, uint32_t hash,
+                                           uint32_t& slot) const {
+  const size_t mask = num_groups_ - 1;
+  size_t idx = h1(hash) & mask;
+  // Probe groups in a triangular sequence, which visits every group when the
+  // number of groups is 2^n.
+  for (size_t step = 1;; ++step) {
+    Group& g = groups_[idx];
+    for (uint32_t m = match(g, h2(hash)); m; m &= m - 1) {
+      slot = std::countr_zero(m);
+      Node_t* e = g.slots[slot];
+      if (e->hash == hash && key == e->key) return &g;
+    }
+    // an empty slot means the key would have been placed here if present
+    if (match(g, kEmpty)) return nullptr;
+    assert(step <= num_groups_);
+    idx = (idx + step) & mask;
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename FlatNodeTable<Key_t, Value_t, Alloc>::Group*
+FlatNodeTable<Key_t, Value_t, Alloc>::find_insert_slot(
+    uint32_t hash, uint32_t& slot) const {
+  const size_t mask = num_groups_ - 1;
+  size_t idx = h1(hash) & mask;
+  for (size_t step = 1;; ++step) {
+    uint32_t m = match_empty_or_deleted(groups_[idx]);
+    if (m) {
+      slot = std::countr_zero(m);
+      return &groups_[idx];
+    }
+    assert(step <= num_groups_);
+    idx = (idx + step) & mask;
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void FlatNodeTable<Key_t, Value_t, Alloc>::insert(Node_t* e) {
+  // Caller must ensure e->key is not present in the table!
+  assert(!lookup(e->key, e->hash));
+  uint32_t slot;
+  Group* g = find_insert_slot(e->hash, slot);
+  if (growth_left_ == 0 && g->ctrl[slot] == kEmpty) {
+    // If most slots are occupied by deleted ones, rehash in place; otherwise,
+    // double the capacity.
+    size_t num_slots = num_groups_ * kGroupWidth;
+    rehash(num_elems_ * 2 <= num_slots * 7 / 8 ? num_groups_
+                                                : num_groups_ * 2);
+    g = find_insert_slot(e->hash, slot);
+  }
+  if (g->ctrl[slot] == kEmpty) --growth_left_;
+  g->ctrl[slot] = h2(e->hash);
+  g->slots[slot] = e;
+  ++num_elems_;
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename FlatNodeTable<Key_t, Value_t, Alloc>::Node_t*
+FlatNodeTable<Key_t, Value_t, Alloc>::lookup(Key_t key, uint32_t hash) {
+  assert(num_groups_ > 0);
+  uint32_t slot;
+  Group* g = find(key, hash, slot);
+  return g ? g->slots[slot] : nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename FlatNodeTable<Key_t, Value_t, Alloc>::Node_t*
+FlatNodeTable<Key_t, Value_t, Alloc>::remove(Key_t key, uint32_t hash) {
+  assert(num_groups_ > 0);
+  uint32_t slot;
+  Group* g = find(key, hash, slot);
+  if (!g) return nullptr;
+  // If the group still has an empty slot, any probe reaching this group must
+  // stop here, so it is safe to mark the slot as empty instead of deleted.
+  if (match(*g, kEmpty)) {
+    g->ctrl[slot] = kEmpty;
+    ++growth_left_;
+  } else {
+    g->ctrl[slot] = kDeleted;
+  }
+  --num_elems_;
+  return g->slots[slot];
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void FlatNodeTable<Key_t, Value_t, Alloc>::rehash(size_t num_groups) {
+  Group* old_groups = groups_;
+  size_t old_num_groups = num_groups_;
+  alloc(num_groups);
+  for (size_t i = 0; i < old_num_groups; ++i) {
+    for (uint32_t j = 0; j < kGroupWidth; ++j) {
+      if (old_groups[i].ctrl[j] < 0) continue;
+      Node_t* e = old_groups[i].slots[j];
+      uint32_t slot;
+      Group* g = find_insert_slot(e->hash, slot);
+      g->ctrl[slot] = h2(e->hash);
+      g->slots[slot] = e;
+    }
+  }
+  Alloc::deallocate(old_groups, old_num_groups);
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline std::ostream& FlatNodeTable<Key_t, Value_t, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "FlatNodeTable (num_groups=" << num_groups_ << ", size=" << num_elems_
+     << ") {\n";
+  for (size_t i = 0; i < num_groups_; ++i) {
+    const Group& g = groups_[i];
+    if (match_empty_or_deleted(g) == kFullMask) continue;
+    for (int j = 0; j < indent; ++j) os << '\t';
+    for (uint32_t j = 0; j < kGroupWidth; ++j)
+      if (g.ctrl[j] >= 0) os << '\t' << *g.slots[j] << ';';
+    os << '\n';
+  }
+  for (int j = 0; j < indent; ++j) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "compact_lru_cache.h"
 #include "hash.h"
 #include "lru_cache.h"
 #include "node.h"
+#include "snapshot.h"
 #include "stat.h"
 
 namespace gcache {
@@ -26,28 +35,68 @@ struct GhostMeta {
 template <typename Hash>
 class GhostKvCache;
 
+// The evenly spaced cache sizes min_size, min_size + tick, ..., max_size
+inline std::vector<uint32_t> linear_sizes(uint32_t tick, uint32_t min_size,
+                                          uint32_t max_size) {
+  assert(tick > 0);
+  assert(min_size <= max_size);
+  std::vector<uint32_t> sizes;
+  sizes.reserve((max_size - min_size) / tick + 1);
+  for (uint64_t s = min_size; s <= max_size; s += tick) sizes.emplace_back(s);
+  return sizes;
+}
+
+// Up to num_sizes cache sizes from min_size to max_size in a geometric
+// progression, each rounded to a multiple of align (e.g., 1 << SampleShift);
+// sizes that round to the same one are merged.
+inline std::vector<uint32_t> log_sizes(uint32_t min_size, uint32_t max_size,
+                                       uint32_t num_sizes, uint32_t align = 1) {
+  assert(min_size > 0 && min_size < max_size);
+  assert(num_sizes > 1);
+  assert(min_size % align == 0 && max_size % align == 0);
+  double ratio = std::pow(double(max_size) / min_size, 1.0 / (num_sizes - 1));
+  std::vector<uint32_t> sizes{min_size};
+  for (uint32_t i = 1; i + 1 < num_sizes; ++i) {
+    uint64_t s = std::llround(min_size * std::pow(ratio, i) / align) * align;
+    if (s > sizes.back() && s < max_size) sizes.emplace_back(s);
+  }
+  sizes.emplace_back(max_size);
+  return sizes;
+}
+
 /**
  * Simulate a set of page cache, where each page only carry thin metadata
  * Templated type Meta must have a field size_idx; in almost all cases, this
  * field does not need to specified; it is only useful if there is some
  * additional per-page metadata to be carried.
+ * Cache is the underlying LRU cache: LRUCache by default, or CompactLRUCache
+ * to save memory when simulating a very large cache (see CompactGhostCache).
+ * The key (block id) type is the one of Cache: uint32_t by default, or
+ * uint64_t for address spaces beyond 2^32 blocks (see GhostCache64).
+ * The cache sizes simulated are evenly spaced by tick by default, or any
+ * sorted list of sizes, e.g., log_sizes, to cover a wide range of sizes with
+ * few boundaries to move per access.
  */
-template <typename Hash = ghash, typename Meta = GhostMeta>
+template <typename Hash = ghash, typename Meta = GhostMeta,
+          typename Cache = LRUCache<uint32_t, Meta, Hash>>
 class GhostCache {
  protected:
-  const uint32_t tick;
+  // sizes[i] is the cache size of size_idx i, in ascending order
+  const std::vector<uint32_t> sizes;
+  const uint32_t tick;  // 0 if sizes are not evenly spaced
   const uint32_t min_size;
   const uint32_t max_size;
   const uint32_t num_ticks;
 
   // Key is block_id/block number
   // Value is "size_idx", which is the least non-negative number such that the
-  // key will in cache if the cache size is (size_idx * tick) + min_size
-  LRUCache<uint32_t, Meta, Hash> cache;
+  // key will in cache if the cache size is sizes[size_idx]
+  Cache cache;
 
  public:
-  using Handle_t = typename LRUCache<uint32_t, Meta, Hash>::Handle_t;
-  using Node_t = typename LRUCache<uint32_t, Meta, Hash>::Node_t;
+  using Handle_t = typename Cache::Handle_t;
+  using Node_t = typename Cache::Node_t;
+  using Key_t = decltype(Node_t::key);
 
  protected:
   // these must be placed after num_ticks to ensure a correct ctor order
@@ -58,45 +107,101 @@ class GhostCache {
   std::vector<uint32_t> reuse_distances;  // converted to caches_stat lazily
   uint32_t reuse_count;                   // count all access to reuse_distances
 
-  Handle_t access_impl(uint32_t block_id, uint32_t hash, AccessMode mode);
+  Handle_t access_impl(Key_t block_id, uint32_t hash, AccessMode mode);
+  // Prefetch for all blocks before accessing them; n must be no more than
+  // kPrefetchBatch.
+  void access_batch_impl(const Key_t* block_ids, const uint32_t* hashes,
+                         size_t n, AccessMode mode);
+
+  static constexpr size_t kPrefetchBatch = Cache::kPrefetchBatch;
 
   template <uint32_t S, typename H>
   friend class SampledGhostKvCache;
+  template <uint32_t S, typename H, typename M, typename C>
+  friend class SampledGhostCache;
 
   void build_caches_stat();
 
+  // The size_idx of the smallest size no less than cache_size
+  [[nodiscard]] uint32_t size_idx_of(uint32_t cache_size) const {
+    return std::lower_bound(sizes.begin(), sizes.end(), cache_size) -
+           sizes.begin();
+  }
+  // The tick of sizes if they are evenly spaced; otherwise, 0
+  static uint32_t tick_of(const std::vector<uint32_t>& sizes) {
+    uint32_t tick = sizes.size() > 1 ? sizes[1] - sizes[0] : 0;
+    for (size_t i = 1; i < sizes.size(); ++i)
+      if (sizes[i] - sizes[i - 1] != tick) return 0;
+    return tick;
+  }
+  // Each size shifted right, e.g., for the sampled blocks
+  static std::vector<uint32_t> shift_sizes(std::vector<uint32_t> sizes,
+                                           uint32_t shift) {
+    for (auto& s : sizes) {
+      assert(s % (uint64_t{1} << shift) == 0);
+      s >>= shift;
+    }
+    return sizes;
+  }
+
+  // Position of a boundary in a snapshot if it is not set yet
+  static constexpr uint64_t kNullBoundary = UINT64_MAX;
+  // A snapshot record of a node: key followed by meta, without padding
+  static constexpr size_t kRecordSize = sizeof(Key_t) + sizeof(Meta);
+
  public:
   GhostCache(uint32_t tick, uint32_t min_size, uint32_t max_size)
-      : tick(tick),
-        min_size(min_size),
-        max_size(max_size),
-        num_ticks((max_size - min_size) / tick + 1),
+      : GhostCache(linear_sizes(tick, min_size, max_size)) {
+    assert(min_size + (num_ticks - 1) * tick == max_size);
+  }
+  // Simulate the given cache sizes, which must be strictly ascending
+  explicit GhostCache(std::vector<uint32_t> grid)
+      : sizes(std::move(grid)),
+        tick(tick_of(sizes)),
+        min_size(sizes.front()),
+        max_size(sizes.back()),
+        num_ticks(sizes.size()),
         cache(),
         boundaries(num_ticks - 1, nullptr),
         caches_stat(num_ticks),
         reuse_distances(num_ticks, 0),
         reuse_count(0) {
-    assert(tick > 0);
     assert(min_size > 1);  // otherwise the first boundary will be LRU evicted
-    assert(min_size + (num_ticks - 1) * tick == max_size);
+    assert(std::adjacent_find(sizes.begin(), sizes.end(),
+                              std::greater_equal<uint32_t>()) == sizes.end());
     assert(num_ticks > 2);
     cache.init(max_size);
   }
 
-  void access(uint32_t block_id, AccessMode mode = AccessMode::DEFAULT) {
+  void access(Key_t block_id, AccessMode mode = AccessMode::DEFAULT) {
     access_impl(block_id, Hash{}(block_id), mode);
   }
 
+  // Same as calling access on each block in order, but the hash buckets and
+  // nodes of a batch are prefetched first so that their misses overlap; it is
+  // the GhostCache counterpart of LRUCache's lookup_batch/insert_batch.
+  void access_batch(const Key_t* block_ids, size_t n,
+                    AccessMode mode = AccessMode::DEFAULT) {
+    uint32_t hashes[kPrefetchBatch];
+    for (size_t i = 0; i < n; i += kPrefetchBatch) {
+      size_t m = std::min(n - i, kPrefetchBatch);
+      for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(block_ids[i + j]);
+      access_batch_impl(block_ids + i, hashes, m, mode);
+    }
+  }
+
+  // 0 if the sizes are not evenly spaced; use get_sizes instead
   [[nodiscard]] uint32_t get_tick() const { return tick; }
   [[nodiscard]] uint32_t get_min_size() const { return min_size; }
   [[nodiscard]] uint32_t get_max_size() const { return max_size; }
+  [[nodiscard]] const std::vector<uint32_t>& get_sizes() const {
+    return sizes;
+  }
 
+  // cache_size must be one of the sizes simulated
   [[nodiscard]] const CacheStat& get_stat(uint32_t cache_size) {
-    assert(cache_size >= min_size);
-    assert(cache_size <= max_size);
-    assert((cache_size - min_size) % tick == 0);
-    uint32_t size_idx = (cache_size - min_size) / tick;
-    assert(size_idx < num_ticks);
+    uint32_t size_idx = size_idx_of(cache_size);
+    assert(size_idx < num_ticks && sizes[size_idx] == cache_size);
     const CacheStat& stat = caches_stat[size_idx];
     if (stat.hit_cnt + stat.miss_cnt != reuse_count) build_caches_stat();
     assert(stat.hit_cnt + stat.miss_cnt == reuse_count);
@@ -114,6 +219,16 @@ class GhostCache {
     for (size_t i = 0; i < reuse_distances.size(); ++i) reuse_distances[i] = 0;
   }
 
+  // Save the sizes, the blocks with their metadata (e.g., size_idx) in LRU
+  // order, the boundaries, and the reuse distance histogram to a binary
+  // snapshot file, so the simulated caches and their stats survive a restart.
+  // Return whether succeeds.
+  bool save(const std::string& path) const;
+  // Load a snapshot into an empty GhostCache with the same sizes; the LRU
+  // list and table are rebuilt in one pass without lookup. Return whether
+  // succeeds; on failure, it may be partially loaded.
+  bool load(const std::string& path);
+
   // For each item in the LRU list, call fn in LRU order
   template <typename Fn>
   void for_each_lru(Fn&& fn) const {
@@ -167,27 +282,68 @@ class GhostCache {
 
 // only sample 1/32 (~3.125%)
 template <uint32_t SampleShift = 5, typename Hash = ghash,
-          typename Meta = GhostMeta>
-class SampledGhostCache : public GhostCache<Hash, Meta> {
+          typename Meta = GhostMeta,
+          typename Cache = LRUCache<uint32_t, Meta, Hash>>
+class SampledGhostCache : public GhostCache<Hash, Meta, Cache> {
  public:
+  using Key_t = typename GhostCache<Hash, Meta, Cache>::Key_t;
+
   SampledGhostCache(uint32_t tick, uint32_t min_size, uint32_t max_size)
-      : GhostCache<Hash, Meta>(tick >> SampleShift, min_size >> SampleShift,
-                               max_size >> SampleShift) {
+      : GhostCache<Hash, Meta, Cache>(tick >> SampleShift,
+                                      min_size >> SampleShift,
+                                      max_size >> SampleShift) {
     assert(tick % (1 << SampleShift) == 0);
     assert(min_size % (1 << SampleShift) == 0);
     assert(max_size % (1 << SampleShift) == 0);
-    // Left few bits used for sampling; right few used for hash.
-    // Make sure they never overlap.
-    assert(std::countr_zero<uint32_t>(std::bit_ceil<uint32_t>(max_size)) <=
-           32 - static_cast<int>(SampleShift));
     assert(this->tick > 0);
   }
+  // Each size must be a multiple of 1 << SampleShift (see log_sizes' align)
+  explicit SampledGhostCache(const std::vector<uint32_t>& sizes)
+      : GhostCache<Hash, Meta, Cache>(
+            GhostCache<Hash, Meta, Cache>::shift_sizes(sizes, SampleShift)) {}
+
+  // A block is sampled if the first few bits of its 64-bit mixed key are all
+  // zero. This is independent of Hash, which may be a CRC (linear in the key
+  // bits) and only has 32 bits, so sampling stays uniform on any address
+  // space, and sampled blocks still spread over all hash buckets.
+  static bool is_sampled(Key_t block_id) {
+    if constexpr (SampleShift == 0)
+      return true;
+    else
+      return (murmurhash_u64(block_id) >> (64 - SampleShift)) == 0;
+  }
+
+  // Only update ghost cache if the block is sampled
+  void access(Key_t block_id, AccessMode mode = AccessMode::DEFAULT) {
+    if (is_sampled(block_id))
+      this->access_impl(block_id, Hash{}(block_id), mode);
+  }
 
-  // Only update ghost cache if the first few bits of hash is all zero
-  void access(uint32_t block_id, AccessMode mode = AccessMode::DEFAULT) {
-    uint32_t hash = Hash{}(block_id);
-    if ((hash >> (32 - SampleShift)) == 0)
-      this->access_impl(block_id, hash, mode);
+  // Same as calling access on each block in order, but much cheaper per
+  // block: sample_batch filters a chunk of blocks with SIMD, and only the
+  // sampled ones are hashed, prefetched, and accessed in batches.
+  void access_batch(const Key_t* block_ids, size_t n,
+                    AccessMode mode = AccessMode::DEFAULT) {
+    constexpr size_t kBatch = GhostCache<Hash, Meta, Cache>::kPrefetchBatch;
+    // sampled blocks not yet accessed are kept at the front across chunks,
+    // so there are always fewer than kBatch of them before filtering
+    Key_t sampled_ids[kFilterBatch + kBatch];
+    uint32_t hashes[kBatch];
+    size_t m = 0;
+    for (size_t i = 0; i < n; i += kFilterBatch) {
+      m += sample_batch<SampleShift>(
+          block_ids + i, std::min(n - i, kFilterBatch), sampled_ids + m);
+      size_t j = 0;
+      for (; j + kBatch <= m; j += kBatch) {
+        for (size_t k = 0; k < kBatch; ++k)
+          hashes[k] = Hash{}(sampled_ids[j + k]);
+        this->access_batch_impl(sampled_ids + j, hashes, kBatch, mode);
+      }
+      std::copy(sampled_ids + j, sampled_ids + m, sampled_ids);
+      m -= j;
+    }
+    for (size_t k = 0; k < m; ++k) hashes[k] = Hash{}(sampled_ids[k]);
+    if (m > 0) this->access_batch_impl(sampled_ids, hashes, m, mode);
   }
 
   [[nodiscard]] uint32_t get_tick() const { return this->tick << SampleShift; }
@@ -197,6 +353,11 @@ class SampledGhostCache : public GhostCache<Hash, Meta> {
   [[nodiscard]] uint32_t get_max_size() const {
     return this->max_size << SampleShift;
   }
+  [[nodiscard]] std::vector<uint32_t> get_sizes() const {
+    std::vector<uint32_t> sizes(this->sizes);
+    for (auto& s : sizes) s <<= SampleShift;
+    return sizes;
+  }
 
   [[nodiscard]] const CacheStat& get_stat(uint32_t cache_size) {
     return get_stat_shifted(cache_size >> SampleShift);
@@ -212,25 +373,162 @@ class SampledGhostCache : public GhostCache<Hash, Meta> {
   template <uint32_t S, typename H>
   friend class SampledGhostKvCache;
 
+  // Number of blocks filtered by sample_batch at a time in access_batch
+  static constexpr size_t kFilterBatch = 256;
+
   [[nodiscard]] const CacheStat& get_stat_shifted(uint32_t cache_size_shifted) {
-    return GhostCache<Hash, Meta>::get_stat(cache_size_shifted);
+    return GhostCache<Hash, Meta, Cache>::get_stat(cache_size_shifted);
+  }
+};
+
+// SampleShift of a SampledGhostCache whose sample rate is set at runtime
+inline constexpr uint32_t kRuntimeSampleShift = UINT32_MAX;
+
+/**
+ * SampledGhostCache with a sample rate of 1 / (1 << sample_shift) set at
+ * runtime, e.g., per volume; the constant-shift version above remains the
+ * fast path when the rate is known at compile time.
+ *
+ * With max_tracked set, it is adaptive as fixed-size SHARDS: whenever more
+ * than max_tracked blocks are tracked, sample_shift rises by one, the tracked
+ * blocks no longer sampled are dropped (the rest keep their LRU order), and
+ * the reuse distance histogram is halved, so the hits counted before and
+ * after weigh the same. It starts at sample_shift, so a small working set can
+ * be simulated exactly with sample_shift 0. The sizes simulated must stay
+ * multiples of 1 << sample_shift, so the shift stops rising at the largest
+ * one that divides all sizes; the memory is then bounded by
+ * max_size >> sample_shift instead.
+ */
+template <typename Hash, typename Meta, typename Cache>
+class SampledGhostCache<kRuntimeSampleShift, Hash, Meta, Cache> {
+ public:
+  using GhostCache_t = GhostCache<Hash, Meta, Cache>;
+  using Handle_t = typename GhostCache_t::Handle_t;
+  using Key_t = typename GhostCache_t::Key_t;
+
+  // max_tracked of a sample rate that never changes
+  static constexpr uint32_t kUnlimited = UINT32_MAX;
+
+  SampledGhostCache(uint32_t tick, uint32_t min_size, uint32_t max_size,
+                    uint32_t sample_shift, uint32_t max_tracked = kUnlimited)
+      : SampledGhostCache(linear_sizes(tick, min_size, max_size), sample_shift,
+                          max_tracked) {}
+  SampledGhostCache(std::vector<uint32_t> grid, uint32_t sample_shift,
+                    uint32_t max_tracked = kUnlimited)
+      : sizes(std::move(grid)),
+        max_tracked(max_tracked),
+        max_shift(max_shift_of(sizes)),
+        sample_shift(sample_shift),
+        ghost(std::make_unique<GhostCache_t>(
+            GhostCache_t::shift_sizes(sizes, sample_shift))) {
+    assert(sample_shift <= max_shift);
+    assert(max_tracked > 0);
+  }
+
+  static bool is_sampled(Key_t block_id, uint32_t sample_shift) {
+    return sample_shift == 0 ||
+           (murmurhash_u64(block_id) >> (64 - sample_shift)) == 0;
+  }
+  bool is_sampled(Key_t block_id) const {
+    return is_sampled(block_id, sample_shift);
+  }
+
+  // Only update ghost cache if the block is sampled
+  void access(Key_t block_id, AccessMode mode = AccessMode::DEFAULT) {
+    if (!is_sampled(block_id)) return;
+    ghost->access_impl(block_id, Hash{}(block_id), mode);
+    if (ghost->cache.size() > max_tracked) adapt();
+  }
+
+  // Same as SampledGhostCache::access_batch with the runtime sample_batch;
+  // the budget is checked once per batch of sampled blocks.
+  void access_batch(const Key_t* block_ids, size_t n,
+                    AccessMode mode = AccessMode::DEFAULT);
+
+  [[nodiscard]] uint32_t get_tick() const {
+    return ghost->get_tick() << sample_shift;
+  }
+  [[nodiscard]] uint32_t get_min_size() const { return sizes.front(); }
+  [[nodiscard]] uint32_t get_max_size() const { return sizes.back(); }
+  [[nodiscard]] const std::vector<uint32_t>& get_sizes() const {
+    return sizes;
+  }
+  [[nodiscard]] uint32_t get_sample_shift() const { return sample_shift; }
+  [[nodiscard]] uint32_t get_max_tracked() const { return max_tracked; }
+  // Number of blocks tracked
+  [[nodiscard]] size_t size() const { return ghost->cache.size(); }
+
+  [[nodiscard]] const CacheStat& get_stat(uint32_t cache_size) {
+    return ghost->get_stat(cache_size >> sample_shift);
+  }
+  [[nodiscard]] double get_hit_rate(uint32_t cache_size) {
+    return get_stat(cache_size).get_hit_rate();
+  }
+  [[nodiscard]] double get_miss_rate(uint32_t cache_size) {
+    return get_stat(cache_size).get_miss_rate();
+  }
+  void reset_stat() { ghost->reset_stat(); }
+
+  // For each sampled item in the LRU list, call fn in LRU order
+  template <typename Fn>
+  void for_each_lru(Fn&& fn) const {
+    ghost->for_each_lru(fn);
+  }
+
+  std::ostream& print(std::ostream& os, int indent = 0) {
+    os << "SampledGhostCache (sample_shift=" << sample_shift
+       << ", max_tracked=" << max_tracked << ") ";
+    return ghost->print(os, indent);
   }
+  friend std::ostream& operator<<(std::ostream& os, SampledGhostCache& c) {
+    return c.print(os);
+  }
+
+ protected:
+  // Number of blocks filtered by sample_batch at a time in access_batch
+  static constexpr size_t kFilterBatch = 256;
+
+  static uint32_t max_shift_of(const std::vector<uint32_t>& sizes) {
+    uint32_t all = 0;  // bitwise or of all sizes
+    for (auto size : sizes) all |= size;
+    uint32_t s = 0;
+    while (s < kMaxSampleShift && (all >> s & 1) == 0 &&
+           sizes.front() >> (s + 1) > 1)
+      ++s;
+    return s;
+  }
+
+  // Raise sample_shift until the tracked blocks fit in max_tracked
+  void adapt() {
+    while (sample_shift < max_shift && ghost->cache.size() > max_tracked)
+      raise_sample_shift();
+  }
+  void raise_sample_shift();
+
+  const std::vector<uint32_t> sizes;  // unshifted
+  const uint32_t max_tracked;
+  const uint32_t max_shift;
+  uint32_t sample_shift;
+  // GhostCache over the sampled blocks with sizes shifted by sample_shift;
+  // replaced when sample_shift rises
+  std::unique_ptr<GhostCache_t> ghost;
 };
 
 /**
  * When using ghost cache, we assume in_use list is always empty.
  */
-template <typename Hash, typename Meta>
-inline typename GhostCache<Hash, Meta>::Handle_t
-GhostCache<Hash, Meta>::access_impl(uint32_t block_id, uint32_t hash,
-                                    AccessMode mode) {
+template <typename Hash, typename Meta, typename Cache>
+inline typename GhostCache<Hash, Meta, Cache>::Handle_t
+GhostCache<Hash, Meta, Cache>::access_impl(Key_t block_id, uint32_t hash,
+                                           AccessMode mode) {
   Handle_t s;  // successor
   Handle_t h = cache.refresh(block_id, hash, s);
   assert(h);  // Since there is no handle in use, allocation must never fail.
 
   /**
-   * To reason through the code below, consider an example where min_size=3,
-   * max_size=7, tick=2, num_ticks=3.
+   * To reason through the code below, consider an example where sizes=[3, 5,
+   * 7] (min_size=3, max_size=7, tick=2, num_ticks=3); the sizes need not be
+   * evenly spaced.
    *              (LRU)                               (MRU)
    *  DummyHead <=> A <=> B <=> C <=> D <=> E <=> F <=> G.
    *  size_idx:     2,    2,    1,    1,    0,    0,    0.
@@ -265,17 +563,17 @@ GhostCache<Hash, Meta>::access_impl(uint32_t block_id, uint32_t hash,
     // 2) this block has never been accessed before
     // For simplicity, both cases are handled uniformly by treating it as a miss
     assert(cache.size() <= max_size);
-    size_idx = cache.size() > min_size
-                   ? (cache.size() - min_size + tick - 1) / tick
-                   : 0;
-    if (size_idx < num_ticks - 1 && cache.size() == size_idx * tick + min_size)
-      boundaries[size_idx] = cache.lru_.next;
+    // once the cache is full, every miss takes the last size_idx
+    size_idx = cache.size() == max_size ? num_ticks - 1
+                                        : size_idx_of(cache.size());
+    if (size_idx < num_ticks - 1 && cache.size() == sizes[size_idx])
+      boundaries[size_idx] = cache.lru_oldest();
   }
   for (uint32_t i = 0; i < size_idx; ++i) {
     auto& b = boundaries[i];
     if (!b) continue;
     b->value.size_idx++;
-    b = b->next;
+    b = cache.next_of(b);
   }
   h->size_idx = 0;
 
@@ -298,8 +596,72 @@ GhostCache<Hash, Meta>::access_impl(uint32_t block_id, uint32_t hash,
   return h;
 }
 
-template <typename Hash, typename Meta>
-inline void GhostCache<Hash, Meta>::build_caches_stat() {
+template <typename Hash, typename Meta, typename Cache>
+inline void GhostCache<Hash, Meta, Cache>::access_batch_impl(
+    const Key_t* block_ids, const uint32_t* hashes, size_t n,
+    AccessMode mode) {
+  assert(n <= kPrefetchBatch);
+  cache.prefetch(hashes, n);
+  for (size_t i = 0; i < n; ++i) access_impl(block_ids[i], hashes[i], mode);
+}
+
+template <typename Hash, typename Meta, typename Cache>
+inline void SampledGhostCache<kRuntimeSampleShift, Hash, Meta,
+                              Cache>::access_batch(const Key_t* block_ids,
+                                                   size_t n, AccessMode mode) {
+  constexpr size_t kBatch = GhostCache_t::kPrefetchBatch;
+  // same as the constant-shift version, but the budget is checked after each
+  // batch, since sample_shift may rise and unsample blocks already filtered
+  Key_t sampled_ids[kFilterBatch];
+  uint32_t hashes[kBatch];
+  for (size_t i = 0; i < n; i += kFilterBatch) {
+    size_t m = sample_batch(block_ids + i, std::min(n - i, kFilterBatch),
+                            sampled_ids, sample_shift);
+    for (size_t j = 0; j < m; j += kBatch) {
+      size_t k = 0;
+      for (size_t l = j; l < std::min(m, j + kBatch); ++l)
+        if (is_sampled(sampled_ids[l])) {
+          sampled_ids[j + k] = sampled_ids[l];
+          hashes[k++] = Hash{}(sampled_ids[l]);
+        }
+      if (k > 0) ghost->access_batch_impl(sampled_ids + j, hashes, k, mode);
+      if (ghost->cache.size() > max_tracked) adapt();
+    }
+  }
+}
+
+template <typename Hash, typename Meta, typename Cache>
+inline void SampledGhostCache<kRuntimeSampleShift, Hash, Meta,
+                              Cache>::raise_sample_shift() {
+  uint32_t shift = sample_shift + 1;
+  auto next =
+      std::make_unique<GhostCache_t>(GhostCache_t::shift_sizes(sizes, shift));
+  // replaying the blocks still sampled in LRU order rebuilds their size_idx
+  // and the boundaries; the rest of the metadata is carried over
+  ghost->unsafe_for_each_lru([&](Handle_t h) {
+    Key_t block_id = h.get_key();
+    if (!is_sampled(block_id, shift)) return;
+    Handle_t e = next->access_impl(block_id, Hash{}(block_id), NOOP);
+    uint32_t size_idx = e->size_idx;
+    *e = *h;
+    e->size_idx = size_idx;
+  });
+
+  // the sizes are the same unshifted, so only the counts are halved;
+  // halving the prefix sums keeps the hit counts monotonic
+  uint32_t accum_hit_cnt = 0, prev_halved = 0;
+  for (uint32_t i = 0; i < ghost->num_ticks; ++i) {
+    accum_hit_cnt += ghost->reuse_distances[i];
+    next->reuse_distances[i] = accum_hit_cnt / 2 - prev_halved;
+    prev_halved = accum_hit_cnt / 2;
+  }
+  next->reuse_count = ghost->reuse_count / 2;
+  ghost = std::move(next);
+  sample_shift = shift;
+}
+
+template <typename Hash, typename Meta, typename Cache>
+inline void GhostCache<Hash, Meta, Cache>::build_caches_stat() {
   uint32_t accum_hit_cnt = 0;
   for (size_t idx = 0; idx < caches_stat.size(); ++idx) {
     accum_hit_cnt += reuse_distances[idx];
@@ -308,9 +670,95 @@ inline void GhostCache<Hash, Meta>::build_caches_stat() {
   }
 }
 
-template <typename Hash, typename Meta>
-inline std::ostream& GhostCache<Hash, Meta>::print(std::ostream& os,
-                                                   int indent) {
+template <typename Hash, typename Meta, typename Cache>
+inline bool GhostCache<Hash, Meta, Cache>::save(const std::string& path) const {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) return false;
+  SnapshotHeader header{kSnapshotGhost, kSnapshotVersion, sizeof(Key_t),
+                        sizeof(Meta), cache.size()};
+  uint32_t config[] = {num_ticks, reuse_count};
+  snapshot_write(os, &header);
+  snapshot_write(os, config, 2);
+  snapshot_write(os, sizes.data(), num_ticks);
+  snapshot_write(os, reuse_distances.data(), num_ticks);
+
+  // A boundary's position counts from the LRU end; the boundaries set so far
+  // are a prefix of `boundaries`, and a larger size_idx is closer to LRU.
+  std::vector<uint64_t> positions(num_ticks - 1, kNullBoundary);
+  int64_t b = num_ticks - 2;
+  while (b >= 0 && !boundaries[b]) --b;
+  uint64_t pos = 0;
+  cache.for_each_lru([&](Handle_t h) {
+    for (; b >= 0 && boundaries[b] == h.node; --b) positions[b] = pos;
+    ++pos;
+  });
+  assert(b < 0);
+  snapshot_write(os, positions.data(), positions.size());
+
+  char records[kPrefetchBatch * kRecordSize];
+  size_t m = 0;
+  cache.for_each_lru([&](Handle_t h) {
+    std::memcpy(records + m * kRecordSize, &h.node->key, sizeof(Key_t));
+    std::memcpy(records + m * kRecordSize + sizeof(Key_t), &h.node->value,
+                sizeof(Meta));
+    if (++m == kPrefetchBatch) {
+      snapshot_write(os, records, m * kRecordSize);
+      m = 0;
+    }
+  });
+  snapshot_write(os, records, m * kRecordSize);
+  return static_cast<bool>(os.flush());
+}
+
+template <typename Hash, typename Meta, typename Cache>
+inline bool GhostCache<Hash, Meta, Cache>::load(const std::string& path) {
+  if (cache.size() > 0) return false;
+  std::ifstream is(path, std::ios::binary);
+  SnapshotHeader header;
+  uint32_t config[2];  // num_ticks, reuse_count
+  if (!is ||
+      !snapshot_read_header(is, header, kSnapshotGhost, sizeof(Key_t),
+                            sizeof(Meta)) ||
+      !snapshot_read(is, config, 2) || config[0] != num_ticks ||
+      header.count > max_size)
+    return false;
+  std::vector<uint32_t> saved_sizes(num_ticks);
+  std::vector<uint64_t> positions(num_ticks - 1);
+  if (!snapshot_read(is, saved_sizes.data(), num_ticks) ||
+      saved_sizes != sizes ||
+      !snapshot_read(is, reuse_distances.data(), num_ticks) ||
+      !snapshot_read(is, positions.data(), positions.size()))
+    return false;
+  reuse_count = config[1];
+  build_caches_stat();
+
+  int64_t b = num_ticks - 2;
+  while (b >= 0 && positions[b] == kNullBoundary) boundaries[b--] = nullptr;
+  char records[kPrefetchBatch * kRecordSize];
+  Key_t block_ids[kPrefetchBatch];
+  uint32_t hashes[kPrefetchBatch];
+  for (uint64_t i = 0; i < header.count; i += kPrefetchBatch) {
+    size_t m = std::min<uint64_t>(header.count - i, kPrefetchBatch);
+    if (!snapshot_read(is, records, m * kRecordSize)) return false;
+    for (size_t j = 0; j < m; ++j) {
+      std::memcpy(&block_ids[j], records + j * kRecordSize, sizeof(Key_t));
+      hashes[j] = Hash{}(block_ids[j]);
+    }
+    cache.prefetch(hashes, m);
+    for (size_t j = 0; j < m; ++j) {
+      Node_t* e = cache.restore(block_ids[j], hashes[j]);
+      assert(e);
+      std::memcpy(&e->value, records + j * kRecordSize + sizeof(Key_t),
+                  sizeof(Meta));
+      for (; b >= 0 && positions[b] == i + j; --b) boundaries[b] = e;
+    }
+  }
+  return b < 0;  // every boundary set is restored
+}
+
+template <typename Hash, typename Meta, typename Cache>
+inline std::ostream& GhostCache<Hash, Meta, Cache>::print(std::ostream& os,
+                                                          int indent) {
   build_caches_stat();
   os << "GhostCache (tick=" << tick << ", min=" << min_size
      << ", max=" << max_size << ", num_ticks=" << num_ticks
@@ -331,9 +779,9 @@ inline std::ostream& GhostCache<Hash, Meta>::print(std::ostream& os,
   }
   os << "]\n";
   for (int i = 0; i < indent + 1; ++i) os << '\t';
-  os << "Stat:       [" << min_size << ": " << caches_stat[0];
+  os << "Stat:       [" << sizes[0] << ": " << caches_stat[0];
   for (uint32_t i = 1; i < num_ticks; ++i)
-    os << ", " << min_size + i * tick << ": " << caches_stat[i];
+    os << ", " << sizes[i] << ": " << caches_stat[i];
   os << "]\n";
   for (int i = 0; i < indent + 1; ++i) os << '\t';
   cache.print(os, indent + 1);
@@ -342,4 +790,25 @@ inline std::ostream& GhostCache<Hash, Meta>::print(std::ostream& os,
   return os;
 }
 
+// GhostCache backed by CompactLRUCache, whose 32-bit index links save 12 bytes
+// per tracked block
+template <typename Hash = ghash, typename Meta = GhostMeta>
+using CompactGhostCache =
+    GhostCache<Hash, Meta, CompactLRUCache<uint32_t, Meta, Hash>>;
+
+template <uint32_t SampleShift = 5, typename Hash = ghash,
+          typename Meta = GhostMeta>
+using CompactSampledGhostCache =
+    SampledGhostCache<SampleShift, Hash, Meta,
+                      CompactLRUCache<uint32_t, Meta, Hash>>;
+
+// GhostCache with 64-bit block ids, for volumes beyond 2^32 blocks
+template <typename Hash = ghash64, typename Meta = GhostMeta>
+using GhostCache64 = GhostCache<Hash, Meta, LRUCache<uint64_t, Meta, Hash>>;
+
+template <uint32_t SampleShift = 5, typename Hash = ghash64,
+          typename Meta = GhostMeta>
+using SampledGhostCache64 =
+    SampledGhostCache<SampleShift, Hash, Meta, LRUCache<uint64_t, Meta, Hash>>;
+
 }  // namespace gcache
\ No newline at end of file
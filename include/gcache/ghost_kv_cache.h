@@ -1,6 +1,11 @@
 #pragma once
+#include <bit>
+#include <cassert>
 #include <cstdint>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <vector>
 
 #include "ghost_cache.h"
 
@@ -28,7 +33,12 @@ class SampledGhostKvCache {
 
  public:
   SampledGhostKvCache(uint32_t tick, uint32_t min_count, uint32_t max_count)
-      : ghost_cache(tick, min_count, max_count) {}
+      : ghost_cache(tick, min_count, max_count) {
+    // Left few bits of the key hash used for sampling; right few used as the
+    // hash of the ghost cache's table. Make sure they never overlap.
+    assert(std::countr_zero<uint32_t>(std::bit_ceil<uint32_t>(max_count)) <=
+           32 - static_cast<int>(SampleShift));
+  }
 
   void access(const std::string_view key, uint32_t kv_size,
               AccessMode mode = AccessMode::DEFAULT) {
@@ -64,6 +74,10 @@ class SampledGhostKvCache {
 
   void reset_stat() { ghost_cache.reset_stat(); }
 
+  // Same as GhostCache::save/load; kv_size is saved along with size_idx
+  bool save(const std::string& path) const { return ghost_cache.save(path); }
+  bool load(const std::string& path) { return ghost_cache.load(path); }
+
   // For each item in the LRU list, call fn in LRU order
   template <typename Fn>
   void for_each_lru(Fn&& fn) const {
@@ -94,12 +108,15 @@ class SampledGhostKvCache {
     std::vector<std::tuple<uint32_t, uint32_t, CacheStat>> curve;
     uint32_t curr_count = 0;
     uint32_t curr_size = 0;
+    uint32_t size_idx = 0;  // the next size to add to the curve
+    const auto& sizes = ghost_cache.sizes;
     ghost_cache.unsafe_for_each_mru([&](Handle_t h) {
       curr_size += h->kv_size;
       ++curr_count;
-      if ((curr_count - ghost_cache.min_size) % ghost_cache.tick == 0) {
+      if (size_idx < sizes.size() && curr_count == sizes[size_idx]) {
         curve.emplace_back(curr_count << SampleShift, curr_size << SampleShift,
                            ghost_cache.get_stat_shifted(curr_count));
+        ++size_idx;
       }
     });
     return curve;
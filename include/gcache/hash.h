@@ -1,6 +1,13 @@
 #pragma once
 
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
 
 #if defined(__SSE4_2__)
 #include <nmmintrin.h>  // for _mm_crc32_u32 instruction
@@ -17,6 +24,14 @@
 #error "Unsupported architecture"
 #endif
 
+#if defined(__AVX512F__) && defined(__AVX512DQ__) && defined(__AVX512VL__)
+#include <immintrin.h>  // for _mm512_mullo_epi64/_mm512_mask_compressstoreu
+#define GCACHE_SAMPLE_AVX512
+#elif defined(__AVX2__)
+#include <immintrin.h>  // for _mm256_mul_epu32/_mm256_movemask_pd
+#define GCACHE_SAMPLE_AVX2
+#endif
+
 namespace gcache {
 
 /**
@@ -46,6 +61,17 @@ namespace gcache {
   return x;
 }
 
+// From MurmurHash's 64-bit finalizer:
+// https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp#L81
+[[maybe_unused]] static inline uint64_t murmurhash_u64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
 /* Hash for uint32_t */
 
 struct ghash {  // default hash function for gcache
@@ -64,4 +90,177 @@ struct murmurhash {
   uint32_t operator()(uint32_t x) const noexcept { return murmurhash_u32(x); }
 };
 
+/* Hash for uint64_t */
+
+struct ghash64 {  // default hash function for 64-bit keys
+  uint32_t operator()(uint64_t x) const noexcept {
+    return static_cast<uint32_t>(crc32_u64(0x537, x));
+  }
+};
+
+struct murmurhash64 {
+  uint32_t operator()(uint64_t x) const noexcept {
+    return static_cast<uint32_t>(murmurhash_u64(x));
+  }
+};
+
+/* Batch sampling */
+
+// Copy the keys whose murmurhash_u64 has the top SampleShift bits all zero
+// (i.e., sampled at 1 / (1 << SampleShift)) from keys[0, n) to out in order;
+// return the number of keys copied. out must have room for n keys.
+//
+// With AVX-512, 8 keys are mixed at once and the sampled ones are compressed
+// into out by the comparison mask; with AVX2, 4 keys are mixed at once (the
+// 64-bit multiplies are emulated with 32-bit ones) and the rare set bits of
+// the mask are copied one by one. Otherwise, keys are appended branch-free.
+template <uint32_t SampleShift, typename Key_t>
+inline size_t sample_batch(const Key_t* keys, size_t n, Key_t* out);
+
+namespace detail {
+
+template <uint32_t SampleShift, typename Key_t>
+inline size_t sample_batch_scalar(const Key_t* keys, size_t n, Key_t* out) {
+  size_t m = 0;
+  for (size_t i = 0; i < n; ++i) {
+    out[m] = keys[i];
+    m += (murmurhash_u64(keys[i]) >> (64 - SampleShift)) == 0;
+  }
+  return m;
+}
+
+#if defined(GCACHE_SAMPLE_AVX512)
+// The zero-masked shifts are the plain ones; they avoid a false positive of
+// -Wmaybe-uninitialized on _mm512_undefined_epi32 in GCC 12's headers.
+static inline __m512i srli33_u64x8(__m512i x) {
+  return _mm512_maskz_srli_epi64(0xff, x, 33);
+}
+
+static inline __m512i murmurhash_u64x8(__m512i x) {
+  x = _mm512_xor_si512(x, srli33_u64x8(x));
+  x = _mm512_mullo_epi64(x, _mm512_set1_epi64(0xff51afd7ed558ccdULL));
+  x = _mm512_xor_si512(x, srli33_u64x8(x));
+  x = _mm512_mullo_epi64(x, _mm512_set1_epi64(0xc4ceb9fe1a85ec53ULL));
+  x = _mm512_xor_si512(x, srli33_u64x8(x));
+  return x;
+}
+#elif defined(GCACHE_SAMPLE_AVX2)
+// The low 64 bits of x * c, from the 32x32->64-bit products of the halves
+static inline __m256i mullo_u64x4(__m256i x, uint64_t c) {
+  const __m256i c_lo = _mm256_set1_epi64x(c & 0xffffffff);
+  const __m256i c_hi = _mm256_set1_epi64x(c >> 32);
+  __m256i lo = _mm256_mul_epu32(x, c_lo);
+  __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(x, 32), c_lo),
+      _mm256_mul_epu32(x, c_hi));
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+static inline __m256i murmurhash_u64x4(__m256i x) {
+  x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+  x = mullo_u64x4(x, 0xff51afd7ed558ccdULL);
+  x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+  x = mullo_u64x4(x, 0xc4ceb9fe1a85ec53ULL);
+  x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+  return x;
+}
+#endif
+
+}  // namespace detail
+
+template <uint32_t SampleShift, typename Key_t>
+inline size_t sample_batch(const Key_t* keys, size_t n, Key_t* out) {
+  static_assert(sizeof(Key_t) == 4 || sizeof(Key_t) == 8);
+  static_assert(SampleShift < 64);
+  if constexpr (SampleShift == 0) {
+    std::memcpy(out, keys, n * sizeof(Key_t));
+    return n;
+  } else {
+    size_t i = 0, m = 0;
+#if defined(GCACHE_SAMPLE_AVX512)
+    // sampled iff the mixed key < 2^(64 - SampleShift)
+    const __m512i bound =
+        _mm512_set1_epi64(uint64_t{1} << (64 - SampleShift));
+    // a compressing store is slow, but mostly skipped: with SampleShift=5,
+    // 3 in 4 groups of 8 keys have none sampled
+    for (; i + 8 <= n; i += 8) {
+      __mmask8 mask;
+      if constexpr (sizeof(Key_t) == 4) {
+        __m256i k =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m512i h =
+            detail::murmurhash_u64x8(_mm512_maskz_cvtepu32_epi64(0xff, k));
+        mask = _mm512_cmplt_epu64_mask(h, bound);
+        if (!mask) continue;
+        _mm256_mask_compressstoreu_epi32(out + m, mask, k);
+      } else {
+        __m512i k = _mm512_loadu_si512(keys + i);
+        __m512i h = detail::murmurhash_u64x8(k);
+        mask = _mm512_cmplt_epu64_mask(h, bound);
+        if (!mask) continue;
+        _mm512_mask_compressstoreu_epi64(out + m, mask, k);
+      }
+      m += std::popcount(static_cast<uint32_t>(mask));
+    }
+#elif defined(GCACHE_SAMPLE_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+      __m256i k;
+      if constexpr (sizeof(Key_t) == 4) {
+        k = _mm256_cvtepu32_epi64(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)));
+      } else {
+        k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+      }
+      __m256i top =
+          _mm256_srli_epi64(detail::murmurhash_u64x4(k), 64 - SampleShift);
+      uint32_t mask = _mm256_movemask_pd(
+          _mm256_castsi256_pd(_mm256_cmpeq_epi64(top, zero)));
+      for (; mask; mask &= mask - 1)
+        out[m++] = keys[i + std::countr_zero(mask)];
+    }
+#endif
+    return m +
+           detail::sample_batch_scalar<SampleShift>(keys + i, n - i, out + m);
+  }
+}
+
+// Largest sample shift supported by the runtime version of sample_batch
+inline constexpr uint32_t kMaxSampleShift = 31;
+
+// Same as above, but the shift is only known at runtime (e.g., set per volume);
+// it dispatches to the instance of the shift, so each keeps its constant
+// shifts and bounds.
+template <typename Key_t>
+inline size_t sample_batch(const Key_t* keys, size_t n, Key_t* out,
+                           uint32_t sample_shift) {
+  using Fn = size_t (*)(const Key_t*, size_t, Key_t*);
+  static constexpr auto kTable =
+      []<uint32_t... S>(std::integer_sequence<uint32_t, S...>) {
+        return std::array<Fn, sizeof...(S)>{&sample_batch<S, Key_t>...};
+      }(std::make_integer_sequence<uint32_t, kMaxSampleShift + 1>{});
+  assert(sample_shift <= kMaxSampleShift);
+  return kTable[sample_shift](keys, n, out);
+}
+
+/* Hash for strings */
+
+struct strhash {  // CRC over 8-byte words
+  uint32_t operator()(std::string_view s) const noexcept {
+    uint32_t crc = 0x537;
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+      uint64_t w;
+      memcpy(&w, s.data() + i, 8);
+      crc = static_cast<uint32_t>(crc32_u64(crc, w));
+    }
+    if (i < s.size()) {
+      uint64_t w = 0;
+      memcpy(&w, s.data() + i, s.size() - i);
+      crc = static_cast<uint32_t>(crc32_u64(crc, w));
+    }
+    return crc32_u32(crc, static_cast<uint32_t>(s.size()));
+  }
+};
+
 }  // namespace gcache
@@ -3,27 +3,73 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include <vector>
+#include <string>
 
+#include "alloc.h"
+#include "arena.h"
 #include "node.h"
+#include "snapshot.h"
 #include "table.h"
 
 namespace gcache {
 
-template <typename Hash, typename Meta>
+template <typename Hash, typename Meta, typename Cache>
 class GhostCache;
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 class SharedCache;
 
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+class ShardedLRUCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class NumaLRUCache;
+
+template <typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class StrLRUCache;
+
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table, typename Alloc>
+class WriteBackCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class TTLCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class BufferedLRUCache;
+
+// A value type with a `uint32_t charge` field (e.g., the size in bytes of the
+// object a node refers to) makes LRUCache weighted: besides the number of
+// nodes, the total charge of the nodes in the table is bounded by a budget.
+// Wrappers of Value_t (e.g., TaggedValue) specialize it to forward the charge.
+template <typename Value_t>
+struct ValueCharge {
+  static constexpr bool kCharged = requires(Value_t v) { v.charge; };
+  static uint32_t& get(Value_t& v) { return v.charge; }
+};
+
 // Key_t should be lightweight that can be pass-by-value
 // Value_t should be trivially copyable
-template <typename Key_t, typename Value_t, typename Hash>
+// Table is the hash table implementation to index nodes, e.g., NodeTable
+// (chained buckets) or FlatNodeTable (open addressing)
+// Alloc is the allocation policy of the node pool and the table, e.g.,
+// HeapAlloc or MmapAlloc (huge pages; see alloc.h)
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
 class LRUCache {
   /**
    * Note the values are initialized once and never destructed during the
@@ -43,6 +89,13 @@ class LRUCache {
  public:
   using Node_t = LRUNode<Key_t, Value_t>;
   using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Every lookup refreshes the LRU list, so it is never read-only.
+  static constexpr bool kConcurrentLookup = false;
+  // Whether the capacity is also weighted by charges (see ValueCharge)
+  static constexpr bool kCharged = ValueCharge<Value_t>::kCharged;
+  static constexpr size_t kUnlimited = SIZE_MAX;
 
   LRUCache();
   ~LRUCache();
@@ -56,6 +109,10 @@ class LRUCache {
 
   size_t size() const { return size_; }
   size_t capacity() const { return capacity_; }
+  // Total charge of the nodes in the table, and its bound (kUnlimited by
+  // default, so only the number of nodes bounds the cache)
+  size_t usage() const { return usage_; }
+  size_t budget() const { return budget_; }
 
   // For each item in the cache, call fn(key, handle)
   template <typename Fn>
@@ -80,19 +137,56 @@ class LRUCache {
   void for_each_until_mru(Fn&& fn) const;
 
   // Set pin to be true to pin the returned node so it won't be recycled by
-  // LRU; a pinned node must be unpinned later by calling release().
+  // LRU; a pinned node must be unpinned later by calling release(). Pinning
+  // and releasing only change the node's atomic reference count, while a
+  // pinned node stays in the LRU list until eviction skips it.
 
   // Insert a node into cache with given key and hash if not exists; if does,
   // return the existing one; if it is known for sure that the key must not
   // exist, set `hint_nonexist` to true to skip a lookup.
   Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false);
+  // Same as above, but call victim_fn(handle) on each LRU victim before it is
+  // recycled. If it returns false, the victim is parked instead: it stays in
+  // the table, so lookups still hit it, but it is out of the LRU list until
+  // `unpark`; eviction then moves on to the next victim.
+  template <typename Fn>
+  Handle_t insert(Key_t key, bool pin, bool hint_nonexist, Fn&& victim_fn);
+  // Same as insert, but charge the node `charge`: LRU victims are evicted to
+  // the free list until it fits in the budget. If the key exists, its charge
+  // is updated. Return nullptr if a new node or a grown charge cannot fit,
+  // e.g., all others are pinned or the charge exceeds the budget; an existing
+  // node then keeps its old charge.
+  Handle_t insert_charged(Key_t key, uint32_t charge, bool pin = false,
+                          bool hint_nonexist = false)
+      requires kCharged;
+  // Set the budget and evict LRU victims until the usage fits; pinned nodes
+  // are skipped, so the usage may stay above the budget until they are
+  // released and evicted by later inserts.
+  void set_budget(size_t budget)
+      requires kCharged;
   // Search for a node; return nullptr if not exist. This op will refresh LRU.
   Handle_t lookup(Key_t key, bool pin = false);
-  // Release pinned node returned by insert/lookup.
-  void release(Handle_t handle);
-  // Pin a node returned by insert/lookup.
+  // Same as lookup, but never refresh LRU, e.g., for a scan or a read that
+  // should not count as a use.
+  Handle_t peek(Key_t key, bool pin = false);
+  // Release pinned node returned by insert/lookup. It is a single atomic
+  // decrement, so it may run concurrently with other operations (e.g., without
+  // the lock of a thread-safe wrapper).
+  void release(Handle_t handle) { handle.node->release(); }
+  // Pin a node returned by insert/lookup. Unless the caller already holds a
+  // pin, it must not run concurrently with other operations, as the node may
+  // be evicted.
   void pin(Handle_t handle);
 
+  // Batched insert/lookup: handles[i] is set as if insert/lookup is called on
+  // keys[i] one by one. All keys are hashed first and their buckets and nodes
+  // are prefetched, so the cache misses of different keys overlap instead of
+  // being serialized.
+  void insert_batch(const Key_t* keys, size_t n, Handle_t* handles,
+                    bool pin = false, bool hint_nonexist = false);
+  void lookup_batch(const Key_t* keys, size_t n, Handle_t* handles,
+                    bool pin = false);
+
   /**
    * The normal opeartions (`insert`/`lookup`/`release`) will only cause a node
    * to flow among the lru list, the in-use list, and the free list.
@@ -113,6 +207,26 @@ class LRUCache {
   // handles. The caller should set the value immediately.
   Handle_t install(Key_t key);
 
+  // For each parked node, call fn(handle) in the order of parking.
+  template <typename Fn>
+  void for_each_parked(Fn&& fn) const;
+  // Return a parked node to the LRU end of the list, so it is the next victim;
+  // a lookup that hits a parked node also returns it (to the MRU end).
+  void unpark(Handle_t handle);
+
+  // Save the keys of all nodes to a binary snapshot file, from the least to
+  // the most recently used (parked and in-use nodes are treated as older than
+  // the ones in the LRU list); values are not saved. Return whether succeeds.
+  bool save(const std::string& path) const;
+  // Load a snapshot into an empty cache: the table and the LRU list are
+  // rebuilt in one pass from the free list, without lookup or eviction. If
+  // the snapshot has more keys than the capacity, the least recently used
+  // ones are dropped. A loaded node keeps the value it has in the pool (e.g.,
+  // set by `init`), so the caller should refill the data it refers to. Return
+  // whether succeeds; on failure, the cache may be partially loaded. Charges
+  // are not saved: loaded nodes are charged 0.
+  bool load(const std::string& path);
+
  private:
   /****************************************************************************/
   /* Below are intrusive functions that should only be called by SharedCache  */
@@ -120,7 +234,7 @@ class LRUCache {
 
   // Init handle pool and table from externally instantiated ones but not owned
   // them; the caller must free the pool and table after dtor.
-  void init_from(Node_t* pool, NodeTable<Key_t, Value_t>* table,
+  void init_from(Node_t* pool, Table_t* table,
                  size_t capacity);
 
   // Force this cache to return a node (i.e. a cache slot) back to caller;
@@ -134,28 +248,92 @@ class LRUCache {
 
   /****************************************************************************/
   /* Below are intrusive functions that should only be called by GhostCache   */
+  /* (and ExactGhostCache)                                                    */
   /****************************************************************************/
 
   // Similar to insert but 1) the targeted node must be in LRU list and this
   // function never pins it, 2) return `successor`: the node with the same order
   // as the returned node after LRU operations (nullptr if newly inserted).
   Handle_t refresh(Key_t key, uint32_t hash, Handle_t& successor);
+  // Return the node after e in the list, and the least (most) recently used
+  // node.
+  Node_t* next_of(Node_t* e) const { return e->next; }
+  Node_t* lru_oldest() const { return lru_.next; }
+  Node_t* lru_newest() const { return lru_.prev; }
+  // Prefetch the buckets and nodes of hashes; n <= kPrefetchBatch.
+  void prefetch(const uint32_t* hashes, size_t n) {
+    prefetch_impl(table_, hashes, n);
+  }
+
+  /****************************************************************************/
+  /* Below are intrusive functions to save/load snapshots (also SharedCache)  */
+  /****************************************************************************/
+
+  // Take a node from the free list as the most recently used one for key,
+  // which must not exist; return nullptr if the free list is empty.
+  Node_t* restore(Key_t key, uint32_t hash);
+  // Write the keys of all nodes in the order described in `save`.
+  void save_keys(std::ostream& os) const;
+  // Read count keys written by save_keys and restore them; call fn(node) on
+  // each restored node. Return whether all keys are read.
+  template <typename Fn>
+  bool load_keys(std::istream& is, uint64_t count, Fn&& fn);
+
+  /****************************************************************************/
+  /* Below are intrusive functions that should only be called by TTLCache     */
+  /****************************************************************************/
+
+  // Remove a node from the table and its list and return it to the free list,
+  // so it is reused before any LRU victim; return false if it is pinned.
+  bool evict(Node_t* e);
 
  private:
   /* some internal implementation APIs (used by other classes in gcache) */
-  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+    return insert_impl(key, hash, pin, hint_nonexist,
+                       [](Node_t*) { return true; });
+  }
+  template <typename Fn>
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist,
+                      Fn&& victim_fn);
+  Node_t* insert_charged_impl(Key_t key, uint32_t hash, uint32_t charge,
+                              bool pin, bool hint_nonexist);
   Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  Node_t* peek_impl(Key_t key, uint32_t hash, bool pin);
   Node_t* install_impl(Key_t key);
+  // Prefetch the buckets of all hashes, and then the nodes in these buckets;
+  // batched APIs process keys in chunks of kPrefetchBatch.
+  static void prefetch_impl(Table_t* table,
+                            const uint32_t* hashes, size_t n);
+  static constexpr size_t kPrefetchBatch = 16;
   // Helper function for lookup: 1) pin the node if asked; 2) refresh LRU if in
   // the LRU list
   void lookup_refresh(Node_t* node, bool pin);
 
-  Node_t* alloc_node();
+  Node_t* alloc_node() {
+    return alloc_node([](Node_t*) { return true; });
+  }
+  template <typename Fn>
+  Node_t* alloc_node(Fn&& victim_fn);
+  // Remove the least recently used unpinned node from the table and return
+  // it; return nullptr if none.
+  template <typename Fn>
+  Node_t* evict_lru(Fn&& victim_fn);
+  // Evict LRU victims to the free list until `charge` more fits in the budget;
+  // return whether it fits.
+  bool reserve(size_t charge);
+  // Account the charge of a node entering or leaving the table; a new node is
+  // charged 0.
+  void charge_new(Node_t* e) {
+    if constexpr (kCharged) ValueCharge<Value_t>::get(e->value) = 0;
+  }
+  void uncharge(Node_t* e) {
+    if constexpr (kCharged) usage_ -= ValueCharge<Value_t>::get(e->value);
+  }
   void free_node(Node_t* e);
-  void list_remove(Node_t* e);
-  void list_append(Node_t* list, Node_t* e);
-  void ref(Node_t* e);
-  void unref(Node_t* e);
+  // Move the released nodes in in_use_ back to the MRU end of lru_; return
+  // whether any.
+  bool reclaim_in_use();
   // Perform LRU operation and return the handle with the same order in the list
   // after LRU (usually it's e->next)
   Node_t* lru_refresh(Node_t* e);
@@ -166,29 +344,41 @@ class LRUCache {
   // Initialized before use.
   size_t capacity_;
 
+  // Total charge of nodes in table_ and its bound; only used if kCharged.
+  size_t usage_;
+  size_t budget_;
+
   // Manage batch of handle and place into the free list.
   // Allocate a handle from free_ and put it into table_; a handle in table_
   // must either present in lru_ or in_use_
   // If user calls `init_from`, this field will be nullptr
   Node_t* pool_;
+  // Number of nodes in pool_; capacity_ may drift from it due to erase/install
+  size_t pool_size_;
 
   // Hash table to lookup
   // If user calls `init_from`, this field will just refer to the external one;
   // otherwise, managed by this class instance
-  NodeTable<Key_t, Value_t>* table_;
+  Table_t* table_;
 
   // Dummy head of LRU list.
   // lru.prev is the newest entry, lru.next is the oldest entry.
-  // Entries have refs==1.
+  // Entries may be pinned (refs >= 2); eviction moves them to in_use_.
   Node_t lru_;
 
   // Dummy head of in-use list.
-  // Entries are in use by clients and have refs >= 2.
+  // Entries were found pinned by eviction; some may have been released since
+  // then (refs == 1) and are moved back by reclaim_in_use().
   Node_t in_use_;
 
   // Dummy head of free list.
   Node_t free_;
 
+  // Dummy head of parked list.
+  // Entries are victims rejected by the victim_fn of insert; they are still in
+  // table_ and counted in size_.
+  Node_t parked_;
+
   /* `erased_` and `extra_pool_` are only used by `erase/install`. */
 
   // Dummy head of erased list.
@@ -196,15 +386,44 @@ class LRUCache {
   // This list is only maintained for memory efficiency purposes.
   Node_t erased_;
 
-  // Pool for additionaly allocated handles.
-  std::vector<Node_t*> extra_pool_;
+  // Pool for additionally allocated handles; nodes are allocated in chunks of
+  // 4K, so install does not call malloc per node, and all of them are freed
+  // at once with the arena.
+  ChunkedArena<Node_t> extra_pool_;
 
-  template <typename H, typename M>
+  template <typename H, typename M, typename C>
   friend class GhostCache;
 
-  template <typename T, typename K, typename V, typename H>
+  template <typename H, typename C>
+  friend class ExactGhostCache;
+
+  template <typename T, typename K, typename V, typename H,
+            template <typename, typename, typename> class TT, typename A>
   friend class SharedCache;
 
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class NumaLRUCache;
+
+  template <typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class StrLRUCache;
+
+  template <typename K, typename V, typename H, typename W,
+            template <typename, typename, typename> class T, typename A>
+  friend class WriteBackCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class TTLCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class BufferedLRUCache;
+
  public:  // for debugging
   std::ostream& print(std::ostream& os, int indent = 0) const;
   friend std::ostream& operator<<(std::ostream& os, const LRUCache& c) {
@@ -212,9 +431,16 @@ class LRUCache {
   }
 };
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline LRUCache<Key_t, Value_t, Hash>::LRUCache()
-    : size_(0), capacity_(0), pool_(nullptr), table_(nullptr) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline LRUCache<Key_t, Value_t, Hash, Table, Alloc>::LRUCache()
+    : size_(0),
+      capacity_(0),
+      usage_(0),
+      budget_(kUnlimited),
+      pool_(nullptr),
+      pool_size_(0),
+      table_(nullptr) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
@@ -222,11 +448,14 @@ inline LRUCache<Key_t, Value_t, Hash>::LRUCache()
   in_use_.prev = &in_use_;
   erased_.next = &erased_;
   erased_.prev = &erased_;
+  parked_.next = &parked_;
+  parked_.prev = &parked_;
   // free_ will be initialized when init() is called
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline LRUCache<Key_t, Value_t, Hash>::~LRUCache() {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline LRUCache<Key_t, Value_t, Hash, Table, Alloc>::~LRUCache() {
   /* Could be an error if caller has an unreleased node */
   // assert(in_use_.next == &in_use_);
 
@@ -239,19 +468,21 @@ inline LRUCache<Key_t, Value_t, Hash>::~LRUCache() {
     /* Unnecessary for correctness, but kept to ease debugging */
     // for (const Node_t* e = lru_.next; e != &lru_; e = e->next)
     //   assert(e->refs == 1);  // Invariant of lru_ list.
-    delete[] pool_;
+    Alloc::deallocate(pool_, pool_size_);
     delete table_;
   }
-  /* `extrac_pool_` is always owned by this instance. */
-  for (auto e : extra_pool_) delete e;
+  /* `extra_pool_` is always owned by this instance and freed with it. */
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::init(size_t capacity) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
   assert(!capacity_ && !pool_ && !table_);
   assert(capacity);
   capacity_ = capacity;
-  pool_ = new Node_t[capacity];
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  pool_size_ = capacity;
   // Put these entries into free list
   free_.next = &pool_[0];
   pool_[0].prev = &free_;
@@ -261,60 +492,76 @@ inline void LRUCache<Key_t, Value_t, Hash>::init(size_t capacity) {
     pool_[i].next = &pool_[i + 1];
     pool_[i + 1].prev = &pool_[i];
   }
-  table_ = new NodeTable<Key_t, Value_t>();
+  table_ = new Table_t();
   table_->init(capacity);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::init(size_t capacity, Fn&& fn) {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(size_t capacity,
+                                                        Fn&& fn) {
   init(capacity);
   for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each(
+    Fn&& fn) const {
   for_each_lru(fn);
   for_each_in_use(fn);
+  for_each_parked(fn);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each_lru(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_lru(
+    Fn&& fn) const {
   for (auto h = lru_.next; h != &lru_; h = h->next) fn(h);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each_mru(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_mru(
+    Fn&& fn) const {
   for (auto h = lru_.prev; h != &lru_; h = h->prev) fn(h);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each_in_use(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_in_use(
+    Fn&& fn) const {
   for (auto h = in_use_.next; h != &in_use_; h = h->next) fn(h);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each_until_lru(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_until_lru(
+    Fn&& fn) const {
   for (auto h = lru_.next; h != &lru_; h = h->next) {
     if (!fn(h)) break;
   }
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void LRUCache<Key_t, Value_t, Hash>::for_each_until_mru(Fn&& fn) const {
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_until_mru(
+    Fn&& fn) const {
   for (auto h = lru_.prev; h != &lru_; h = h->prev)
     if (!fn(h)) break;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::init_from(
-    Node_t* pool, NodeTable<Key_t, Value_t>* table, size_t capacity) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::init_from(
+    Node_t* pool, Table_t* table, size_t capacity) {
   assert(!capacity_ && !pool_ && !table_);
   assert(capacity);
   capacity_ = capacity;
@@ -330,17 +577,30 @@ inline void LRUCache<Key_t, Value_t, Hash>::init_from(
   table_ = table;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Handle_t
-LRUCache<Key_t, Value_t, Hash>::insert(Key_t key, bool pin,
-                                       bool hint_nonexist) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert(Key_t key, bool pin,
+                                                     bool hint_nonexist) {
   return insert_impl(key, Hash{}(key), pin, hint_nonexist);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Node_t*
-LRUCache<Key_t, Value_t, Hash>::insert_impl(Key_t key, uint32_t hash, bool pin,
-                                            bool hint_nonexist) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert(Key_t key, bool pin,
+                                                     bool hint_nonexist,
+                                                     Fn&& victim_fn) {
+  return insert_impl(key, Hash{}(key), pin, hint_nonexist, victim_fn);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist, Fn&& victim_fn) {
   // Disable support for capacity_ == 0; the user must set capacity first
   assert(capacity_ > 0);
 
@@ -353,54 +613,146 @@ LRUCache<Key_t, Value_t, Hash>::insert_impl(Key_t key, uint32_t hash, bool pin,
     assert(!table_->lookup(key, hash));  // check if hint is correct
   }
 
-  e = alloc_node();
+  e = alloc_node(victim_fn);
   if (!e) return nullptr;
   e->init(key, hash);
+  charge_new(e);
   table_->insert(e);
-  assert(e->refs == 1);
-  if (pin) {
-    e->refs++;
-    list_append(&in_use_, e);
-  } else {
-    list_append(&lru_, e);
-  }
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  Node_t::list_append(&lru_, e);
   ++size_;
   return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Handle_t
-LRUCache<Key_t, Value_t, Hash>::lookup(Key_t key, bool pin) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_charged(
+    Key_t key, uint32_t charge, bool pin, bool hint_nonexist)
+    requires kCharged {
+  return insert_charged_impl(key, Hash{}(key), charge, pin, hint_nonexist);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_charged_impl(
+    Key_t key, uint32_t hash, uint32_t charge, bool pin, bool hint_nonexist) {
+  static_assert(kCharged);
+  Node_t* e = hint_nonexist ? nullptr : lookup_impl(key, hash, pin);
+  if (!e) {
+    if (charge > budget_) return nullptr;  // never fits; evict nothing
+    // make room before allocating, so the new node is never a victim
+    if (!reserve(charge)) return nullptr;
+    e = insert_impl(key, hash, pin, /*hint_nonexist*/ true);
+    if (!e) return nullptr;
+  } else if (uint32_t old = ValueCharge<Value_t>::get(e->value); charge > old) {
+    // the charge of an existing node grows; keep the old one if it cannot fit
+    e->refs.fetch_add(1, std::memory_order_relaxed);  // not to evict itself
+    bool fits = charge <= budget_ && reserve(charge - old);
+    e->refs.fetch_sub(1, std::memory_order_relaxed);
+    if (!fits) {
+      if (pin) e->refs.fetch_sub(1, std::memory_order_relaxed);  // undo lookup
+      return nullptr;
+    }
+  }
+  uint32_t& old_charge = ValueCharge<Value_t>::get(e->value);
+  usage_ = usage_ - old_charge + charge;
+  old_charge = charge;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::set_budget(
+    size_t budget)
+    requires kCharged {
+  budget_ = budget;
+  reserve(0);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup(Key_t key, bool pin) {
   return lookup_impl(key, Hash{}(key), pin);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Node_t*
-LRUCache<Key_t, Value_t, Hash>::lookup_impl(Key_t key, uint32_t hash,
-                                            bool pin) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(
+    Key_t key, uint32_t hash, bool pin) {
   Node_t* e = table_->lookup(key, hash);
   if (e) lookup_refresh(e, pin);
   return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::release(Handle_t handle) {
-  // release can only called if the caller has previously pinned the handle;
-  // the handle thus must still have nonzero refs
-  Node_t* e = handle.node;
-  assert(e->refs > 1);
-  unref(e);
-  assert(e->refs > 0);
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::peek(Key_t key, bool pin) {
+  return peek_impl(key, Hash{}(key), pin);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::pin(Handle_t handle) {
-  ref(handle.node);
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::peek_impl(Key_t key,
+                                                        uint32_t hash,
+                                                        bool pin) {
+  Node_t* e = table_->lookup(key, hash);
+  if (e && pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Handle_t
-LRUCache<Key_t, Value_t, Hash>::preempt() {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_batch(
+    const Key_t* keys, size_t n, Handle_t* handles, bool pin,
+    bool hint_nonexist) {
+  uint32_t hashes[kPrefetchBatch];
+  for (size_t i = 0; i < n; i += kPrefetchBatch) {
+    size_t m = std::min(n - i, kPrefetchBatch);
+    for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(keys[i + j]);
+    prefetch_impl(table_, hashes, m);
+    for (size_t j = 0; j < m; ++j)
+      handles[i + j] = insert_impl(keys[i + j], hashes[j], pin, hint_nonexist);
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_batch(
+    const Key_t* keys, size_t n, Handle_t* handles, bool pin) {
+  uint32_t hashes[kPrefetchBatch];
+  for (size_t i = 0; i < n; i += kPrefetchBatch) {
+    size_t m = std::min(n - i, kPrefetchBatch);
+    for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(keys[i + j]);
+    prefetch_impl(table_, hashes, m);
+    for (size_t j = 0; j < m; ++j)
+      handles[i + j] = lookup_impl(keys[i + j], hashes[j], pin);
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::prefetch_impl(
+    Table_t* table, const uint32_t* hashes, size_t n) {
+  for (size_t i = 0; i < n; ++i) table->prefetch_bucket(hashes[i]);
+  for (size_t i = 0; i < n; ++i) table->prefetch_node(hashes[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::pin(Handle_t handle) {
+  handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::preempt() {
   // In fact, it is just like allocate a handle but instead of using it
   // immediately, return it out to caller (i.e. SharedCache).
   // We keep this function independent from `alloc_node` to make it
@@ -410,25 +762,28 @@ LRUCache<Key_t, Value_t, Hash>::preempt() {
   return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::assign(Handle_t e) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::assign(Handle_t e) {
   ++capacity_;
   free_node(e.node);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::lookup_refresh(Node_t* node,
-                                                           bool pin) {
-  if (pin)
-    ref(node);
-  else if (node->refs == 1)
-    lru_refresh(node);
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_refresh(
+    Node_t* node, bool pin) {
+  // the node may be in lru_ or in_use_, and moves to the MRU end either way
+  Node_t::list_remove(node);
+  Node_t::list_append(&lru_, node);
+  if (pin) node->refs.fetch_add(1, std::memory_order_relaxed);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Handle_t
-LRUCache<Key_t, Value_t, Hash>::refresh(Key_t key, uint32_t hash,
-                                        Handle_t& successor) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::refresh(Key_t key, uint32_t hash,
+                                                      Handle_t& successor) {
   // Disable support for capacity_ == 0; the user must set capacity first
   assert(capacity_ > 0);
 
@@ -443,136 +798,288 @@ LRUCache<Key_t, Value_t, Hash>::refresh(Key_t key, uint32_t hash,
   e = alloc_node();
   if (!e) return nullptr;
   e->init(key, hash);
+  charge_new(e);
   table_->insert(e);
-  assert(e->refs == 1);
-  list_append(&lru_, e);
+  Node_t::list_append(&lru_, e);
   ++size_;
   return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline bool LRUCache<Key_t, Value_t, Hash>::erase(Handle_t handle) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::erase(
+    Handle_t handle) {
   Node_t* e = handle.node;
   assert(e);
-  if (e->refs != 1) return false;
-  list_remove(e);
-  list_append(&erased_, e);
+  // refs can only be decremented concurrently (by release), so a node seen
+  // unpinned stays unpinned
+  if (e->refs.load(std::memory_order_acquire) != 1) return false;
+  Node_t::list_remove(e);
+  Node_t::list_append(&erased_, e);
   // it's actually fine to not decrement refs because later `Node_t::init` will
   // reset it. however, decrement it can help to detect "double-erase" issue.
-  --e->refs;
+  e->refs.store(0, std::memory_order_relaxed);
   [[maybe_unused]] Node_t* e_;
   e_ = table_->remove(e->key, e->hash);
   assert(e_ == e);
+  uncharge(e);
   --size_;
   --capacity_;
   return true;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Handle_t
-LRUCache<Key_t, Value_t, Hash>::install(Key_t key) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::install(Key_t key) {
   return install_impl(key);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Node_t*
-LRUCache<Key_t, Value_t, Hash>::install_impl(Key_t key) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::install_impl(Key_t key) {
   Node_t* e;
   if (erased_.next == &erased_) {
-    e = new Node_t;  // caller is responsible for setting the value
-    extra_pool_.emplace_back(e);
+    e = extra_pool_.alloc();  // caller is responsible for setting the value
   } else {
     e = erased_.next;
-    list_remove(e);
+    Node_t::list_remove(e);
   }
   e->init(key, Hash{}(key));
+  charge_new(e);
   table_->insert(e);
-  list_append(&lru_, e);
+  Node_t::list_append(&lru_, e);
   ++size_;
   ++capacity_;
   return e;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Node_t*
-LRUCache<Key_t, Value_t, Hash>::alloc_node() {
-  if (free_.next != &free_) {  // Allocate from free list
-    Node_t* e = free_.next;
-    list_remove(e);
-    return e;
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each_parked(
+    Fn&& fn) const {
+  for (auto h = parked_.next; h != &parked_; h = h->next) fn(h);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::unpark(
+    Handle_t handle) {
+  Node_t* e = handle.node;
+  Node_t::list_remove(e);
+  Node_t::list_append(lru_.next, e);  // insert before the oldest one
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::save(
+    const std::string& path) const {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) return false;
+  SnapshotHeader header{kSnapshotLRU, kSnapshotVersion, sizeof(Key_t),
+                        /*meta_size*/ 0, size_};
+  snapshot_write(os, &header);
+  save_keys(os);
+  return static_cast<bool>(os.flush());
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::load(
+    const std::string& path) {
+  assert(capacity_ > 0);
+  if (size_ > 0) return false;
+  std::ifstream is(path, std::ios::binary);
+  SnapshotHeader header;
+  if (!is || !snapshot_read_header(is, header, kSnapshotLRU, sizeof(Key_t),
+                                   /*meta_size*/ 0))
+    return false;
+  return load_keys(is, header.count, [](Node_t*) {});
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::restore(Key_t key,
+                                                      uint32_t hash) {
+  Node_t* e = free_.next;
+  if (e == &free_) return nullptr;
+  Node_t::list_remove(e);
+  e->init(key, hash);
+  charge_new(e);
+  table_->insert(e);
+  Node_t::list_append(&lru_, e);
+  ++size_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::save_keys(
+    std::ostream& os) const {
+  Key_t keys[kPrefetchBatch];
+  size_t m = 0;
+  auto save_key = [&](const Node_t* e) {
+    keys[m++] = e->key;
+    if (m == kPrefetchBatch) {
+      snapshot_write(os, keys, m);
+      m = 0;
+    }
+  };
+  for_each_parked(save_key);
+  for_each_in_use(save_key);
+  for_each_lru(save_key);
+  snapshot_write(os, keys, m);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::load_keys(
+    std::istream& is, uint64_t count, Fn&& fn) {
+  // keep the most recently used ones if not all of them fit
+  uint64_t num_free = capacity_ - size_;
+  if (count > num_free) {
+    auto skipped = static_cast<std::streamsize>((count - num_free) *
+                                                sizeof(Key_t));
+    if (is.ignore(skipped).gcount() != skipped) return false;
+    count = num_free;
+  }
+  Key_t keys[kPrefetchBatch];
+  uint32_t hashes[kPrefetchBatch];
+  for (uint64_t i = 0; i < count; i += kPrefetchBatch) {
+    size_t m = std::min<uint64_t>(count - i, kPrefetchBatch);
+    if (!snapshot_read(is, keys, m)) return false;
+    for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(keys[j]);
+    prefetch_impl(table_, hashes, m);
+    for (size_t j = 0; j < m; ++j) {
+      Node_t* e = restore(keys[j], hashes[j]);
+      assert(e);
+      fn(e);
+    }
   }
+  return true;
+}
 
-  // Evict one handle from LRU and recycle it
-  if (lru_.next == &lru_) return nullptr;  // No more space
-  Node_t* e = lru_.next;
-  assert(e->refs == 1);
-  list_remove(e);  // Remove from lru_
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::evict(Node_t* e) {
+  if (e->refs.load(std::memory_order_acquire) > 1) return false;
+  Node_t::list_remove(e);
   [[maybe_unused]] Node_t* e_;
   e_ = table_->remove(e->key, e->hash);
   assert(e_ == e);
+  uncharge(e);
   --size_;
-  return e;
+  free_node(e);
+  return true;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::free_node(Node_t* e) {
-  list_append(&free_, e);
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::alloc_node(Fn&& victim_fn) {
+  if (free_.next != &free_) {  // Allocate from free list
+    Node_t* e = free_.next;
+    Node_t::list_remove(e);
+    return e;
+  }
+  return evict_lru(victim_fn);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::ref(Node_t* e) {
-  if (e->refs == 1) {  // If on lru_ list, move to in_use_ list.
-    list_remove(e);
-    list_append(&in_use_, e);
-  }
-  e->refs++;
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::evict_lru(Fn&& victim_fn) {
+  // Evict one handle from LRU and recycle it; pinned ones are moved aside.
+  // Nodes released since they were moved aside rejoin lru_ first, so they age
+  // out instead of staying cached until lru_ runs out of unpinned nodes.
+  reclaim_in_use();
+  do {
+    while (lru_.next != &lru_) {
+      Node_t* e = lru_.next;
+      Node_t::list_remove(e);  // Remove from lru_
+      if (e->refs.load(std::memory_order_acquire) > 1) {
+        Node_t::list_append(&in_use_, e);
+        continue;
+      }
+      if (!victim_fn(e)) {
+        Node_t::list_append(&parked_, e);
+        continue;
+      }
+      [[maybe_unused]] Node_t* e_;
+      e_ = table_->remove(e->key, e->hash);
+      assert(e_ == e);
+      uncharge(e);
+      --size_;
+      return e;
+    }
+  } while (reclaim_in_use());
+  return nullptr;  // No more space
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::unref(Node_t* e) {
-  assert(e->refs > 0);
-  e->refs--;
-  if (e->refs == 0) {  // Deallocate.
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::reserve(
+    size_t charge) {
+  while (usage_ + charge > budget_) {
+    Node_t* e = evict_lru([](Node_t*) { return true; });
+    if (!e) return false;
     free_node(e);
-  } else if (e->refs == 1) {
-    // No longer in use; move to lru_ list.
-    list_remove(e);
-    list_append(&lru_, e);
   }
+  return true;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::list_remove(Node_t* e) {
-  e->next->prev = e->prev;
-  e->prev->next = e->next;
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void LRUCache<Key_t, Value_t, Hash, Table, Alloc>::free_node(
+    Node_t* e) {
+  Node_t::list_append(&free_, e);
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline void LRUCache<Key_t, Value_t, Hash>::list_append(Node_t* list,
-                                                        Node_t* e) {
-  // Make "e" newest entry by inserting just before *list
-  e->next = list;
-  e->prev = list->prev;
-  e->prev->next = e;
-  e->next->prev = e;
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool LRUCache<Key_t, Value_t, Hash, Table, Alloc>::reclaim_in_use() {
+  bool reclaimed = false;
+  for (Node_t* e = in_use_.next; e != &in_use_;) {
+    Node_t* next = e->next;
+    if (e->refs.load(std::memory_order_relaxed) == 1) {
+      Node_t::list_remove(e);
+      Node_t::list_append(&lru_, e);
+      reclaimed = true;
+    }
+    e = next;
+  }
+  return reclaimed;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline typename LRUCache<Key_t, Value_t, Hash>::Node_t*
-LRUCache<Key_t, Value_t, Hash>::lru_refresh(Node_t* e) {
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename LRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+LRUCache<Key_t, Value_t, Hash, Table, Alloc>::lru_refresh(Node_t* e) {
   assert(e != &lru_);
   assert(e->refs == 1);
   auto successor = e->next;
   if (successor == &lru_) return e;  // no need to move
-  list_remove(e);
-  list_append(&lru_, e);
+  Node_t::list_remove(e);
+  Node_t::list_append(&lru_, e);
   return successor;
 }
 
-template <typename Key_t, typename Value_t, typename Hash>
-inline std::ostream& LRUCache<Key_t, Value_t, Hash>::print(std::ostream& os,
-                                                           int indent) const {
-  os << "LRUCache (capacity=" << capacity_ << ") {\n";
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& LRUCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "LRUCache (capacity=" << capacity_;
+  if constexpr (kCharged) {
+    os << ", usage=" << usage_;
+    if (budget_ != kUnlimited) os << ", budget=" << budget_;
+  }
+  os << ") {\n";
   for (int i = 0; i < indent + 1; ++i) os << '\t';
   os << "lru:    [";
   lru_.print_list(os);
@@ -581,6 +1088,12 @@ inline std::ostream& LRUCache<Key_t, Value_t, Hash>::print(std::ostream& os,
   os << "in_use: [";
   in_use_.print_list(os);
   os << "]\n";
+  if (parked_.next != &parked_) {
+    for (int i = 0; i < indent + 1; ++i) os << '\t';
+    os << "parked: [";
+    parked_.print_list(os);
+    os << "]\n";
+  }
   for (int i = 0; i < indent + 1; ++i) os << '\t';
   table_->print(os, indent + 1);
   for (int i = 0; i < indent; ++i) os << '\t';
@@ -3,6 +3,7 @@
  */
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <iostream>
@@ -18,39 +19,116 @@ namespace gcache {
 // The cache keeps two linked lists of items in the cache.  All items in the
 // cache are in one list or the other, and never both.  Items still referenced
 // by clients but erased from the cache are in neither list.  The lists are:
-// - in-use:  contains the items currently referenced by clients, in no
-//   particular order.  (This list is used for invariant checking.  If we
-//   removed the check, elements that would otherwise be on this list could be
-//   left as disconnected singleton lists.)
-// - LRU:  contains the items not currently referenced by clients, in LRU order
-// Elements are moved between these lists by the Ref() and Unref() methods,
-// when they detect an element in the cache acquiring or losing its only
-// external reference.
+// - LRU:  contains the items in LRU order, including those referenced by
+//   clients that have not been seen by eviction yet.
+// - in-use:  contains the items that eviction found referenced by clients, in
+//   no particular order; an item released since then is moved back to the MRU
+//   end of the LRU list by the next eviction, as if it was moved on release.
+// The reference count is atomic and pinning/releasing never moves an element
+// between lists, so a client holding a reference can release it without the
+// cache's lock.
 
-template <typename Key_t, typename Value_t>
+template <typename Key_t, typename Value_t, typename Alloc>
 class NodeTable;
 
-template <typename Key_t, typename Value_t, typename Hash>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 class LRUCache;
 
-template <typename Hash, typename Meta>
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class ClockCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class SLRUCache;
+
+template <typename Node_t, typename Alloc>
+class SLRUSegments;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class S3FifoCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class SieveCache;
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+class TinyLFUCache;
+
+template <typename Hash, typename Meta, typename Cache>
 class GhostCache;
 
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+class ShardedLRUCache;
+
 // LRUNodes forms a circular doubly linked list ordered by access time.
 template <typename Key_t, typename Value_t>
 class LRUNode {
   LRUNode *next_hash;
   LRUNode *next;
   LRUNode *prev;
-  uint32_t refs;  // References, including cache reference, if present.
+  // References, including cache reference, if present.
+  std::atomic<uint32_t> refs;
+
+  static void list_remove(LRUNode *e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+  }
+
+  static void list_append(LRUNode *list, LRUNode *e) {
+    // Make "e" newest entry by inserting just before *list
+    e->next = list;
+    e->prev = list->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+  }
+
+  // release can only be called if the caller has previously pinned the node;
+  // the node thus must have at least two refs. The release order makes the
+  // caller's writes to the value visible to whoever recycles the node. Return
+  // the refs before release.
+  uint32_t release() {
+    uint32_t refs = this->refs.fetch_sub(1, std::memory_order_release);
+    assert(refs > 1);
+    return refs;
+  }
 
  protected:
-  friend class NodeTable<Key_t, Value_t>;
+  template <typename K, typename V, typename A>
+  friend class NodeTable;
 
-  template <typename K, typename V, typename H>
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
   friend class LRUCache;
 
-  template <typename H, typename M>
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class ClockCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class SLRUCache;
+
+  template <typename N, typename A>
+  friend class SLRUSegments;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class S3FifoCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class SieveCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class TinyLFUCache;
+
+  template <typename H, typename M, typename C>
   friend class GhostCache;
 
  public:
@@ -59,7 +137,7 @@ class LRUNode {
   Value_t value;
 
   void init(Key_t k, uint32_t h) {
-    this->refs = 1;
+    this->refs.store(1, std::memory_order_relaxed);
     this->hash = h;
     this->key = k;
   }
@@ -67,7 +145,8 @@ class LRUNode {
   // print for debugging
   friend std::ostream &operator<<(std::ostream &os, const LRUNode &h) {
     // value may not be printable...
-    return os << h.key << " (refs=" << h.refs << ", hash=" << h.hash << ")";
+    return os << h.key << " (refs=" << h.refs.load() << ", hash=" << h.hash
+              << ")";
   }
 
   // print a list; this must be a dummy list head
@@ -135,14 +214,39 @@ class LRUHandle : public BaseHandle<LRUNode<Key_t, Value_t>> {
   using BaseHandle<Node_t>::node;  // otherwise `node` will be invisible
 
  protected:
-  friend class NodeTable<Key_t, Value_t>;
+  template <typename K, typename V, typename A>
+  friend class NodeTable;
 
-  template <typename K, typename V, typename H>
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
   friend class LRUCache;
 
-  template <typename H, typename M>
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class ClockCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class SLRUCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class S3FifoCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class SieveCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class TinyLFUCache;
+
+  template <typename H, typename M, typename C>
   friend class GhostCache;
 
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
  public:
   LRUHandle(Node_t *node) : BaseHandle<Node_t>(node) {}
   LRUHandle() = default;
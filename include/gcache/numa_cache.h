@@ -0,0 +1,360 @@
+#pragma once
+
+#include <linux/mempolicy.h>  // for MPOL_*; syscalls avoid linking libnuma
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+#include "alloc.h"
+#include "lru_cache.h"
+#include "node.h"
+#include "shared_cache.h"
+#include "table.h"
+
+namespace gcache {
+
+namespace numa {
+
+// Number of NUMA nodes that this process may allocate memory from; 1 if NUMA
+// is unsupported (or forbidden, e.g. by seccomp in a container).
+inline uint32_t num_nodes() {
+  unsigned long mask = 0;
+  if (syscall(SYS_get_mempolicy, nullptr, &mask, sizeof(mask) * 8 + 1,
+              nullptr, MPOL_F_MEMS_ALLOWED) != 0 ||
+      mask == 0)
+    return 1;
+  return std::bit_width(mask);
+}
+
+// The CPU and the NUMA node that the calling thread is running on.
+inline void get_cpu(uint32_t& cpu, uint32_t& node) {
+  unsigned c = 0, n = 0;
+  if (syscall(SYS_getcpu, &c, &n, nullptr) != 0) c = n = 0;
+  cpu = c;
+  node = n;
+}
+
+// Within its scope, memory faulted in by the calling thread is bound to the
+// given node. This is best effort: if NUMA is unsupported, it does nothing.
+class ScopedMemBind {
+ public:
+  explicit ScopedMemBind(uint32_t node) {
+    assert(node < sizeof(unsigned long) * 8);
+    unsigned long mask = 1ul << node;
+    bound_ = syscall(SYS_set_mempolicy, MPOL_BIND, &mask,
+                     sizeof(mask) * 8 + 1) == 0;
+  }
+  ~ScopedMemBind() {
+    if (bound_) syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+  }
+  ScopedMemBind(const ScopedMemBind&) = delete;
+  ScopedMemBind& operator=(const ScopedMemBind&) = delete;
+
+  bool bound() const { return bound_; }
+
+ private:
+  bool bound_;
+};
+
+}  // namespace numa
+
+// NumaLRUCache is a thread-safe LRU cache partitioned by NUMA nodes: each node
+// has its own shard (an LRUCache protected by its own lock), whose node pool
+// and table are allocated from the node's local memory. A thread inserts into
+// the shard of its local node, and looks up the local shard before the remote
+// ones, so blocks mostly accessed from one socket stay in its local memory.
+// A key is cached in at most one shard; to guarantee that, a key is only added
+// to a shard while holding one of kNumInsertLocks locks picked by its hash, so
+// inserts of the same key serialize while inserts of other keys mostly do not.
+//
+// The number of nodes can be set different from the machine's (e.g. to test
+// on a single-node machine). In this case, shard i is bound to physical node
+// i % numa::num_nodes(), and a thread's local shard is chosen by its CPU. The
+// *_on variants of APIs take the local node explicitly.
+//
+// Handles are TaggedHandle whose tag is the node of the owning shard. Memory is
+// bound by the page faults during `init`, so the pool should be large enough
+// not to be carved from pages already faulted in by the heap (or use
+// MmapAlloc, which maps fresh pages for arrays of 2MB or more).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class NumaLRUCache {
+ public:
+  using TaggedValue_t = TaggedValue<uint32_t, Value_t>;
+  using LRUCache_t = LRUCache<Key_t, TaggedValue_t, Hash, Table, Alloc>;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = TaggedHandle<uint32_t, Key_t, Value_t>;
+
+  explicit NumaLRUCache(uint32_t num_nodes = numa::num_nodes());
+  ~NumaLRUCache() = default;
+  NumaLRUCache(const NumaLRUCache&) = delete;
+  NumaLRUCache(NumaLRUCache&&) = delete;
+  NumaLRUCache& operator=(const NumaLRUCache&) = delete;
+  NumaLRUCache& operator=(NumaLRUCache&&) = delete;
+
+  // The capacity is evenly split across nodes. `init` is not thread-safe.
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  uint32_t num_nodes() const { return num_nodes_; }
+  // The node of the calling thread.
+  uint32_t local_node() const;
+
+  // Aggregated size/capacity over all shards; since each shard is locked
+  // separately, the result may be inconsistent under concurrent updates.
+  size_t size() const;
+  size_t capacity() const;
+  size_t size_of(uint32_t node) const;
+  size_t capacity_of(uint32_t node) const;
+
+  // For each item in the cache, call fn(handle); shards are visited one by one
+  // while holding the shard's lock, so fn must not call back into this cache.
+  template <typename Fn>
+  void for_each(Fn&& fn) const;
+
+  // Same semantics as LRUCache, except that a hit may be in a remote shard.
+  Handle_t insert(Key_t key, bool pin = false) {
+    return insert_on(local_node(), key, pin);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_on(local_node(), key, pin);
+  }
+  Handle_t install(Key_t key) { return install_on(local_node(), key); }
+  Handle_t insert_on(uint32_t node, Key_t key, bool pin = false);
+  Handle_t lookup_on(uint32_t node, Key_t key, bool pin = false);
+  Handle_t install_on(uint32_t node, Key_t key);
+  // Lock-free, as it only drops the node's atomic reference count.
+  void release(Handle_t handle);
+  void pin(Handle_t handle);
+  bool erase(Handle_t handle);
+
+ private:
+  // Pad to cache line to avoid false sharing between shards' locks.
+  struct alignas(64) Shard {
+    mutable std::mutex mtx;
+    LRUCache_t cache;
+  };
+
+  static constexpr uint32_t kNumInsertLocks = 64;
+  struct alignas(64) InsertLock {
+    std::mutex mtx;
+  };
+
+  std::mutex& insert_mtx(uint32_t hash) {
+    return insert_locks_[hash % kNumInsertLocks].mtx;
+  }
+
+  uint32_t num_nodes_;
+  uint32_t num_physical_nodes_;
+  std::unique_ptr<Shard[]> shards_;
+  // Serialize adding a new key into any shard, striped by the key's hash.
+  InsertLock insert_locks_[kNumInsertLocks];
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const NumaLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::NumaLRUCache(
+    uint32_t num_nodes)
+    : num_nodes_(num_nodes),
+      num_physical_nodes_(numa::num_nodes()),
+      shards_(new Shard[num_nodes]) {
+  assert(num_nodes > 0);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  init(capacity, [](Handle_t) {});
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  assert(capacity >= num_nodes_);
+  for (uint32_t i = 0; i < num_nodes_; ++i) {
+    numa::ScopedMemBind bind(i % num_physical_nodes_);
+    shards_[i].cache.init(
+        capacity / num_nodes_ + (i < capacity % num_nodes_ ? 1 : 0),
+        [&fn, i](Node_t* e) {
+          e->value.tag = i;
+          fn(Handle_t(e));
+        });
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline uint32_t NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::local_node()
+    const {
+  uint32_t cpu, node;
+  numa::get_cpu(cpu, node);
+  return (num_nodes_ == num_physical_nodes_ ? node : cpu) % num_nodes_;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::size() const {
+  size_t total = 0;
+  for (uint32_t i = 0; i < num_nodes_; ++i) total += size_of(i);
+  return total;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::capacity()
+    const {
+  size_t total = 0;
+  for (uint32_t i = 0; i < num_nodes_; ++i) total += capacity_of(i);
+  return total;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::size_of(
+    uint32_t node) const {
+  std::lock_guard<std::mutex> lock(shards_[node].mtx);
+  return shards_[node].cache.size();
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::capacity_of(
+    uint32_t node) const {
+  std::lock_guard<std::mutex> lock(shards_[node].mtx);
+  return shards_[node].cache.capacity();
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::for_each(
+    Fn&& fn) const {
+  for (uint32_t i = 0; i < num_nodes_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mtx);
+    shards_[i].cache.for_each([&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_on(uint32_t node,
+                                                            Key_t key,
+                                                            bool pin) {
+  assert(node < num_nodes_);
+  uint32_t hash = Hash{}(key);
+  auto& local = shards_[node];
+  std::unique_lock<std::mutex> insert_lock(insert_mtx(hash), std::defer_lock);
+  {
+    std::lock_guard<std::mutex> lock(local.mtx);
+    if (Node_t* e = local.cache.lookup_impl(key, hash, pin)) return e;
+    // No one can add the key without its insert lock, so if the lock is taken
+    // before unlocking the local shard, the local miss stays valid; try_lock
+    // never blocks, so it cannot deadlock with the lock order below.
+    insert_lock.try_lock();
+  }
+  bool local_miss = insert_lock.owns_lock();
+  // Otherwise, the key may be added to any shard until the insert lock is
+  // taken, so the local shard is checked again by insert_impl.
+  if (!local_miss) insert_lock.lock();
+  for (uint32_t i = 1; i < num_nodes_; ++i) {
+    auto& remote = shards_[(node + i) % num_nodes_];
+    std::lock_guard<std::mutex> lock(remote.mtx);
+    if (Node_t* e = remote.cache.lookup_impl(key, hash, pin)) return e;
+  }
+  std::lock_guard<std::mutex> lock(local.mtx);
+  return local.cache.insert_impl(key, hash, pin, /*hint_nonexist*/ local_miss);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_on(uint32_t node,
+                                                            Key_t key,
+                                                            bool pin) {
+  assert(node < num_nodes_);
+  uint32_t hash = Hash{}(key);
+  for (uint32_t i = 0; i < num_nodes_; ++i) {
+    auto& s = shards_[(node + i) % num_nodes_];
+    std::lock_guard<std::mutex> lock(s.mtx);
+    if (Node_t* e = s.cache.lookup_impl(key, hash, pin)) return e;
+  }
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::install_on(uint32_t node,
+                                                             Key_t key) {
+  assert(node < num_nodes_);
+  std::lock_guard<std::mutex> insert_lock(insert_mtx(Hash{}(key)));
+  assert(!lookup_on(node, key));
+  auto& s = shards_[node];
+  std::lock_guard<std::mutex> lock(s.mtx);
+  Node_t* e = s.cache.install_impl(key);
+  e->value.tag = node;  // may be newly allocated
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::release(
+    Handle_t handle) {
+  shards_[handle.get_tag()].cache.release(handle.untagged());
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::pin(
+    Handle_t handle) {
+  auto& s = shards_[handle.get_tag()];
+  std::lock_guard<std::mutex> lock(s.mtx);
+  s.cache.pin(handle.untagged());
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::erase(
+    Handle_t handle) {
+  auto& s = shards_[handle.get_tag()];
+  std::lock_guard<std::mutex> lock(s.mtx);
+  return s.cache.erase(handle.untagged());
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& NumaLRUCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "NumaLRUCache (num_nodes=" << num_nodes_
+     << ", num_physical_nodes=" << num_physical_nodes_ << ") {\n";
+  for (uint32_t i = 0; i < num_nodes_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mtx);
+    for (int j = 0; j < indent + 1; ++j) os << '\t';
+    os << "Node " << i << ": ";
+    shards_[i].cache.print(os, indent + 1);
+  }
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
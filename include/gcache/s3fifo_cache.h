@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// S3FifoCache is a drop-in replacement of LRUCache with the S3-FIFO policy, on
+// the same node pool and table. It keeps three FIFO queues:
+// - small: a newly inserted node enters here; it holds `small_ratio` of the
+//   capacity, so one-hit wonders are evicted quickly;
+// - main: a node in small that is referenced again is moved here instead of
+//   being evicted; a node is reinserted into main if it is referenced since
+//   the last time, with its frequency decremented;
+// - ghost: keys evicted from small, in metadata-only nodes as in GhostCache;
+//   a newly inserted key found in ghost goes directly to main.
+// A hit only increments the node's 2-bit frequency with relaxed atomics, and
+// never relinks any list; as with ClockCache, lookups are read-only to the
+// cache structure, so ShardedLRUCache runs them under a shared lock.
+//
+// A pinned node is never evicted; eviction treats it as referenced and moves
+// it to the newest end of main without touching its frequency.
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but
+// not the LRU-specific ones (e.g. for_each_lru, erase/install).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class S3FifoCache {
+ public:
+  using Node_t = LRUNode<Key_t, Value_t>;
+  using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Lookup only reads the table, and bumps the frequency and pins the node
+  // with atomics.
+  static constexpr bool kConcurrentLookup = true;
+
+  explicit S3FifoCache(double small_ratio = 0.1);
+  ~S3FifoCache() {
+    Alloc::deallocate(pool_, capacity_);
+    Alloc::deallocate(freqs_, capacity_);
+    Alloc::deallocate(ghost_pool_, ghost_capacity_);
+  }
+  S3FifoCache(const S3FifoCache&) = delete;
+  S3FifoCache(S3FifoCache&&) = delete;
+  S3FifoCache& operator=(const S3FifoCache&) = delete;
+  S3FifoCache& operator=(S3FifoCache&&) = delete;
+
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t small_size() const { return small_size_; }
+
+  // For each item in the cache, call fn(handle) in the order of the pool
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < size_; ++i) fn(&pool_[i]);
+  }
+
+  // Same semantics as LRUCache, except that a hit only bumps the frequency
+  // instead of refreshing LRU.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { handle.node->release(); }
+  void pin(Handle_t handle) {
+    handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  // Metadata-only node of the ghost queue; the value tells whether it is
+  // still in ghost_table_, i.e., not hit since it was inserted.
+  using GhostNode_t = LRUNode<Key_t, bool>;
+  using GhostTable_t = Table<Key_t, bool, Alloc>;
+
+  // A frequency saturates at 3, so a node is reinserted into main at most 3
+  // times without being referenced again.
+  static constexpr uint8_t kMaxFreq = 3;
+
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  // Evict from small or main; return nullptr if all are pinned.
+  Node_t* evict();
+  // Insert a key into ghost, which overwrites the oldest ghost entry.
+  void ghost_insert(Key_t key, uint32_t hash);
+  // Remove a key from ghost; return whether it is found.
+  bool ghost_remove(Key_t key, uint32_t hash);
+
+  size_t index_of(const Node_t* e) const { return e - pool_; }
+
+  // Number of nodes in use; nodes in pool_[size_, capacity_) are free.
+  size_t size_;
+  size_t capacity_;
+  double small_ratio_;
+  size_t small_capacity_;
+  // Number of nodes in the small_ list; the others are in main_.
+  size_t small_size_;
+  Node_t* pool_;
+  // One byte per node in pool_, so a hit does not write the node itself.
+  std::atomic<uint8_t>* freqs_;
+  Table_t table_;
+
+  // Dummy heads of the FIFO queues; list.prev is the newest entry, list.next
+  // is the oldest entry.
+  Node_t small_;
+  Node_t main_;
+
+  // The ghost queue is a ring of ghost_capacity_ nodes; ghost_head_ is the
+  // oldest one, which is overwritten by the next ghost_insert.
+  GhostNode_t* ghost_pool_;
+  size_t ghost_capacity_;
+  size_t ghost_head_;
+  GhostTable_t ghost_table_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const S3FifoCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::S3FifoCache(
+    double small_ratio)
+    : size_(0),
+      capacity_(0),
+      small_ratio_(small_ratio),
+      small_capacity_(0),
+      small_size_(0),
+      pool_(nullptr),
+      freqs_(nullptr),
+      table_(),
+      ghost_pool_(nullptr),
+      ghost_capacity_(0),
+      ghost_head_(0),
+      ghost_table_() {
+  assert(small_ratio > 0 && small_ratio < 1);
+  small_.next = &small_;
+  small_.prev = &small_;
+  main_.next = &main_;
+  main_.prev = &main_;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  assert(!capacity_ && !pool_);
+  assert(capacity);
+  capacity_ = capacity;
+  small_capacity_ =
+      std::max<size_t>(static_cast<size_t>(capacity * small_ratio_), 1);
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  freqs_ = Alloc::template allocate<std::atomic<uint8_t>>(capacity);
+  for (size_t i = 0; i < capacity; ++i)
+    freqs_[i].store(0, std::memory_order_relaxed);
+  table_.init(capacity);
+
+  // ghost remembers as many keys as main holds
+  ghost_capacity_ = std::max<size_t>(capacity - small_capacity_, 1);
+  ghost_pool_ = Alloc::template allocate<GhostNode_t>(ghost_capacity_);
+  for (size_t i = 0; i < ghost_capacity_; ++i) ghost_pool_[i].value = false;
+  ghost_table_.init(ghost_capacity_);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  init(capacity);
+  for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+  assert(capacity_ > 0);
+  Node_t* e;
+  if (!hint_nonexist) {
+    e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  if (size_ < capacity_) {
+    e = &pool_[size_++];
+  } else {
+    e = evict();
+    if (!e) return nullptr;
+  }
+  e->init(key, hash);
+  freqs_[index_of(e)].store(0, std::memory_order_relaxed);
+  table_.insert(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  if (ghost_remove(key, hash)) {  // recently evicted from small
+    Node_t::list_append(&main_, e);
+  } else {
+    Node_t::list_append(&small_, e);
+    ++small_size_;
+  }
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(Key_t key,
+                                                             uint32_t hash,
+                                                             bool pin) {
+  Node_t* e = table_.lookup(key, hash);
+  if (!e) return nullptr;
+  // concurrent increments may race and lose some counts, which only makes the
+  // frequency a bit less accurate; skip the store once it saturates, so a hot
+  // node's cache line is not bounced between cores
+  auto& freq = freqs_[index_of(e)];
+  uint8_t f = freq.load(std::memory_order_relaxed);
+  if (f < kMaxFreq) freq.store(f + 1, std::memory_order_relaxed);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::evict() {
+  // Unless pinned, a node is moved at most once from small to main and then
+  // kMaxFreq times within main before it is evicted, so if no victim is found
+  // in (kMaxFreq + 2) rounds, all nodes must be pinned.
+  for (size_t i = 0; i < (kMaxFreq + 2) * capacity_; ++i) {
+    bool pinned;
+    if (small_size_ >= small_capacity_ || main_.next == &main_) {
+      Node_t* e = small_.next;
+      assert(e != &small_);
+      Node_t::list_remove(e);
+      --small_size_;
+      pinned = e->refs.load(std::memory_order_acquire) > 1;
+      if (pinned || freqs_[index_of(e)].load(std::memory_order_relaxed)) {
+        Node_t::list_append(&main_, e);
+        continue;
+      }
+      ghost_insert(e->key, e->hash);
+      [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+      assert(e_ == e);
+      return e;
+    }
+
+    Node_t* e = main_.next;
+    Node_t::list_remove(e);
+    pinned = e->refs.load(std::memory_order_acquire) > 1;
+    auto& freq = freqs_[index_of(e)];
+    uint8_t f = freq.load(std::memory_order_relaxed);
+    if (pinned || f) {
+      if (!pinned) freq.store(f - 1, std::memory_order_relaxed);
+      Node_t::list_append(&main_, e);
+      continue;
+    }
+    [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+    assert(e_ == e);
+    return e;
+  }
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::ghost_insert(
+    Key_t key, uint32_t hash) {
+  GhostNode_t* g = &ghost_pool_[ghost_head_];
+  if (++ghost_head_ == ghost_capacity_) ghost_head_ = 0;
+  if (g->value) ghost_table_.remove(g->key, g->hash);
+  g->init(key, hash);
+  g->value = true;
+  ghost_table_.insert(g);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::ghost_remove(
+    Key_t key, uint32_t hash) {
+  GhostNode_t* g = ghost_table_.remove(key, hash);
+  if (!g) return false;
+  g->value = false;  // leave the slot in the ring until it is overwritten
+  return true;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& S3FifoCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "S3FifoCache (capacity=" << capacity_
+     << ", small_capacity=" << small_capacity_ << ") {\n";
+  auto print_queue = [&](const char* name, const Node_t& list) {
+    for (int i = 0; i < indent + 1; ++i) os << '\t';
+    os << name << "[";
+    for (const Node_t* e = list.next; e != &list; e = e->next) {
+      if (e != list.next) os << ", ";
+      os << e->key;
+      uint8_t f = freqs_[index_of(e)].load(std::memory_order_relaxed);
+      for (uint8_t j = 0; j < f; ++j) os << '*';
+      if (e->refs.load() > 1) os << " (pinned)";
+    }
+    os << "]\n";
+  };
+  print_queue("small: ", small_);
+  print_queue("main:  ", main_);
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "ghost: [";
+  bool first = true;
+  for (size_t i = 0; i < ghost_capacity_; ++i) {  // from the oldest
+    const GhostNode_t& g = ghost_pool_[(ghost_head_ + i) % ghost_capacity_];
+    if (!g.value) continue;
+    if (!first) os << ", ";
+    os << g.key;
+    first = false;
+  }
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
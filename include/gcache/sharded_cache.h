@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+
+#include "hash.h"
+#include "lru_cache.h"
+#include "node.h"
+
+namespace gcache {
+
+// ShardedLRUCache is a thread-safe LRU cache: it splits the capacity into
+// (1 << ShardBits) independent LRUCache, each protected by its own lock. A key
+// is routed to a shard by the top ShardBits of its hash mixed by MurmurHash's
+// finalizer, so a Hash without entropy in the top bits (e.g. idhash) still
+// spreads keys over all shards, and the keys of a shard still spread over the
+// buckets of its NodeTable, which are indexed by the low bits of the hash.
+//
+// The Handle/pin/release semantics are the same as LRUCache. Note that an
+// unpinned handle may be recycled by another thread as soon as the call
+// returns, so concurrent callers should always pin a handle before accessing
+// its value and release it afterwards.
+//
+// Cache is the per-shard cache, e.g., LRUCache or ClockCache (see
+// clock_cache.h). If Cache::kConcurrentLookup, lookups only take the shard's
+// lock in shared mode, so they can run concurrently. If Cache buffers hits
+// (see BufferedLRUCache), a lookup that fills the buffer replays it under the
+// exclusive lock, unless another thread is holding the lock.
+template <typename Key_t, typename Value_t, typename Hash,
+          uint32_t ShardBits = 4,
+          typename Cache = LRUCache<Key_t, Value_t, Hash>>
+class ShardedLRUCache {
+  static_assert(ShardBits > 0 && ShardBits < 32);
+
+ public:
+  using LRUCache_t = Cache;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = typename LRUCache_t::Handle_t;
+
+  static constexpr size_t num_shards = size_t{1} << ShardBits;
+
+  ShardedLRUCache() = default;
+  ~ShardedLRUCache() = default;
+  ShardedLRUCache(const ShardedLRUCache&) = delete;
+  ShardedLRUCache(ShardedLRUCache&&) = delete;
+  ShardedLRUCache& operator=(const ShardedLRUCache&) = delete;
+  ShardedLRUCache& operator=(ShardedLRUCache&&) = delete;
+
+  // The capacity is evenly split across shards, so it must be no smaller than
+  // the number of shards. `init` is not thread-safe.
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  // Aggregated size/capacity over all shards; since each shard is locked
+  // separately, the result may be inconsistent under concurrent updates.
+  size_t size() const;
+  size_t capacity() const;
+
+  // For each item in the cache, call fn(handle); shards are visited one by one
+  // while holding the shard's lock, so fn must not call back into this cache.
+  template <typename Fn>
+  void for_each(Fn&& fn) const;
+
+  // Same semantics as LRUCache. `release` is lock-free, as it only drops the
+  // node's atomic reference count.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false);
+  Handle_t lookup(Key_t key, bool pin = false);
+  // Same as lookup, but never refresh LRU (if Cache supports it)
+  Handle_t peek(Key_t key, bool pin = false);
+  void release(Handle_t handle);
+  void pin(Handle_t handle);
+  bool erase(Handle_t handle);
+  Handle_t install(Key_t key);
+
+  // Return a read-only access to the shard that owns the key; the caller must
+  // ensure there is no concurrent update.
+  const LRUCache_t& get_shard(Key_t key) const {
+    return shards_[shard_idx(Hash{}(key))].cache;
+  }
+
+ private:
+  static uint32_t shard_idx(uint32_t hash) {
+    return murmurhash_u32(hash) >> (32 - ShardBits);
+  }
+
+  using Mutex_t = std::conditional_t<Cache::kConcurrentLookup,
+                                     std::shared_mutex, std::mutex>;
+
+  // Pad to cache line to avoid false sharing between shards' locks.
+  struct alignas(64) Shard {
+    mutable Mutex_t mtx;
+    LRUCache_t cache;
+  };
+
+  Shard shards_[num_shards];
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const ShardedLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline void ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::init(
+    size_t capacity) {
+  assert(capacity >= num_shards);
+  for (size_t i = 0; i < num_shards; ++i)
+    shards_[i].cache.init(capacity / num_shards +
+                          (i < capacity % num_shards ? 1 : 0));
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+template <typename Fn>
+inline void ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::init(
+    size_t capacity, Fn&& fn) {
+  assert(capacity >= num_shards);
+  for (size_t i = 0; i < num_shards; ++i)
+    shards_[i].cache.init(
+        capacity / num_shards + (i < capacity % num_shards ? 1 : 0), fn);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline size_t ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::size()
+    const {
+  size_t total = 0;
+  for (auto& s : shards_) {
+    std::lock_guard<Mutex_t> lock(s.mtx);
+    total += s.cache.size();
+  }
+  return total;
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline size_t
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::capacity() const {
+  size_t total = 0;
+  for (auto& s : shards_) {
+    std::lock_guard<Mutex_t> lock(s.mtx);
+    total += s.cache.capacity();
+  }
+  return total;
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+template <typename Fn>
+inline void ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::for_each(
+    Fn&& fn) const {
+  for (auto& s : shards_) {
+    std::lock_guard<Mutex_t> lock(s.mtx);
+    s.cache.for_each(fn);
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline typename ShardedLRUCache<Key_t, Value_t, Hash, ShardBits,
+                                Cache>::Handle_t
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::insert(
+    Key_t key, bool pin, bool hint_nonexist) {
+  uint32_t hash = Hash{}(key);
+  auto& s = shards_[shard_idx(hash)];
+  std::lock_guard<Mutex_t> lock(s.mtx);
+  return s.cache.insert_impl(key, hash, pin, hint_nonexist);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline typename ShardedLRUCache<Key_t, Value_t, Hash, ShardBits,
+                                Cache>::Handle_t
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::lookup(Key_t key,
+                                                                bool pin) {
+  uint32_t hash = Hash{}(key);
+  auto& s = shards_[shard_idx(hash)];
+  if constexpr (Cache::kConcurrentLookup) {
+    Node_t* e;
+    {
+      std::shared_lock<Mutex_t> lock(s.mtx);
+      e = s.cache.lookup_impl(key, hash, pin);
+    }
+    if constexpr (requires { s.cache.drain_pending(); }) {
+      if (s.cache.drain_pending()) {
+        std::unique_lock<Mutex_t> lock(s.mtx, std::try_to_lock);
+        if (lock.owns_lock()) s.cache.drain();
+      }
+    }
+    return e;
+  } else {
+    std::lock_guard<Mutex_t> lock(s.mtx);
+    return s.cache.lookup_impl(key, hash, pin);
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline typename ShardedLRUCache<Key_t, Value_t, Hash, ShardBits,
+                                Cache>::Handle_t
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::peek(Key_t key,
+                                                              bool pin) {
+  uint32_t hash = Hash{}(key);
+  auto& s = shards_[shard_idx(hash)];
+  if constexpr (Cache::kConcurrentLookup) {
+    std::shared_lock<Mutex_t> lock(s.mtx);
+    return s.cache.peek_impl(key, hash, pin);
+  } else {
+    std::lock_guard<Mutex_t> lock(s.mtx);
+    return s.cache.peek_impl(key, hash, pin);
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline void ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::release(
+    Handle_t handle) {
+  // the handle is pinned, so its hash must be stable
+  shards_[shard_idx(handle.node->hash)].cache.release(handle);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline void ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::pin(
+    Handle_t handle) {
+  auto& s = shards_[shard_idx(handle.node->hash)];
+  std::lock_guard<Mutex_t> lock(s.mtx);
+  s.cache.pin(handle);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline bool ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::erase(
+    Handle_t handle) {
+  auto& s = shards_[shard_idx(handle.node->hash)];
+  std::lock_guard<Mutex_t> lock(s.mtx);
+  return s.cache.erase(handle);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline typename ShardedLRUCache<Key_t, Value_t, Hash, ShardBits,
+                                Cache>::Handle_t
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::install(Key_t key) {
+  auto& s = shards_[shard_idx(Hash{}(key))];
+  std::lock_guard<Mutex_t> lock(s.mtx);
+  return s.cache.install(key);
+}
+
+template <typename Key_t, typename Value_t, typename Hash, uint32_t ShardBits,
+          typename Cache>
+inline std::ostream&
+ShardedLRUCache<Key_t, Value_t, Hash, ShardBits, Cache>::print(
+    std::ostream& os, int indent) const {
+  os << "ShardedLRUCache (num_shards=" << num_shards << ") {\n";
+  for (size_t i = 0; i < num_shards; ++i) {
+    std::lock_guard<Mutex_t> lock(shards_[i].mtx);
+    for (int j = 0; j < indent + 1; ++j) os << '\t';
+    os << "Shard " << i << ": ";
+    shards_[i].cache.print(os, indent + 1);
+  }
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
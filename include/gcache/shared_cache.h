@@ -1,14 +1,20 @@
 #pragma once
+#include <algorithm>
 #include <cstddef>
+#include <fstream>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "lru_cache.h"
 #include "node.h"
+#include "snapshot.h"
 
 namespace gcache {
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
 class SharedCache;
 
 template <typename Tag_t, typename Value_t>
@@ -17,6 +23,15 @@ struct TaggedValue {
   Value_t value;
 };
 
+// A tenant's cache is weighted if Value_t is charged
+template <typename Tag_t, typename Value_t>
+struct ValueCharge<TaggedValue<Tag_t, Value_t>> {
+  static constexpr bool kCharged = ValueCharge<Value_t>::kCharged;
+  static uint32_t& get(TaggedValue<Tag_t, Value_t>& v) {
+    return ValueCharge<Value_t>::get(v.value);
+  }
+};
+
 template <typename Tag_t, typename Key_t, typename Value_t>
 class TaggedHandle
     : public BaseHandle<LRUNode<Key_t, TaggedValue<Tag_t, Value_t>>> {
@@ -54,13 +69,19 @@ class TaggedHandle
   // only visible to SharedCache: converted into LRUHandle
   LRUHandle<Key_t, TaggedValue_t> untagged() { return node; }
 
-  template <typename T, typename K, typename V, typename H>
+  template <typename T, typename K, typename V, typename H,
+            template <typename, typename, typename> class TT, typename A>
   friend class SharedCache;
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class NumaLRUCache;
 };
 
 // Each tenant should have a "tag" which uniquely identifies this tenant. Tag
 // should be a lightweight type to copy.
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 class SharedCache {
  private:
   using TaggedValue_t = TaggedValue<Tag_t, Value_t>;
@@ -68,10 +89,11 @@ class SharedCache {
 
  public:
   using Handle_t = TaggedHandle<Tag_t, Key_t, Value_t>;
-  using LRUCache_t = LRUCache<Key_t, TaggedValue_t, Hash>;
+  using LRUCache_t = LRUCache<Key_t, TaggedValue_t, Hash, Table, Alloc>;
 
-  SharedCache() : pool_(nullptr), table_(), tenant_cache_map_(){};
-  ~SharedCache() { delete[] pool_; };
+  SharedCache()
+      : pool_(nullptr), pool_size_(0), table_(), tenant_cache_map_(){};
+  ~SharedCache() { Alloc::deallocate(pool_, pool_size_); };
   SharedCache(const SharedCache&) = delete;
   SharedCache(SharedCache&&) = delete;
   SharedCache& operator=(const SharedCache&) = delete;
@@ -91,6 +113,13 @@ class SharedCache {
   size_t capacity_of(Tag_t tag) const;
   // Return the current cache size associated with the given tag
   size_t size_of(Tag_t tag) const;
+  // Return the budget and usage of the given tag if Value_t is charged (see
+  // LRUCache::insert_charged)
+  size_t budget_of(Tag_t tag) const { return get_cache(tag).budget(); }
+  size_t usage_of(Tag_t tag) const { return get_cache(tag).usage(); }
+  void set_budget(Tag_t tag, size_t budget) {
+    get_cache_mutable(tag).set_budget(budget);
+  }
 
   // For each item in the cache, call fn(key, handle)
   template <typename Fn>
@@ -103,6 +132,10 @@ class SharedCache {
   // return the existing one
   Handle_t insert(Tag_t tag, Key_t key, bool pin = false,
                   bool hint_nonexist = false);
+  // Same as LRUCache::insert_charged; if the key exists, its charge is updated
+  // on behalf of the tenant that owns it.
+  Handle_t insert_charged(Tag_t tag, Key_t key, uint32_t charge,
+                          bool pin = false, bool hint_nonexist = false);
   // Search for a handle; return nullptr if not exist; no tag required because
   // there is no insertion may happen
   // FIXME: However, this op will refresh LRU list, so a tenant A could
@@ -113,12 +146,22 @@ class SharedCache {
   void release(Handle_t handle);
   // Pin a handle returned by insert/lookup
   void pin(Handle_t handle);
+  // Batched insert/lookup with prefetching; see LRUCache for details. All keys
+  // in insert_batch are inserted on behalf of the same tenant.
+  void insert_batch(Tag_t tag, const Key_t* keys, size_t n, Handle_t* handles,
+                    bool pin = false, bool hint_nonexist = false);
+  void lookup_batch(const Key_t* keys, size_t n, Handle_t* handles,
+                    bool pin = false);
   // `touch` is not implemented yet because it is mostly used on GhostCache and
   // it is unclear whether it is useful in the real cache
 
   // Relocate some handles (i.e. cache slots) from src to dst; the relocation
   // may be terminated early if src does not have enough available handles to
-  // return; return number of handles relocated successfully
+  // return; return number of handles relocated successfully.
+  // If Value_t is charged, `size` is instead in the unit of charges (e.g.,
+  // bytes): it is moved from src's budget to dst's, and src's handles are
+  // moved along in proportion, so both keep their handles per charge. src
+  // must have a budget set; return the budget relocated.
   size_t relocate(Tag_t src, Tag_t dst, size_t size);
 
   // Similar to LRUCache erase/install
@@ -128,14 +171,30 @@ class SharedCache {
   // Return a read-only access to the LRU cache associated with the tag
   const LRUCache_t& get_cache(Tag_t tag) const;
 
+  // Save each tenant's tag, capacity, and keys (as LRUCache::save does) to a
+  // binary snapshot file; tags are saved as raw bytes, so they must stay
+  // valid across restarts (e.g., integers). Return whether succeeds.
+  bool save(const std::string& path) const;
+  // Load a snapshot into an empty SharedCache initialized with the same tags
+  // and total capacity: slots are relocated first so that each tenant gets
+  // back its saved capacity, and then each tenant's keys are loaded as
+  // LRUCache::load does. Return whether succeeds; on failure, the cache may
+  // be partially loaded.
+  bool load(const std::string& path);
+
  private:
   Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  Node_t* insert_impl(Tag_t tag, Key_t key, uint32_t hash, bool pin,
+                      bool hint_nonexist);
 
   LRUCache_t& get_cache_mutable(Tag_t tag);
+  // Move up to `size` handles from src to dst; return the number moved
+  size_t relocate_nodes(Tag_t src, Tag_t dst, size_t size);
 
   Node_t* pool_;
+  size_t pool_size_;
   size_t total_capacity_;
-  NodeTable<Key_t, TaggedValue_t> table_;
+  Table<Key_t, TaggedValue_t, Alloc> table_;
 
   // Map each tenant's tag to its own cache; must be const after `init`
   std::unordered_map<Tag_t, LRUCache_t> tenant_cache_map_;
@@ -147,15 +206,17 @@ class SharedCache {
   }
 };
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-void SharedCache<Tag_t, Key_t, Value_t, Hash>::init(
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+void SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::init(
     const std::vector<std::pair<Tag_t, size_t>>& tenant_configs) {
   total_capacity_ = 0;
   size_t begin_idx = 0;
   for (auto [tag, capacity] : tenant_configs) total_capacity_ += capacity;
 
   table_.init(total_capacity_);
-  pool_ = new Node_t[total_capacity_];
+  pool_ = Alloc::template allocate<Node_t>(total_capacity_);
+  pool_size_ = total_capacity_;
   for (auto [tag, capacity] : tenant_configs) {
     auto [it, is_emplaced] = tenant_cache_map_.emplace(
         std::piecewise_construct, std::forward_as_tuple(tag),
@@ -167,9 +228,10 @@ void SharedCache<Tag_t, Key_t, Value_t, Hash>::init(
   assert(begin_idx == total_capacity_);
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void SharedCache<Tag_t, Key_t, Value_t, Hash>::init(
+inline void SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::init(
     const std::vector<std::pair<Tag_t, size_t>>& tenant_configs, Fn&& fn) {
   init(tenant_configs);
   for (size_t i = 0; i < total_capacity_; ++i) {
@@ -177,31 +239,47 @@ inline void SharedCache<Tag_t, Key_t, Value_t, Hash>::init(
   }
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-size_t SharedCache<Tag_t, Key_t, Value_t, Hash>::capacity_of(Tag_t tag) const {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+size_t SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::capacity_of(
+    Tag_t tag) const {
   assert(tenant_cache_map_.contains(tag));
   return get_cache(tag).capacity();
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-size_t SharedCache<Tag_t, Key_t, Value_t, Hash>::size_of(Tag_t tag) const {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+size_t SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::size_of(
+    Tag_t tag) const {
   assert(tenant_cache_map_.contains(tag));
   return get_cache(tag).size();
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
 template <typename Fn>
-inline void SharedCache<Tag_t, Key_t, Value_t, Hash>::for_each(Fn&& fn) {
+inline void SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::for_each(
+    Fn&& fn) {
   for (auto& [tag, cache] : tenant_cache_map_) {
     cache.for_each(fn);
   }
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline typename SharedCache<Tag_t, Key_t, Value_t, Hash>::Handle_t
-SharedCache<Tag_t, Key_t, Value_t, Hash>::insert(Tag_t tag, Key_t key, bool pin,
-                                                 bool hint_nonexist) {
-  uint32_t hash = Hash{}(key);
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Handle_t
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::insert(
+    Tag_t tag, Key_t key, bool pin, bool hint_nonexist) {
+  return insert_impl(tag, key, Hash{}(key), pin, hint_nonexist);
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Node_t*
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Tag_t tag, Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
   assert(tenant_cache_map_.contains(tag));
 
   Node_t* e;
@@ -215,21 +293,76 @@ SharedCache<Tag_t, Key_t, Value_t, Hash>::insert(Tag_t tag, Key_t key, bool pin,
   // The key does not exist in the cache, perform insertion
   e = get_cache_mutable(tag).insert_impl(key, hash, pin, /*not_exist*/ true);
   if (!e) return nullptr;
-  Handle_t h(e);
-  h.set_tag(tag);
-  return h;
+  Handle_t(e).set_tag(tag);
+  return e;
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Handle_t
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::insert_charged(
+    Tag_t tag, Key_t key, uint32_t charge, bool pin, bool hint_nonexist) {
+  assert(tenant_cache_map_.contains(tag));
+  uint32_t hash = Hash{}(key);
+  Node_t* e = hint_nonexist ? nullptr : table_.lookup(key, hash);
+  if (e) tag = Handle_t(e).get_tag();
+  e = get_cache_mutable(tag).insert_charged_impl(key, hash, charge, pin,
+                                                 /*hint_nonexist*/ !e);
+  if (!e) return nullptr;
+  Handle_t(e).set_tag(tag);
+  return e;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline typename SharedCache<Tag_t, Key_t, Value_t, Hash>::Handle_t
-SharedCache<Tag_t, Key_t, Value_t, Hash>::lookup(Key_t key, bool pin) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::insert_batch(
+    Tag_t tag, const Key_t* keys, size_t n, Handle_t* handles, bool pin,
+    bool hint_nonexist) {
+  constexpr size_t kBatch = LRUCache_t::kPrefetchBatch;
+  uint32_t hashes[kBatch];
+  for (size_t i = 0; i < n; i += kBatch) {
+    size_t m = std::min(n - i, kBatch);
+    for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(keys[i + j]);
+    LRUCache_t::prefetch_impl(&table_, hashes, m);
+    for (size_t j = 0; j < m; ++j)
+      handles[i + j] = Handle_t(
+          insert_impl(tag, keys[i + j], hashes[j], pin, hint_nonexist));
+  }
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::lookup_batch(
+    const Key_t* keys, size_t n, Handle_t* handles, bool pin) {
+  constexpr size_t kBatch = LRUCache_t::kPrefetchBatch;
+  uint32_t hashes[kBatch];
+  for (size_t i = 0; i < n; i += kBatch) {
+    size_t m = std::min(n - i, kBatch);
+    for (size_t j = 0; j < m; ++j) hashes[j] = Hash{}(keys[i + j]);
+    LRUCache_t::prefetch_impl(&table_, hashes, m);
+    for (size_t j = 0; j < m; ++j)
+      handles[i + j] = Handle_t(lookup_impl(keys[i + j], hashes[j], pin));
+  }
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Handle_t
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::lookup(Key_t key,
+                                                               bool pin) {
   return lookup_impl(key, Hash{}(key), pin);
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline typename SharedCache<Tag_t, Key_t, Value_t, Hash>::Node_t*
-SharedCache<Tag_t, Key_t, Value_t, Hash>::lookup_impl(Key_t key, uint32_t hash,
-                                                      bool pin) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Node_t*
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(
+    Key_t key, uint32_t hash, bool pin) {
   Node_t* e = table_.lookup(key, hash);
   if (!e) return nullptr;
 
@@ -239,30 +372,59 @@ SharedCache<Tag_t, Key_t, Value_t, Hash>::lookup_impl(Key_t key, uint32_t hash,
   return e;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline void SharedCache<Tag_t, Key_t, Value_t, Hash>::release(Handle_t handle) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::release(
+    Handle_t handle) {
   Tag_t tag = handle.get_tag();
   assert(tenant_cache_map_.contains(tag));
   get_cache_mutable(tag).release(handle.untagged());
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline void SharedCache<Tag_t, Key_t, Value_t, Hash>::pin(
-    typename SharedCache<Tag_t, Key_t, Value_t, Hash>::Handle_t handle) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::pin(
+    typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+        handle) {
   Tag_t tag = handle.get_tag();
   assert(tenant_cache_map_.contains(tag));
   get_cache_mutable(tag).pin(handle.untagged());
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline size_t SharedCache<Tag_t, Key_t, Value_t, Hash>::relocate(Tag_t src,
-                                                                 Tag_t dst,
-                                                                 size_t size) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::relocate(
+    Tag_t src, Tag_t dst, size_t size) {
   assert(tenant_cache_map_.contains(src));
   assert(tenant_cache_map_.contains(dst));
 
-  auto& src_cache = tenant_cache_map_[src];
-  auto& dst_cache = tenant_cache_map_[dst];
+  if constexpr (LRUCache_t::kCharged) {
+    auto& src_cache = get_cache_mutable(src);
+    auto& dst_cache = get_cache_mutable(dst);
+    size_t src_budget = src_cache.budget();
+    assert(src_budget != LRUCache_t::kUnlimited);
+    size = std::min(size, src_budget);
+    if (size == 0) return 0;
+    src_cache.set_budget(src_budget - size);
+    relocate_nodes(src, dst,
+                   static_cast<size_t>(
+                       static_cast<double>(src_cache.capacity()) * size /
+                       src_budget));
+    if (dst_cache.budget() != LRUCache_t::kUnlimited)
+      dst_cache.set_budget(dst_cache.budget() + size);
+    return size;
+  } else {
+    return relocate_nodes(src, dst, size);
+  }
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::relocate_nodes(
+    Tag_t src, Tag_t dst, size_t size) {
+  auto& src_cache = get_cache_mutable(src);
+  auto& dst_cache = get_cache_mutable(dst);
   size_t n = 0;
   for (; n < size; ++n) {
     auto e = src_cache.preempt();
@@ -272,17 +434,22 @@ inline size_t SharedCache<Tag_t, Key_t, Value_t, Hash>::relocate(Tag_t src,
   return n;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline bool SharedCache<Tag_t, Key_t, Value_t, Hash>::erase(Handle_t handle) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::erase(
+    Handle_t handle) {
   assert(tenant_cache_map_.contains(handle.get_tag()));
   bool is_erased = tenant_cache_map_[handle.get_tag()].erase(handle.untagged());
   if (is_erased) --total_capacity_;
   return is_erased;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline typename SharedCache<Tag_t, Key_t, Value_t, Hash>::Handle_t
-SharedCache<Tag_t, Key_t, Value_t, Hash>::install(Tag_t tag, Key_t key) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::Handle_t
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::install(Tag_t tag,
+                                                                Key_t key) {
   assert(tenant_cache_map_.contains(tag));
   Node_t* e = get_cache_mutable(tag).install_impl(key);
   Handle_t h(e);
@@ -291,22 +458,100 @@ SharedCache<Tag_t, Key_t, Value_t, Hash>::install(Tag_t tag, Key_t key) {
   return h;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline const typename SharedCache<Tag_t, Key_t, Value_t, Hash>::LRUCache_t&
-SharedCache<Tag_t, Key_t, Value_t, Hash>::get_cache(Tag_t tag) const {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline const typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                                  Alloc>::LRUCache_t&
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::get_cache(
+    Tag_t tag) const {
   assert(tenant_cache_map_.contains(tag));
   return tenant_cache_map_.find(tag)->second;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline typename SharedCache<Tag_t, Key_t, Value_t, Hash>::LRUCache_t&
-SharedCache<Tag_t, Key_t, Value_t, Hash>::get_cache_mutable(Tag_t tag) {
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SharedCache<Tag_t, Key_t, Value_t, Hash, Table,
+                            Alloc>::LRUCache_t&
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::get_cache_mutable(
+    Tag_t tag) {
   assert(tenant_cache_map_.contains(tag));
   return tenant_cache_map_.find(tag)->second;
 }
 
-template <typename Tag_t, typename Key_t, typename Value_t, typename Hash>
-inline std::ostream& SharedCache<Tag_t, Key_t, Value_t, Hash>::print(
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::save(
+    const std::string& path) const {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) return false;
+  SnapshotHeader header{kSnapshotShared, kSnapshotVersion, sizeof(Key_t),
+                        sizeof(Tag_t), tenant_cache_map_.size()};
+  snapshot_write(os, &header);
+  for (auto& [tag, cache] : tenant_cache_map_) {
+    uint64_t capacity = cache.capacity();
+    uint64_t size = cache.size();
+    snapshot_write(os, &tag);
+    snapshot_write(os, &capacity);
+    snapshot_write(os, &size);
+  }
+  for (auto& [tag, cache] : tenant_cache_map_) cache.save_keys(os);
+  return static_cast<bool>(os.flush());
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::load(
+    const std::string& path) {
+  std::ifstream is(path, std::ios::binary);
+  SnapshotHeader header;
+  if (!is || !snapshot_read_header(is, header, kSnapshotShared, sizeof(Key_t),
+                                   sizeof(Tag_t)) ||
+      header.count != tenant_cache_map_.size())
+    return false;
+
+  struct Tenant {
+    Tag_t tag;
+    uint64_t capacity;
+    uint64_t size;
+  };
+  std::vector<Tenant> tenants(header.count);
+  uint64_t total_capacity = 0;
+  for (auto& t : tenants) {
+    if (!snapshot_read(is, &t.tag) || !snapshot_read(is, &t.capacity) ||
+        !snapshot_read(is, &t.size))
+      return false;
+    auto it = tenant_cache_map_.find(t.tag);
+    if (it == tenant_cache_map_.end() || it->second.size() > 0) return false;
+    total_capacity += t.capacity;
+  }
+  if (total_capacity != total_capacity_) return false;
+
+  // All caches are empty, so relocation only moves slots from free lists
+  for (auto& dst : tenants) {
+    for (auto& src : tenants) {
+      size_t dst_capacity = capacity_of(dst.tag);
+      if (dst_capacity >= dst.capacity) break;
+      size_t src_capacity = capacity_of(src.tag);
+      if (src_capacity <= src.capacity) continue;
+      relocate_nodes(src.tag, dst.tag,
+                     std::min<size_t>(src_capacity - src.capacity,
+                                      dst.capacity - dst_capacity));
+    }
+  }
+
+  for (auto& t : tenants) {
+    Tag_t tag = t.tag;
+    if (!get_cache_mutable(tag).load_keys(
+            is, t.size, [tag](Node_t* e) { Handle_t(e).set_tag(tag); }))
+      return false;
+  }
+  return true;
+}
+
+template <typename Tag_t, typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream&
+SharedCache<Tag_t, Key_t, Value_t, Hash, Table, Alloc>::print(
     std::ostream& os, int indent) const {
   os << "Tenant Cache Map {" << std::endl;
   for (auto& [tag, cache] : tenant_cache_map_) {
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "arena.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// SieveCache is a drop-in replacement of LRUCache with the SIEVE policy, on
+// the same node pool and table. Nodes are kept in a single FIFO queue in the
+// order of insertion, and never move within it. A hit only sets the node's
+// visited bit; on eviction, a hand moves from the oldest node towards the
+// newest one (and wraps around), clearing visited bits and skipping pinned
+// nodes, until it finds a node that is neither visited nor pinned. The hand
+// stays there for the next eviction, so nodes that survive a sweep are not
+// examined again until the hand comes back.
+//
+// The visited bit is the most significant bit of the node's reference count,
+// so a hit is a single atomic OR on a field that a lookup reads anyway, and
+// pinning/releasing still work with atomic increments/decrements. Lookups are
+// read-only to the cache structure, so ShardedLRUCache allows them to run
+// concurrently under a shared lock (see kConcurrentLookup).
+//
+// It provides the same init/insert/lookup/pin/release/erase/install APIs as
+// LRUCache, but not the LRU-specific ones (e.g. for_each_lru).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class SieveCache {
+ public:
+  using Node_t = LRUNode<Key_t, Value_t>;
+  using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Lookup only reads the table, and sets the visited bit and pins the node
+  // with atomics.
+  static constexpr bool kConcurrentLookup = true;
+
+  SieveCache();
+  ~SieveCache() { Alloc::deallocate(pool_, pool_size_); }
+  SieveCache(const SieveCache&) = delete;
+  SieveCache(SieveCache&&) = delete;
+  SieveCache& operator=(const SieveCache&) = delete;
+  SieveCache& operator=(SieveCache&&) = delete;
+
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+  // For each item in the cache, call fn(handle) from the oldest to the newest
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (auto h = queue_.next; h != &queue_; h = h->next) fn(h);
+  }
+
+  // Same semantics as LRUCache, except that a hit sets the visited bit
+  // instead of refreshing LRU.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) {
+    [[maybe_unused]] uint32_t refs = handle.node->release();
+    assert(pin_count(refs) > 1);
+  }
+  void pin(Handle_t handle) {
+    handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Same semantics as LRUCache: erase an unpinned node out of circulation,
+  // which decrements the capacity; install a node with additional space or
+  // reused space from erased ones, which increments the capacity.
+  bool erase(Handle_t handle);
+  Handle_t install(Key_t key);
+
+ private:
+  static constexpr uint32_t kVisited = uint32_t{1} << 31;
+
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  // Move the hand to find a victim; return nullptr if all are pinned.
+  Node_t* evict();
+
+  static uint32_t pin_count(uint32_t refs) { return refs & ~kVisited; }
+
+  // Number of nodes in queue_ (i.e. in table_).
+  size_t size_;
+  size_t capacity_;
+  Node_t* pool_;
+  // Number of nodes in pool_; capacity_ may drift from it due to erase/install
+  size_t pool_size_;
+  Table_t table_;
+
+  // Dummy head of the FIFO queue.
+  // queue.prev is the newest entry, queue.next is the oldest entry.
+  Node_t queue_;
+  // The next node to examine on eviction; nullptr means the oldest one.
+  Node_t* hand_;
+
+  // Dummy head of free list.
+  Node_t free_;
+
+  // Dummy head of erased list; see LRUCache.
+  Node_t erased_;
+  // Pool for additionally allocated nodes by install; see LRUCache.
+  ChunkedArena<Node_t> extra_pool_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const SieveCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline SieveCache<Key_t, Value_t, Hash, Table, Alloc>::SieveCache()
+    : size_(0),
+      capacity_(0),
+      pool_(nullptr),
+      pool_size_(0),
+      table_(),
+      hand_(nullptr) {
+  queue_.next = &queue_;
+  queue_.prev = &queue_;
+  free_.next = &free_;
+  free_.prev = &free_;
+  erased_.next = &erased_;
+  erased_.prev = &erased_;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void SieveCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  assert(!capacity_ && !pool_);
+  assert(capacity);
+  capacity_ = capacity;
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  pool_size_ = capacity;
+  for (size_t i = 0; i < capacity; ++i) Node_t::list_append(&free_, &pool_[i]);
+  table_.init(capacity);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void SieveCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  init(capacity);
+  for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SieveCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SieveCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+  assert(capacity_ > 0);
+  Node_t* e;
+  if (!hint_nonexist) {
+    e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  if (free_.next != &free_) {
+    e = free_.next;
+    Node_t::list_remove(e);
+  } else {
+    e = evict();
+    if (!e) return nullptr;
+  }
+  e->init(key, hash);  // also clears the visited bit
+  table_.insert(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  Node_t::list_append(&queue_, e);
+  ++size_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SieveCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SieveCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(Key_t key,
+                                                            uint32_t hash,
+                                                            bool pin) {
+  Node_t* e = table_.lookup(key, hash);
+  if (!e) return nullptr;
+  // skip the write if the bit is already set, so a hot node's cache line is
+  // not bounced between cores
+  if (!(e->refs.load(std::memory_order_relaxed) & kVisited))
+    e->refs.fetch_or(kVisited, std::memory_order_relaxed);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline bool SieveCache<Key_t, Value_t, Hash, Table, Alloc>::erase(
+    Handle_t handle) {
+  Node_t* e = handle.node;
+  assert(e);
+  if (pin_count(e->refs.load(std::memory_order_acquire)) != 1) return false;
+  if (hand_ == e) hand_ = e->next == &queue_ ? nullptr : e->next;
+  Node_t::list_remove(e);
+  Node_t::list_append(&erased_, e);
+  e->refs.store(0, std::memory_order_relaxed);  // to detect double-erase
+  [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+  assert(e_ == e);
+  --size_;
+  --capacity_;
+  return true;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SieveCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+SieveCache<Key_t, Value_t, Hash, Table, Alloc>::install(Key_t key) {
+  Node_t* e;
+  if (erased_.next == &erased_) {
+    e = extra_pool_.alloc();  // caller is responsible for setting the value
+  } else {
+    e = erased_.next;
+    Node_t::list_remove(e);
+  }
+  e->init(key, Hash{}(key));
+  table_.insert(e);
+  Node_t::list_append(&queue_, e);
+  ++size_;
+  ++capacity_;
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SieveCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SieveCache<Key_t, Value_t, Hash, Table, Alloc>::evict() {
+  if (queue_.next == &queue_) return nullptr;
+  Node_t* e = hand_ ? hand_ : queue_.next;
+  // in two rounds, all visited bits are cleared, so any unpinned node must
+  // have been found
+  for (size_t i = 0; i < 2 * size_; ++i) {
+    Node_t* next = e->next == &queue_ ? queue_.next : e->next;
+    uint32_t refs = e->refs.load(std::memory_order_acquire);
+    if (refs & kVisited) {
+      e->refs.fetch_and(~kVisited, std::memory_order_relaxed);
+    } else if (refs == 1) {  // neither visited nor pinned
+      hand_ = e->next == &queue_ ? nullptr : e->next;
+      Node_t::list_remove(e);
+      [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+      assert(e_ == e);
+      --size_;
+      return e;
+    }
+    e = next;
+  }
+  hand_ = e;
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& SieveCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "SieveCache (capacity=" << capacity_ << ", hand=";
+  if (hand_)
+    os << hand_->key;
+  else
+    os << "oldest";
+  os << ") {\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "queue: [";
+  for (const Node_t* e = queue_.next; e != &queue_; e = e->next) {
+    if (e != queue_.next) os << ", ";
+    os << e->key;
+    uint32_t refs = e->refs.load();
+    if (refs & kVisited) os << '*';
+    if (pin_count(refs) > 1) os << " (pinned)";
+  }
+  os << "]\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "alloc.h"
+#include "hash.h"
+
+namespace gcache {
+
+// FrequencySketch is a count-min sketch of 4-bit counters that estimates how
+// many times a hash has been seen recently, saturating at 15. It is blocked:
+// a hash selects one 64-byte block of 8 words, and its 4 counters are taken
+// from 4 different words of that block, so an increment or an estimate only
+// touches a single cache line. The estimate is the minimum of the 4 counters.
+//
+// To forget the past, all counters are halved once the number of increments
+// reaches 10 times the capacity (aging).
+template <typename Alloc = HeapAlloc>
+class FrequencySketch {
+ public:
+  static constexpr uint32_t kMaxCount = 15;
+
+  FrequencySketch()
+      : blocks_(nullptr), num_blocks_(0), sample_size_(0), num_samples_(0) {}
+  ~FrequencySketch() { Alloc::deallocate(blocks_, num_blocks_); }
+  FrequencySketch(const FrequencySketch&) = delete;
+  FrequencySketch(FrequencySketch&&) = delete;
+  FrequencySketch& operator=(const FrequencySketch&) = delete;
+  FrequencySketch& operator=(FrequencySketch&&) = delete;
+
+  // Size the sketch for `capacity` distinct hashes, i.e., 16 counters each.
+  void init(size_t capacity);
+
+  void increment(uint32_t hash);
+  [[nodiscard]] uint32_t estimate(uint32_t hash) const;
+
+  [[nodiscard]] size_t sample_size() const { return sample_size_; }
+
+ private:
+  struct alignas(64) Block {
+    uint64_t words[8];
+  };
+
+  // Mix the 32-bit hash into 64 bits: the low bits select the block and the
+  // high 32 bits select the counters within it.
+  static uint64_t mix(uint32_t hash) { return murmurhash_u64(hash); }
+  // The i-th counter (i < 4) is in word 2i or 2i+1; return the word index and
+  // the bit offset of the counter within the word.
+  static uint32_t word_of(uint64_t h, uint32_t i) {
+    return (i << 1) | ((h >> (32 + i * 8)) & 1);
+  }
+  static uint32_t shift_of(uint64_t h, uint32_t i) {
+    return ((h >> (33 + i * 8)) & 15) << 2;
+  }
+  Block& block_of(uint64_t h) const { return blocks_[h & (num_blocks_ - 1)]; }
+
+  // Halve all counters.
+  void age();
+
+  Block* blocks_;
+  size_t num_blocks_;  // must be 2^n
+  size_t sample_size_;
+  size_t num_samples_;
+};
+
+template <typename Alloc>
+inline void FrequencySketch<Alloc>::init(size_t capacity) {
+  assert(!blocks_);
+  assert(capacity);
+  // 16 counters per hash, i.e., one word; 8 words per block
+  num_blocks_ = std::max<size_t>(std::bit_ceil(capacity) / 8, 1);
+  blocks_ = Alloc::template allocate<Block>(num_blocks_);
+  for (size_t i = 0; i < num_blocks_; ++i)
+    for (auto& w : blocks_[i].words) w = 0;
+  sample_size_ = 10 * capacity;
+  num_samples_ = 0;
+}
+
+template <typename Alloc>
+inline void FrequencySketch<Alloc>::increment(uint32_t hash) {
+  uint64_t h = mix(hash);
+  Block& b = block_of(h);
+  bool added = false;
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint64_t& w = b.words[word_of(h, i)];
+    uint32_t shift = shift_of(h, i);
+    if (((w >> shift) & 15) < kMaxCount) {
+      w += uint64_t{1} << shift;
+      added = true;
+    }
+  }
+  if (added && ++num_samples_ >= sample_size_) age();
+}
+
+template <typename Alloc>
+inline uint32_t FrequencySketch<Alloc>::estimate(uint32_t hash) const {
+  uint64_t h = mix(hash);
+  const Block& b = block_of(h);
+  uint32_t count = kMaxCount;
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint32_t c = (b.words[word_of(h, i)] >> shift_of(h, i)) & 15;
+    count = std::min(count, c);
+  }
+  return count;
+}
+
+template <typename Alloc>
+inline void FrequencySketch<Alloc>::age() {
+  for (size_t i = 0; i < num_blocks_; ++i)
+    for (auto& w : blocks_[i].words) w = (w >> 1) & 0x7777777777777777ULL;
+  num_samples_ /= 2;
+}
+
+}  // namespace gcache
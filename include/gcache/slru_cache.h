@@ -0,0 +1,399 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// SLRUSegments is the segmented LRU of SLRUCache on a node pool owned by the
+// cache; TinyLFUCache reuses it as its main segments. It keeps the probation,
+// protected and in-use lists, and one byte per node for the list it is in.
+template <typename Node_t, typename Alloc = HeapAlloc>
+class SLRUSegments {
+ public:
+  // kWindow is not used here, but by TinyLFUCache for its window.
+  enum Segment : uint8_t { kProbation, kProtected, kInUse, kWindow };
+
+  SLRUSegments();
+  ~SLRUSegments() { Alloc::deallocate(segments_, capacity_); }
+  SLRUSegments(const SLRUSegments&) = delete;
+  SLRUSegments(SLRUSegments&&) = delete;
+  SLRUSegments& operator=(const SLRUSegments&) = delete;
+  SLRUSegments& operator=(SLRUSegments&&) = delete;
+
+  // Track the nodes in pool[0, capacity), of which protected holds at most
+  // protected_capacity.
+  void init(Node_t* pool, size_t capacity, size_t protected_capacity);
+
+  size_t protected_size() const { return protected_size_; }
+  size_t protected_capacity() const { return protected_capacity_; }
+  Segment& segment_of(const Node_t* e) { return segments_[e - pool_]; }
+
+  // Append e, which is in no list, to the MRU end of probation.
+  void insert(Node_t* e);
+  // Move e from any list to the MRU end of protected, and demote protected's
+  // LRU nodes to probation until it fits.
+  void hit(Node_t* e);
+  // Append e, which is in no list and pinned, to in-use.
+  void park(Node_t* e);
+  // Remove probation's LRU unpinned node, or protected's if there is none, and
+  // return it; pinned ones are parked. Return nullptr if all are pinned.
+  Node_t* pop_victim();
+  // Put a node returned by pop_victim back as the LRU node of its list.
+  void push_victim(Node_t* e);
+  // Move the released nodes in in-use back to probation; return whether any.
+  bool reclaim_in_use();
+
+  // Print the lists, one per line.
+  std::ostream& print(std::ostream& os, int indent) const;
+
+ private:
+  // Remove list's LRU unpinned node and return it; pinned ones are parked.
+  // Return nullptr if there is none.
+  Node_t* pop_unpinned(Node_t* list);
+
+  size_t capacity_;
+  size_t protected_capacity_;
+  // Number of nodes in the protected_ list.
+  size_t protected_size_;
+  Node_t* pool_;
+  // One byte per node in pool_: the list it is in.
+  Segment* segments_;
+
+  // Dummy heads of the lists; list.prev is the newest entry, list.next is the
+  // oldest entry.
+  Node_t probation_;
+  Node_t protected_;
+  // Entries were found pinned by eviction; some may have been released since
+  // then (refs == 1) and are moved back by reclaim_in_use().
+  Node_t in_use_;
+};
+
+// SLRUCache is a drop-in replacement of LRUCache with the segmented LRU policy,
+// on the same node pool and table. The LRU list is split into two segments:
+// - probation: a newly inserted node enters at its MRU end, i.e., the midpoint
+//   of the whole order, instead of the MRU end of the cache;
+// - protected: a node is promoted here only when it is referenced again; if
+//   the segment exceeds its capacity, its LRU node is demoted to the MRU end
+//   of probation.
+// Eviction takes probation's LRU node, and only falls back to protected when
+// probation is empty. Thus a large sequential scan, whose blocks are never
+// re-referenced, only churns probation and cannot flush the working set out
+// of protected.
+//
+// The protected segment holds at most `protected_ratio` of the capacity. A
+// ratio of 0 degenerates to LRU; the larger it is, the less a scan can evict,
+// but the less room a new block has to prove itself before being evicted.
+//
+// As in LRUCache, a pinned node stays in its segment until eviction moves it
+// aside to the in-use list, and release is a single atomic decrement. A node
+// released since then returns to probation's MRU end at the next eviction,
+// and a hit promotes it.
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but
+// not the LRU-specific ones (e.g. for_each_lru, erase/install).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class SLRUCache {
+ public:
+  using Node_t = LRUNode<Key_t, Value_t>;
+  using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Every lookup moves the node in or between segments.
+  static constexpr bool kConcurrentLookup = false;
+
+  explicit SLRUCache(double protected_ratio = 0.8);
+  ~SLRUCache() { Alloc::deallocate(pool_, capacity_); }
+  SLRUCache(const SLRUCache&) = delete;
+  SLRUCache(SLRUCache&&) = delete;
+  SLRUCache& operator=(const SLRUCache&) = delete;
+  SLRUCache& operator=(SLRUCache&&) = delete;
+
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t protected_size() const { return segments_.protected_size(); }
+  size_t protected_capacity() const { return segments_.protected_capacity(); }
+
+  // For each item in the cache, call fn(handle)
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < size_; ++i) fn(&pool_[i]);
+  }
+
+  // Same semantics as LRUCache, except that a new node enters probation and a
+  // hit promotes it to protected.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { handle.node->release(); }
+  void pin(Handle_t handle) {
+    handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  // Remove a victim from the table; return nullptr if all are pinned.
+  Node_t* evict();
+
+  // Number of nodes in use; nodes in pool_[size_, capacity_) are free.
+  size_t size_;
+  size_t capacity_;
+  double protected_ratio_;
+  Node_t* pool_;
+  SLRUSegments<Node_t, Alloc> segments_;
+  Table_t table_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const SLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Node_t, typename Alloc>
+inline SLRUSegments<Node_t, Alloc>::SLRUSegments()
+    : capacity_(0),
+      protected_capacity_(0),
+      protected_size_(0),
+      pool_(nullptr),
+      segments_(nullptr) {
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
+  protected_.next = &protected_;
+  protected_.prev = &protected_;
+  in_use_.next = &in_use_;
+  in_use_.prev = &in_use_;
+}
+
+template <typename Node_t, typename Alloc>
+inline void SLRUSegments<Node_t, Alloc>::init(Node_t* pool, size_t capacity,
+                                              size_t protected_capacity) {
+  assert(!segments_);
+  capacity_ = capacity;
+  protected_capacity_ = protected_capacity;
+  pool_ = pool;
+  segments_ = Alloc::template allocate<Segment>(capacity);
+}
+
+template <typename Node_t, typename Alloc>
+inline void SLRUSegments<Node_t, Alloc>::insert(Node_t* e) {
+  segment_of(e) = kProbation;
+  Node_t::list_append(&probation_, e);
+}
+
+template <typename Node_t, typename Alloc>
+inline void SLRUSegments<Node_t, Alloc>::hit(Node_t* e) {
+  Node_t::list_remove(e);
+  if (segment_of(e) == kProtected) {
+    Node_t::list_append(&protected_, e);
+    return;
+  }
+  // a re-reference in probation (or in-use) earns a promotion
+  segment_of(e) = kProtected;
+  Node_t::list_append(&protected_, e);
+  ++protected_size_;
+  while (protected_size_ > protected_capacity_) {
+    Node_t* d = protected_.next;
+    Node_t::list_remove(d);
+    --protected_size_;
+    segment_of(d) = kProbation;
+    Node_t::list_append(&probation_, d);
+  }
+}
+
+template <typename Node_t, typename Alloc>
+inline void SLRUSegments<Node_t, Alloc>::park(Node_t* e) {
+  segment_of(e) = kInUse;
+  Node_t::list_append(&in_use_, e);
+}
+
+template <typename Node_t, typename Alloc>
+inline Node_t* SLRUSegments<Node_t, Alloc>::pop_victim() {
+  Node_t* e = pop_unpinned(&probation_);
+  return e ? e : pop_unpinned(&protected_);
+}
+
+template <typename Node_t, typename Alloc>
+inline void SLRUSegments<Node_t, Alloc>::push_victim(Node_t* e) {
+  Node_t* list = &probation_;
+  if (segment_of(e) == kProtected) {
+    list = &protected_;
+    ++protected_size_;
+  }
+  Node_t::list_append(list->next, e);
+}
+
+template <typename Node_t, typename Alloc>
+inline Node_t* SLRUSegments<Node_t, Alloc>::pop_unpinned(Node_t* list) {
+  while (list->next != list) {
+    Node_t* e = list->next;
+    Node_t::list_remove(e);
+    if (list == &protected_) --protected_size_;
+    if (e->refs.load(std::memory_order_acquire) > 1) {
+      park(e);
+      continue;
+    }
+    return e;
+  }
+  return nullptr;
+}
+
+template <typename Node_t, typename Alloc>
+inline bool SLRUSegments<Node_t, Alloc>::reclaim_in_use() {
+  bool reclaimed = false;
+  for (Node_t* e = in_use_.next; e != &in_use_;) {
+    Node_t* next = e->next;
+    if (e->refs.load(std::memory_order_relaxed) == 1) {
+      Node_t::list_remove(e);
+      insert(e);
+      reclaimed = true;
+    }
+    e = next;
+  }
+  return reclaimed;
+}
+
+template <typename Node_t, typename Alloc>
+inline std::ostream& SLRUSegments<Node_t, Alloc>::print(std::ostream& os,
+                                                        int indent) const {
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "probation: [";
+  probation_.print_list(os);
+  os << "]\n";
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "protected: [";
+  protected_.print_list(os);
+  os << "]\n";
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "in_use:    [";
+  in_use_.print_list(os);
+  os << "]\n";
+  return os;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::SLRUCache(
+    double protected_ratio)
+    : size_(0),
+      capacity_(0),
+      protected_ratio_(protected_ratio),
+      pool_(nullptr),
+      segments_(),
+      table_() {
+  assert(protected_ratio >= 0 && protected_ratio <= 1);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  assert(!capacity_ && !pool_);
+  assert(capacity);
+  capacity_ = capacity;
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  segments_.init(pool_, capacity,
+                 static_cast<size_t>(capacity * protected_ratio_));
+  table_.init(capacity);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  init(capacity);
+  for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+  assert(capacity_ > 0);
+  Node_t* e;
+  if (!hint_nonexist) {
+    e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  if (size_ < capacity_) {
+    e = &pool_[size_++];
+  } else {
+    e = evict();
+    if (!e) return nullptr;
+  }
+  e->init(key, hash);
+  table_.insert(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  segments_.insert(e);  // midpoint insertion
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(Key_t key,
+                                                           uint32_t hash,
+                                                           bool pin) {
+  Node_t* e = table_.lookup(key, hash);
+  if (!e) return nullptr;
+  segments_.hit(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::evict() {
+  segments_.reclaim_in_use();  // see LRUCache::evict_lru
+  do {
+    Node_t* e = segments_.pop_victim();
+    if (e) {
+      [[maybe_unused]] Node_t* e_ = table_.remove(e->key, e->hash);
+      assert(e_ == e);
+      return e;
+    }
+  } while (segments_.reclaim_in_use());
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& SLRUCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "SLRUCache (capacity=" << capacity_
+     << ", protected_capacity=" << protected_capacity() << ") {\n";
+  segments_.print(os, indent + 1);
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
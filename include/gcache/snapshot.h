@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+namespace gcache {
+
+// A snapshot file starts with a SnapshotHeader, followed by the records of the
+// class that saves it. All fields are in the host's byte order, so a snapshot
+// is meant to be loaded by the same build on the same kind of machine, e.g.,
+// to warm up a cache after a restart.
+struct SnapshotHeader {
+  uint32_t magic;      // identify the class that saves it
+  uint32_t version;    // bumped on any format change
+  uint32_t key_size;   // sizeof(Key_t)
+  uint32_t meta_size;  // size of per-node (or per-tenant) metadata; 0 if none
+  uint64_t count;      // number of nodes (or tenants for SharedCache)
+};
+
+// "GCLR", "GCSH", "GCGH" in little-endian
+constexpr uint32_t kSnapshotLRU = 0x524c4347;
+constexpr uint32_t kSnapshotShared = 0x48534347;
+constexpr uint32_t kSnapshotGhost = 0x48474347;
+constexpr uint32_t kSnapshotVersion = 2;
+
+template <typename T>
+inline void snapshot_write(std::ostream& os, const T* data, size_t n = 1) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  os.write(reinterpret_cast<const char*>(data), sizeof(T) * n);
+}
+
+// Return whether all n objects are read
+template <typename T>
+inline bool snapshot_read(std::istream& is, T* data, size_t n = 1) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  return static_cast<bool>(
+      is.read(reinterpret_cast<char*>(data), sizeof(T) * n));
+}
+
+// Read a header and check it against the expected magic, key and meta sizes
+inline bool snapshot_read_header(std::istream& is, SnapshotHeader& header,
+                                 uint32_t magic, uint32_t key_size,
+                                 uint32_t meta_size) {
+  return snapshot_read(is, &header) && header.magic == magic &&
+         header.version == kSnapshotVersion && header.key_size == key_size &&
+         header.meta_size == meta_size;
+}
+
+}  // namespace gcache
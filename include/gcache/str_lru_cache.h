@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+#include "alloc.h"
+#include "arena.h"
+#include "hash.h"
+#include "lru_cache.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+// StrKey is a 16-byte handle of a variable-length string key. The length and
+// the first 4 bytes (prefix) are always inline, so most mismatches are caught
+// by comparing the first 8 bytes. A string of at most kInlineSize bytes is
+// stored inline entirely; otherwise, the last 8 bytes store a pointer to the
+// whole string, which StrKey does not own.
+class StrKey {
+ public:
+  static constexpr uint32_t kInlineSize = 12;
+
+  StrKey() : len_(0), data_() {}
+  explicit StrKey(std::string_view s) : len_(s.size()), data_() {
+    assert(s.size() <= UINT32_MAX);
+    if (len_ <= kInlineSize) {
+      memcpy(data_, s.data(), len_);
+    } else {
+      memcpy(data_, s.data(), 4);
+      set_ptr(s.data());
+    }
+  }
+
+  uint32_t size() const { return len_; }
+  bool is_inline() const { return len_ <= kInlineSize; }
+  std::string_view view() const {
+    return {is_inline() ? data_ : get_ptr(), len_};
+  }
+
+  // Only valid for a non-inline key; the string must have the same content.
+  const char* get_ptr() const {
+    const char* p;
+    memcpy(&p, data_ + 4, sizeof(p));
+    return p;
+  }
+  void set_ptr(const char* p) { memcpy(data_ + 4, &p, sizeof(p)); }
+
+  bool operator==(const StrKey& other) const {
+    uint64_t a, b;  // length and prefix
+    memcpy(&a, this, 8);
+    memcpy(&b, &other, 8);
+    if (a != b) return false;
+    if (is_inline()) return memcmp(data_ + 4, other.data_ + 4, 8) == 0;
+    return memcmp(get_ptr() + 4, other.get_ptr() + 4, len_ - 4) == 0;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const StrKey& k) {
+    return os << k.view();
+  }
+
+ private:
+  uint32_t len_;
+  char data_[kInlineSize];  // zero-padded if inline
+};
+
+static_assert(sizeof(StrKey) == 16);
+
+template <typename Hash>
+struct StrKeyHash {
+  uint32_t operator()(const StrKey& k) const noexcept {
+    return Hash{}(k.view());
+  }
+};
+
+template <typename Value_t>
+struct StrValue {
+  // Buffer to store the key if it is not inline; owned by the node and kept
+  // when the node is reused, so it only grows.
+  char* buf = nullptr;
+  uint32_t buf_size = 0;
+  Value_t value;
+};
+
+template <typename Value_t>
+class StrHandle : public BaseHandle<LRUNode<StrKey, StrValue<Value_t>>> {
+ private:
+  using Node_t = LRUNode<StrKey, StrValue<Value_t>>;
+  using BaseHandle<Node_t>::node;  // otherwise `node` will be invisible
+
+ public:
+  StrHandle(Node_t* node) : BaseHandle<Node_t>(node) {}
+  StrHandle() = default;
+  StrHandle(const StrHandle&) = default;
+  StrHandle(StrHandle&&) noexcept = default;
+  StrHandle& operator=(const StrHandle&) = default;
+  StrHandle& operator=(StrHandle&&) noexcept = default;
+
+  // node->value is of type `StrValue`; to get the real value, must further
+  // access .value
+  Value_t* operator->() { return &node->value.value; }
+  const Value_t* operator->() const { return &node->value.value; }
+  Value_t& operator*() { return node->value.value; }
+  const Value_t& operator*() const { return node->value.value; }
+
+  // Valid until the node is evicted or erased.
+  std::string_view get_key() const { return node->key.view(); }
+
+ protected:
+  template <typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class StrLRUCache;
+};
+
+// StrLRUCache is an LRUCache keyed by variable-length strings. Each key is
+// hashed once per operation; the table then filters candidates by the full
+// 32-bit hash, and StrKey by the length and the prefix, before any byte
+// comparison (which is only needed for keys longer than StrKey::kInlineSize).
+//
+// Short keys are stored inline in the node. A long key is copied into a buffer
+// from a SlabArena, which is owned by the node and reused when the node is
+// recycled for another key (it is only reallocated if too small), so once the
+// cache is warmed up, no heap memory is allocated per insert.
+template <typename Value_t, typename Hash = strhash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class StrLRUCache {
+ public:
+  using StrValue_t = StrValue<Value_t>;
+  using LRUCache_t =
+      LRUCache<StrKey, StrValue_t, StrKeyHash<Hash>, Table, Alloc>;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = StrHandle<Value_t>;
+
+  StrLRUCache() = default;
+  ~StrLRUCache() = default;
+  StrLRUCache(const StrLRUCache&) = delete;
+  StrLRUCache(StrLRUCache&&) = delete;
+  StrLRUCache& operator=(const StrLRUCache&) = delete;
+  StrLRUCache& operator=(StrLRUCache&&) = delete;
+
+  void init(size_t capacity) { cache_.init(capacity); }
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn) {
+    cache_.init(capacity, [&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+
+  [[nodiscard]] size_t size() const { return cache_.size(); }
+  [[nodiscard]] size_t capacity() const { return cache_.capacity(); }
+
+  // For each item in the LRU list, call fn(handle) in LRU/MRU order
+  template <typename Fn>
+  void for_each_lru(Fn&& fn) const {
+    cache_.for_each_lru([&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+  template <typename Fn>
+  void for_each_mru(Fn&& fn) const {
+    cache_.for_each_mru([&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+
+  // Same semantics as LRUCache; the key is copied into the cache, so the
+  // caller's string can be dropped after the call.
+  Handle_t insert(std::string_view key, bool pin = false);
+  Handle_t lookup(std::string_view key, bool pin = false);
+  void release(Handle_t handle) { cache_.release(handle.node); }
+  void pin(Handle_t handle) { cache_.pin(handle.node); }
+  bool erase(Handle_t handle) { return cache_.erase(handle.node); }
+  Handle_t install(std::string_view key);
+
+ private:
+  // Make a node own its key, i.e., copy a non-inline key into its buffer.
+  void own_key(Node_t* e);
+
+  LRUCache_t cache_;
+  SlabArena arena_;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const {
+    return cache_.print(os, indent);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const StrLRUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename StrLRUCache<Value_t, Hash, Table, Alloc>::Handle_t
+StrLRUCache<Value_t, Hash, Table, Alloc>::insert(std::string_view key,
+                                                 bool pin) {
+  StrKey k(key);
+  uint32_t hash = Hash{}(key);
+  if (Node_t* e = cache_.lookup_impl(k, hash, pin)) return e;
+  Node_t* e = cache_.insert_impl(k, hash, pin, /*hint_nonexist*/ true);
+  if (e) own_key(e);
+  return e;
+}
+
+template <typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename StrLRUCache<Value_t, Hash, Table, Alloc>::Handle_t
+StrLRUCache<Value_t, Hash, Table, Alloc>::lookup(std::string_view key,
+                                                 bool pin) {
+  return cache_.lookup_impl(StrKey(key), Hash{}(key), pin);
+}
+
+template <typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename StrLRUCache<Value_t, Hash, Table, Alloc>::Handle_t
+StrLRUCache<Value_t, Hash, Table, Alloc>::install(std::string_view key) {
+  Node_t* e = cache_.install_impl(StrKey(key));
+  own_key(e);
+  return e;
+}
+
+template <typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void StrLRUCache<Value_t, Hash, Table, Alloc>::own_key(Node_t* e) {
+  // the node is already in the table, but replacing the key's pointer with one
+  // to the same content does not change its hash or equality
+  if (e->key.is_inline()) return;
+  uint32_t len = e->key.size();
+  StrValue_t& v = e->value;
+  if (v.buf_size < len) {
+    if (v.buf) arena_.free(v.buf, v.buf_size);
+    v.buf_size = len;
+    v.buf = arena_.alloc(v.buf_size);
+  }
+  memcpy(v.buf, e->key.get_ptr(), len);
+  e->key.set_ptr(v.buf);
+}
+
+}  // namespace gcache
@@ -3,12 +3,14 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <bit>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 
+#include "alloc.h"
 #include "node.h"
 
 namespace gcache {
@@ -18,14 +20,30 @@ namespace gcache {
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
 // 4.4.3's builtin hashtable.
-template <typename Key_t, typename Value_t>
+//
+// The table grows when the number of entries exceeds the number of buckets
+// (e.g. due to `install`), and shrinks when it drops below 1/4 of buckets (but
+// never below the initial length). Resizing is incremental: the old bucket
+// array is kept until all its buckets are migrated, and each insert/remove
+// migrates a few of them, so no single operation pays an O(n) stall.
+template <typename Key_t, typename Value_t, typename Alloc = HeapAlloc>
 class NodeTable {
  private:
   using Node_t = LRUNode<Key_t, Value_t>;
 
  public:
-  NodeTable() : length_(0), list_(nullptr) {}
-  ~NodeTable() { delete[] list_; }
+  NodeTable()
+      : length_(0),
+        min_length_(0),
+        elems_(0),
+        list_(nullptr),
+        old_length_(0),
+        migrate_idx_(0),
+        old_list_(nullptr) {}
+  ~NodeTable() {
+    Alloc::deallocate(list_, length_);
+    Alloc::deallocate(old_list_, old_length_);
+  }
 
   void init(size_t size);  // size must be 2^n; must be called before any r/w
 
@@ -34,80 +52,176 @@ class NodeTable {
   Node_t* lookup(Key_t key, uint32_t hash);
   Node_t* remove(Key_t key, uint32_t hash);
 
+  // Prefetch the bucket of the hash, and the first node in the bucket; the
+  // latter should be called after the bucket is prefetched.
+  void prefetch_bucket(uint32_t hash) { __builtin_prefetch(bucket(hash)); }
+  void prefetch_node(uint32_t hash) {
+    if (Node_t* e = *bucket(hash)) __builtin_prefetch(e);
+  }
+
  private:
+  // Number of old buckets to migrate per insert/remove during resizing. With
+  // growing triggered at elems_ > length_, the migration must be done before
+  // the next resizing is required, which takes at least length_ operations.
+  static constexpr uint32_t kMigrateBuckets = 4;
+
+  // Return a pointer to the bucket that the hash belongs to; during resizing,
+  // it is in the old list if that bucket has not been migrated yet.
+  Node_t** bucket(uint32_t hash);
+
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
   Node_t** find_pointer(Key_t key, uint32_t hash);
 
+  bool is_resizing() const { return old_list_ != nullptr; }
+  // Start to migrate all entries into a new list of the given length.
+  void resize(uint32_t length);
+  // Migrate a few buckets from the old list to the new list.
+  void migrate();
+
   // The table consists of an array of buckets where each bucket is
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
+  uint32_t min_length_;  // the length at init; never shrink below it
+  size_t elems_;
   Node_t** list_;
 
+  // Buckets of old_list_ before migrate_idx_ have been moved to list_; only
+  // valid during resizing.
+  uint32_t old_length_;
+  uint32_t migrate_idx_;
+  Node_t** old_list_;
+
  public:  // for debugging
   std::ostream& print(std::ostream& os, int indent = 0) const;
 };
 
-template <typename Key_t, typename Value_t>
-inline void NodeTable<Key_t, Value_t>::insert(
-    NodeTable<Key_t, Value_t>::Node_t* e) {
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void NodeTable<Key_t, Value_t, Alloc>::insert(
+    NodeTable<Key_t, Value_t, Alloc>::Node_t* e) {
   // Caller must ensure e->key is not present in the table!
   assert(!lookup(e->key, e->hash));
+  if (is_resizing()) {
+    migrate();
+  } else if (elems_ >= length_) {
+    resize(length_ * 2);
+    migrate();
+  }
   // Add to the head of this linked list
-  Node_t** ptr = &list_[e->hash & (length_ - 1)];
+  Node_t** ptr = bucket(e->hash);
   e->next_hash = *ptr;
   *ptr = e;
+  ++elems_;
 }
 
-template <typename Key_t, typename Value_t>
-inline typename NodeTable<Key_t, Value_t>::Node_t*
-NodeTable<Key_t, Value_t>::lookup(Key_t key, uint32_t hash) {
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename NodeTable<Key_t, Value_t, Alloc>::Node_t*
+NodeTable<Key_t, Value_t, Alloc>::lookup(Key_t key, uint32_t hash) {
   assert(length_ > 0);
   return *find_pointer(key, hash);
 }
 
-template <typename Key_t, typename Value_t>
-inline typename NodeTable<Key_t, Value_t>::Node_t*
-NodeTable<Key_t, Value_t>::remove(Key_t key, uint32_t hash) {
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename NodeTable<Key_t, Value_t, Alloc>::Node_t*
+NodeTable<Key_t, Value_t, Alloc>::remove(Key_t key, uint32_t hash) {
   assert(length_ > 0);
   Node_t** ptr = find_pointer(key, hash);
   Node_t* result = *ptr;
-  if (result != nullptr) *ptr = result->next_hash;
+  if (result == nullptr) return nullptr;
+  *ptr = result->next_hash;
+  --elems_;
+  if (is_resizing()) {
+    migrate();
+  } else if (elems_ < length_ / 4 && length_ > min_length_) {
+    resize(length_ / 2);
+    migrate();
+  }
   return result;
 }
 
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename NodeTable<Key_t, Value_t, Alloc>::Node_t**
+NodeTable<Key_t, Value_t, Alloc>::bucket(uint32_t hash) {
+  if (is_resizing()) {
+    uint32_t old_idx = hash & (old_length_ - 1);
+    if (old_idx >= migrate_idx_) return &old_list_[old_idx];
+  }
+  return &list_[hash & (length_ - 1)];
+}
+
 // Return a pointer to slot that points to a cache entry that
 // matches key/hash.  If there is no such cache entry, return a
 // pointer to the trailing slot in the corresponding linked list.
-template <typename Key_t, typename Value_t>
-inline typename NodeTable<Key_t, Value_t>::Node_t**
-NodeTable<Key_t, Value_t>::find_pointer(Key_t key, uint32_t hash) {
-  Node_t** ptr = &list_[hash & (length_ - 1)];
+template <typename Key_t, typename Value_t, typename Alloc>
+inline typename NodeTable<Key_t, Value_t, Alloc>::Node_t**
+NodeTable<Key_t, Value_t, Alloc>::find_pointer(Key_t key, uint32_t hash) {
+  Node_t** ptr = bucket(hash);
   while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key)) {
     ptr = &(*ptr)->next_hash;
   }
   return ptr;
 }
 
-template <typename Key_t, typename Value_t>
-inline void NodeTable<Key_t, Value_t>::init(size_t size) {
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void NodeTable<Key_t, Value_t, Alloc>::resize(uint32_t length) {
+  assert(!is_resizing());
+  old_list_ = list_;
+  old_length_ = length_;
+  migrate_idx_ = 0;
+  length_ = length;
+  list_ = Alloc::template allocate<Node_t*>(length_);
+  memset(list_, 0, sizeof(list_[0]) * length_);
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void NodeTable<Key_t, Value_t, Alloc>::migrate() {
+  assert(is_resizing());
+  uint32_t end = std::min(migrate_idx_ + kMigrateBuckets, old_length_);
+  for (; migrate_idx_ < end; ++migrate_idx_) {
+    Node_t* e = old_list_[migrate_idx_];
+    while (e != nullptr) {
+      Node_t* next = e->next_hash;
+      Node_t** ptr = &list_[e->hash & (length_ - 1)];
+      e->next_hash = *ptr;
+      *ptr = e;
+      e = next;
+    }
+  }
+  if (migrate_idx_ == old_length_) {
+    Alloc::deallocate(old_list_, old_length_);
+    old_list_ = nullptr;
+    old_length_ = 0;
+    migrate_idx_ = 0;
+  }
+}
+
+template <typename Key_t, typename Value_t, typename Alloc>
+inline void NodeTable<Key_t, Value_t, Alloc>::init(size_t size) {
   size = std::bit_ceil<size_t>(size);
   length_ = size;
-  list_ = new Node_t*[length_];
+  min_length_ = size;
+  list_ = Alloc::template allocate<Node_t*>(length_);
   memset(list_, 0, sizeof(list_[0]) * length_);
 }
 
-template <typename Key_t, typename Value_t>
-inline std::ostream& NodeTable<Key_t, Value_t>::print(std::ostream& os,
-                                                      int indent) const {
-  os << "NodeTable (length=" << length_ << ") {\n";
+template <typename Key_t, typename Value_t, typename Alloc>
+inline std::ostream& NodeTable<Key_t, Value_t, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "NodeTable (length=" << length_ << ", size=" << elems_ << ") {\n";
   for (size_t i = 0; i < length_; ++i) {
     auto h = list_[i];
     if (!h) continue;
     for (int j = 0; j < indent; ++j) os << '\t';
     h->print_list_hash(os);
   }
+  // buckets that have not been migrated yet
+  for (size_t i = migrate_idx_; i < old_length_; ++i) {
+    auto h = old_list_[i];
+    if (!h) continue;
+    for (int j = 0; j < indent; ++j) os << '\t';
+    h->print_list_hash(os);
+  }
   for (int j = 0; j < indent; ++j) os << '\t';
   os << "}\n";
   return os;
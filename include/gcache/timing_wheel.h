@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace gcache {
+
+// Intrusive links of a timer; embedded in the node's value as `timer`.
+template <typename Node_t>
+struct TimerLink {
+  Node_t* next;     // next node in the same slot
+  Node_t** pprev;   // the pointer pointing to this node; nullptr if unscheduled
+  uint64_t expire;  // the tick to expire at
+};
+
+// TimingWheel schedules timers on nodes in O(1) (Varghese & Lauck): it is a
+// hierarchy of kNumLevels wheels of kNumSlots slots each, where a slot at
+// level l spans kNumSlots^l ticks. A timer is placed at the finest level whose
+// range covers it; when a level wraps around, the slot of the next level for
+// the upcoming ticks is cascaded to the finer levels, so each timer moves at
+// most kNumLevels - 1 times. Timers beyond kRange ticks are placed at the
+// farthest slot and placed again when they cascade.
+//
+// Node_t must have a field `value.timer` of type TimerLink<Node_t>, whose
+// pprev is nullptr when the node is not scheduled.
+template <typename Node_t>
+class TimingWheel {
+ public:
+  static constexpr uint32_t kSlotBits = 6;
+  static constexpr uint32_t kNumSlots = 1 << kSlotBits;
+  static constexpr uint32_t kNumLevels = 4;
+  static constexpr uint64_t kRange = uint64_t{1} << (kSlotBits * kNumLevels);
+
+  TimingWheel() : slots_(), now_(0), size_(0) {}
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel(TimingWheel&&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+  TimingWheel& operator=(TimingWheel&&) = delete;
+
+  // Current tick
+  uint64_t now() const { return now_; }
+  // Number of scheduled nodes
+  size_t size() const { return size_; }
+
+  static bool is_scheduled(const Node_t* e) { return e->value.timer.pprev; }
+
+  // Schedule an unscheduled node to expire at the given tick; an expire in
+  // the past is treated as the next tick.
+  void schedule(Node_t* e, uint64_t expire) {
+    assert(!is_scheduled(e));
+    e->value.timer.expire = std::max(expire, now_ + 1);
+    link(e);
+    ++size_;
+  }
+
+  // Unschedule a scheduled node
+  void cancel(Node_t* e) {
+    assert(is_scheduled(e));
+    unlink(e);
+    --size_;
+  }
+
+  // Advance the clock by one tick and call fn(node) on each node expiring at
+  // the new tick; a node is unscheduled before fn is called on it. fn may
+  // schedule the node again, but must not cancel other nodes.
+  template <typename Fn>
+  void tick(Fn&& fn);
+
+  // Tick until now() reaches `now`; jump if nothing is scheduled.
+  template <typename Fn>
+  void advance_to(uint64_t now, Fn&& fn) {
+    while (now_ < now) {
+      if (size_ == 0) {
+        now_ = now;
+        break;
+      }
+      tick(fn);
+    }
+  }
+
+ private:
+  // Put e into the slot of its expire; the expire must be no earlier than
+  // now_, and may equal it only during cascading.
+  void link(Node_t* e);
+  void unlink(Node_t* e) {
+    auto& t = e->value.timer;
+    *t.pprev = t.next;
+    if (t.next) t.next->value.timer.pprev = t.pprev;
+    t.pprev = nullptr;
+  }
+  // Detach all nodes in a slot; return the first one. The detached nodes
+  // must be linked again or unscheduled.
+  Node_t* take(uint32_t level, uint32_t slot) {
+    Node_t* head = slots_[level][slot];
+    slots_[level][slot] = nullptr;
+    return head;
+  }
+
+  Node_t* slots_[kNumLevels][kNumSlots];
+  uint64_t now_;
+  size_t size_;
+};
+
+template <typename Node_t>
+inline void TimingWheel<Node_t>::link(Node_t* e) {
+  auto& t = e->value.timer;
+  assert(t.expire >= now_);
+  uint64_t expire = std::min(t.expire, now_ + kRange - 1);
+  uint64_t delta = expire - now_;
+  uint32_t level =
+      delta < kNumSlots ? 0 : (std::bit_width(delta) - 1) / kSlotBits;
+  uint32_t slot = (expire >> (kSlotBits * level)) & (kNumSlots - 1);
+  Node_t** head = &slots_[level][slot];
+  t.next = *head;
+  if (*head) (*head)->value.timer.pprev = &t.next;
+  *head = e;
+  t.pprev = head;
+}
+
+template <typename Node_t>
+template <typename Fn>
+inline void TimingWheel<Node_t>::tick(Fn&& fn) {
+  ++now_;
+  // cascade the slot of each level whose finer level just wrapped around
+  for (uint32_t level = 1; level < kNumLevels; ++level) {
+    if (now_ & ((uint64_t{1} << (kSlotBits * level)) - 1)) break;
+    uint32_t slot = (now_ >> (kSlotBits * level)) & (kNumSlots - 1);
+    for (Node_t* e = take(level, slot); e;) {
+      Node_t* next = e->value.timer.next;
+      link(e);
+      e = next;
+    }
+  }
+  for (Node_t* e = take(0, now_ & (kNumSlots - 1)); e;) {
+    Node_t* next = e->value.timer.next;
+    if (e->value.timer.expire > now_) {  // beyond kRange when placed
+      link(e);
+    } else {
+      e->value.timer.pprev = nullptr;
+      --size_;
+      fn(e);
+    }
+    e = next;
+  }
+}
+
+}  // namespace gcache
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "node.h"
+#include "sketch.h"
+#include "slru_cache.h"
+#include "table.h"
+
+namespace gcache {
+
+// TinyLFUCache is a drop-in replacement of LRUCache with the W-TinyLFU policy,
+// on the same node pool and table: LRUCache admits every new node by evicting
+// the LRU one, so one-hit wonders keep evicting hot nodes; TinyLFUCache puts
+// an admission filter in front of a segmented LRU instead.
+// - window: a small LRU (`window_ratio` of the capacity) that every new node
+//   enters, so a burst of new nodes still gets some hits;
+// - main: the segmented LRU of SLRUCache (probation and protected, the latter
+//   holding `protected_ratio` of main);
+// - admission: when the window overflows, its LRU node (the candidate) enters
+//   main only if its estimated frequency is higher than that of main's victim
+//   (probation's LRU node, or protected's if probation is empty); the loser is
+//   evicted.
+// Frequencies are estimated by a FrequencySketch, which counts every hit and
+// every newly inserted key.
+//
+// As in LRUCache, a pinned node is moved aside to the in-use list when met by
+// eviction, and release is a single atomic decrement. A node released since
+// then returns to probation's MRU end at the next eviction.
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but
+// not the LRU-specific ones (e.g. for_each_lru, erase/install).
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class TinyLFUCache {
+ public:
+  using Node_t = LRUNode<Key_t, Value_t>;
+  using Handle_t = LRUHandle<Key_t, Value_t>;
+  using Table_t = Table<Key_t, Value_t, Alloc>;
+
+  // Every lookup moves the node and updates the sketch.
+  static constexpr bool kConcurrentLookup = false;
+
+  explicit TinyLFUCache(double window_ratio = 0.01,
+                        double protected_ratio = 0.8);
+  ~TinyLFUCache() { Alloc::deallocate(pool_, capacity_); }
+  TinyLFUCache(const TinyLFUCache&) = delete;
+  TinyLFUCache(TinyLFUCache&&) = delete;
+  TinyLFUCache& operator=(const TinyLFUCache&) = delete;
+  TinyLFUCache& operator=(TinyLFUCache&&) = delete;
+
+  void init(size_t capacity);
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t window_capacity() const { return window_capacity_; }
+  size_t protected_capacity() const { return main_.protected_capacity(); }
+
+  // Return the estimated frequency of a key.
+  uint32_t estimate(Key_t key) const { return sketch_.estimate(Hash{}(key)); }
+
+  // For each item in the cache, call fn(handle)
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (size_t i = 0; i < size_; ++i) fn(&pool_[i]);
+  }
+
+  // Same semantics as LRUCache, except that a new node may evict itself (in
+  // favor of a more frequent one) when it leaves the window.
+  Handle_t insert(Key_t key, bool pin = false, bool hint_nonexist = false) {
+    return insert_impl(key, Hash{}(key), pin, hint_nonexist);
+  }
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { handle.node->release(); }
+  void pin(Handle_t handle) {
+    handle.node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  using Main_t = SLRUSegments<Node_t, Alloc>;
+
+  Node_t* insert_impl(Key_t key, uint32_t hash, bool pin, bool hint_nonexist);
+  Node_t* lookup_impl(Key_t key, uint32_t hash, bool pin);
+  // Remove a victim from the table, which is the loser between the window's
+  // candidate and main's victim; return nullptr if all are pinned.
+  Node_t* evict();
+  // Remove the window's LRU unpinned node and return it; pinned ones are moved
+  // to main's in-use list. Return nullptr if there is none.
+  Node_t* pop_window();
+
+  // Number of nodes in use; nodes in pool_[size_, capacity_) are free.
+  size_t size_;
+  size_t capacity_;
+  double window_ratio_;
+  double protected_ratio_;
+  size_t window_capacity_;
+  // Number of nodes in the window_ list.
+  size_t window_size_;
+  Node_t* pool_;
+  Main_t main_;
+  Table_t table_;
+  FrequencySketch<Alloc> sketch_;
+
+  // Dummy head of the window; window_.prev is the newest entry, window_.next
+  // is the oldest entry.
+  Node_t window_;
+
+  template <typename K, typename V, typename H, uint32_t B, typename C>
+  friend class ShardedLRUCache;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const;
+  friend std::ostream& operator<<(std::ostream& os, const TinyLFUCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::TinyLFUCache(
+    double window_ratio, double protected_ratio)
+    : size_(0),
+      capacity_(0),
+      window_ratio_(window_ratio),
+      protected_ratio_(protected_ratio),
+      window_capacity_(0),
+      window_size_(0),
+      pool_(nullptr),
+      main_(),
+      table_(),
+      sketch_() {
+  assert(window_ratio > 0 && window_ratio < 1);
+  assert(protected_ratio >= 0 && protected_ratio <= 1);
+  window_.next = &window_;
+  window_.prev = &window_;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity) {
+  assert(!capacity_ && !pool_);
+  assert(capacity);
+  capacity_ = capacity;
+  window_capacity_ =
+      std::max<size_t>(static_cast<size_t>(capacity * window_ratio_), 1);
+  pool_ = Alloc::template allocate<Node_t>(capacity);
+  main_.init(pool_, capacity,
+             static_cast<size_t>((capacity - window_capacity_) *
+                                 protected_ratio_));
+  table_.init(capacity);
+  sketch_.init(capacity);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+template <typename Fn>
+inline void TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::init(
+    size_t capacity, Fn&& fn) {
+  init(capacity);
+  for (size_t i = 0; i < capacity; ++i) fn(&pool_[i]);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::insert_impl(
+    Key_t key, uint32_t hash, bool pin, bool hint_nonexist) {
+  assert(capacity_ > 0);
+  Node_t* e;
+  if (!hint_nonexist) {
+    e = lookup_impl(key, hash, pin);
+    if (e) return e;
+  } else {
+    assert(!table_.lookup(key, hash));  // check if hint is correct
+  }
+
+  // a newly inserted key counts as an access, as a hit does
+  sketch_.increment(hash);
+  if (size_ < capacity_) {
+    e = &pool_[size_++];
+  } else {
+    e = evict();
+    if (!e) return nullptr;
+  }
+  e->init(key, hash);
+  table_.insert(e);
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  main_.segment_of(e) = Main_t::kWindow;
+  Node_t::list_append(&window_, e);
+  ++window_size_;
+  // the window overflows only if main has room (or its nodes are pinned), so
+  // its LRU node enters probation without competing
+  if (window_size_ > window_capacity_) {
+    Node_t* c = window_.next;
+    Node_t::list_remove(c);
+    --window_size_;
+    main_.insert(c);
+  }
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::lookup_impl(Key_t key,
+                                                              uint32_t hash,
+                                                              bool pin) {
+  Node_t* e = table_.lookup(key, hash);
+  if (!e) return nullptr;
+  sketch_.increment(hash);
+  if (main_.segment_of(e) == Main_t::kWindow) {
+    Node_t::list_remove(e);
+    Node_t::list_append(&window_, e);
+  } else {
+    main_.hit(e);
+  }
+  if (pin) e->refs.fetch_add(1, std::memory_order_relaxed);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::pop_window() {
+  while (window_.next != &window_) {
+    Node_t* e = window_.next;
+    Node_t::list_remove(e);
+    --window_size_;
+    if (e->refs.load(std::memory_order_acquire) > 1) {
+      main_.park(e);
+      continue;
+    }
+    return e;
+  }
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::Node_t*
+TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::evict() {
+  main_.reclaim_in_use();  // see LRUCache::evict_lru
+  do {
+    // without a full window, there is no candidate, and main's victim is
+    // evicted as in SLRU
+    Node_t* candidate =
+        window_size_ >= window_capacity_ ? pop_window() : nullptr;
+    Node_t* victim = main_.pop_victim();
+
+    Node_t* loser = candidate ? candidate : victim;
+    if (candidate && victim) {
+      if (sketch_.estimate(candidate->hash) > sketch_.estimate(victim->hash)) {
+        main_.insert(candidate);
+        loser = victim;
+      } else {  // the victim survives and stays the LRU node of its list
+        main_.push_victim(victim);
+      }
+    }
+    if (loser) {
+      [[maybe_unused]] Node_t* e_ = table_.remove(loser->key, loser->hash);
+      assert(e_ == loser);
+      return loser;
+    }
+  } while (main_.reclaim_in_use());
+  return nullptr;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline std::ostream& TinyLFUCache<Key_t, Value_t, Hash, Table, Alloc>::print(
+    std::ostream& os, int indent) const {
+  os << "TinyLFUCache (capacity=" << capacity_
+     << ", window_capacity=" << window_capacity_
+     << ", protected_capacity=" << protected_capacity() << ") {\n";
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  os << "window:    [";
+  window_.print_list(os);
+  os << "]\n";
+  main_.print(os, indent + 1);
+  for (int i = 0; i < indent + 1; ++i) os << '\t';
+  table_.print(os, indent + 1);
+  for (int i = 0; i < indent; ++i) os << '\t';
+  os << "}\n";
+  return os;
+}
+
+}  // namespace gcache
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "alloc.h"
+#include "lru_cache.h"
+#include "node.h"
+#include "table.h"
+#include "timing_wheel.h"
+
+namespace gcache {
+
+template <typename Key_t, typename Value_t>
+struct TTLValue {
+  TimerLink<LRUNode<Key_t, TTLValue>> timer;
+  Value_t value;
+};
+
+template <typename Key_t, typename Value_t>
+class TTLHandle : public BaseHandle<LRUNode<Key_t, TTLValue<Key_t, Value_t>>> {
+ private:
+  using TTLValue_t = TTLValue<Key_t, Value_t>;
+  using Node_t = LRUNode<Key_t, TTLValue_t>;
+  using BaseHandle<Node_t>::node;  // otherwise `node` will be invisible
+
+ public:
+  TTLHandle(Node_t* node) : BaseHandle<Node_t>(node) {}
+  TTLHandle() = default;
+  TTLHandle(const TTLHandle&) = default;
+  TTLHandle(TTLHandle&&) noexcept = default;
+  TTLHandle& operator=(const TTLHandle&) = default;
+  TTLHandle& operator=(TTLHandle&&) noexcept = default;
+
+  // node->value is of type `TTLValue`; to get the real value, must further
+  // access .value
+  Value_t* operator->() { return &node->value.value; }
+  const Value_t* operator->() const { return &node->value.value; }
+  Value_t& operator*() { return node->value.value; }
+  const Value_t& operator*() const { return node->value.value; }
+
+  Key_t get_key() const { return node->key; }
+  // The tick this node expires at; UINT64_MAX if it never expires
+  uint64_t get_expire() const { return node->value.timer.expire; }
+
+ protected:
+  // only visible to TTLCache: converted into LRUHandle
+  LRUHandle<Key_t, TTLValue_t> untagged() { return node; }
+
+  template <typename K, typename V, typename H,
+            template <typename, typename, typename> class T, typename A>
+  friend class TTLCache;
+};
+
+// TTLCache is an LRUCache whose entries may expire after a time-to-live (TTL).
+// Time is counted in ticks of a coarse clock that the caller advances, e.g.,
+// by calling advance_to(now_ms / 10) once per batch of requests for a 10 ms
+// tick, so lookup only compares against the cached tick instead of reading a
+// clock on each access.
+//
+// Timers are kept in a hierarchical TimingWheel, so setting, cancelling, and
+// firing one are O(1). An expired node is removed from the table and goes
+// straight to the free list, so it is reused before any live LRU victim. If
+// an expiring node is pinned, it stays until LRU evicts it, but lookup treats
+// it as a miss.
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but not
+// erase/install.
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class TTLCache {
+ public:
+  using TTLValue_t = TTLValue<Key_t, Value_t>;
+  using LRUCache_t = LRUCache<Key_t, TTLValue_t, Hash, Table, Alloc>;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = TTLHandle<Key_t, Value_t>;
+
+  // TTL of an entry that never expires
+  static constexpr uint64_t kNoTTL = 0;
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  TTLCache() = default;
+  ~TTLCache() = default;
+  TTLCache(const TTLCache&) = delete;
+  TTLCache(TTLCache&&) = delete;
+  TTLCache& operator=(const TTLCache&) = delete;
+  TTLCache& operator=(TTLCache&&) = delete;
+
+  void init(size_t capacity) {
+    cache_.init(capacity, [](Node_t* e) { init_timer(e); });
+  }
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn) {
+    cache_.init(capacity, [&fn](Node_t* e) {
+      init_timer(e);
+      fn(Handle_t(e));
+    });
+  }
+
+  [[nodiscard]] size_t size() const { return cache_.size(); }
+  [[nodiscard]] size_t capacity() const { return cache_.capacity(); }
+  // Current tick of the coarse clock
+  [[nodiscard]] uint64_t now() const { return wheel_.now(); }
+
+  // For each item in the cache (including the expired but pinned ones), call
+  // fn(handle)
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    cache_.for_each([&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+
+  // Same as LRUCache::insert, but the node expires `ttl` ticks later (never if
+  // kNoTTL); if the key exists, the existing node's TTL is reset.
+  Handle_t insert(Key_t key, uint64_t ttl = kNoTTL, bool pin = false);
+  // Same as LRUCache::lookup, but return nullptr if the node has expired.
+  Handle_t lookup(Key_t key, bool pin = false);
+  void release(Handle_t handle) { cache_.release(handle.untagged()); }
+  void pin(Handle_t handle) { cache_.pin(handle.untagged()); }
+
+  // Reset the TTL of a node to `ttl` ticks from now (never if kNoTTL)
+  void set_ttl(Handle_t handle, uint64_t ttl) { set_ttl(handle.node, ttl); }
+
+  // Advance the clock by n ticks or to the tick `now`, and free the expired
+  // nodes; return the number of nodes freed.
+  size_t tick(uint64_t n = 1) { return advance_to(wheel_.now() + n); }
+  size_t advance_to(uint64_t now);
+
+ private:
+  static void init_timer(Node_t* e) {
+    e->value.timer.pprev = nullptr;
+    e->value.timer.expire = kNever;
+  }
+  void set_ttl(Node_t* e, uint64_t ttl);
+
+  LRUCache_t cache_;
+  TimingWheel<Node_t> wheel_;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const {
+    return cache_.print(os, indent);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const TTLCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TTLCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+TTLCache<Key_t, Value_t, Hash, Table, Alloc>::insert(Key_t key, uint64_t ttl,
+                                                     bool pin) {
+  // a recycled LRU victim must not fire later
+  auto victim_fn = [this](Node_t* e) {
+    if (wheel_.is_scheduled(e)) wheel_.cancel(e);
+    return true;
+  };
+  Node_t* e = cache_.insert_impl(key, Hash{}(key), pin, false, victim_fn);
+  if (!e) return nullptr;
+  set_ttl(e, ttl);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename TTLCache<Key_t, Value_t, Hash, Table, Alloc>::Handle_t
+TTLCache<Key_t, Value_t, Hash, Table, Alloc>::lookup(Key_t key, bool pin) {
+  Node_t* e = cache_.table_->lookup(key, Hash{}(key));
+  if (!e || e->value.timer.expire <= wheel_.now()) return nullptr;
+  cache_.lookup_refresh(e, pin);
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void TTLCache<Key_t, Value_t, Hash, Table, Alloc>::set_ttl(
+    Node_t* e, uint64_t ttl) {
+  if (wheel_.is_scheduled(e)) wheel_.cancel(e);
+  if (ttl == kNoTTL)
+    e->value.timer.expire = kNever;
+  else
+    wheel_.schedule(e, wheel_.now() + ttl);
+}
+
+template <typename Key_t, typename Value_t, typename Hash,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t TTLCache<Key_t, Value_t, Hash, Table, Alloc>::advance_to(
+    uint64_t now) {
+  size_t num_freed = 0;
+  wheel_.advance_to(now, [&](Node_t* e) { num_freed += cache_.evict(e); });
+  return num_freed;
+}
+
+}  // namespace gcache
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "alloc.h"
+#include "lru_cache.h"
+#include "node.h"
+#include "table.h"
+
+namespace gcache {
+
+template <typename Value_t>
+struct DirtyValue {
+  bool dirty;
+  Value_t value;
+};
+
+template <typename Key_t, typename Value_t>
+class WriteBackHandle
+    : public BaseHandle<LRUNode<Key_t, DirtyValue<Value_t>>> {
+ private:
+  using DirtyValue_t = DirtyValue<Value_t>;
+  using Node_t = LRUNode<Key_t, DirtyValue_t>;
+  using BaseHandle<Node_t>::node;  // otherwise `node` will be invisible
+
+ public:
+  WriteBackHandle(Node_t* node) : BaseHandle<Node_t>(node) {}
+  WriteBackHandle() = default;
+  WriteBackHandle(const WriteBackHandle&) = default;
+  WriteBackHandle(WriteBackHandle&&) noexcept = default;
+  WriteBackHandle& operator=(const WriteBackHandle&) = default;
+  WriteBackHandle& operator=(WriteBackHandle&&) noexcept = default;
+
+  // node->value is of type `DirtyValue`; to get the real value, must further
+  // access .value
+  Value_t* operator->() { return &node->value.value; }
+  const Value_t* operator->() const { return &node->value.value; }
+  Value_t& operator*() { return node->value.value; }
+  const Value_t& operator*() const { return node->value.value; }
+
+  Key_t get_key() const { return node->key; }
+  bool is_dirty() const { return node->value.dirty; }
+  // Mark the value as modified, so it is written back before being recycled.
+  void mark_dirty() { node->value.dirty = true; }
+
+ protected:
+  // only visible to WriteBackCache: converted into LRUHandle
+  LRUHandle<Key_t, DirtyValue_t> untagged() { return node; }
+
+  template <typename K, typename V, typename H, typename W,
+            template <typename, typename, typename> class T, typename A>
+  friend class WriteBackCache;
+};
+
+// WriteBackCache is an LRUCache whose values are cached pages of a backing
+// store, e.g. a file. A modified page is marked dirty and must be written back
+// before its node is recycled for another key. Instead of writing a dirty
+// victim synchronously on eviction, the cache parks it (see LRUCache::insert)
+// and moves on to the next clean victim; once batch_size victims are parked,
+// or there is no clean victim left, they are flushed together: sorted by key
+// and passed to the writer in one call, so the backing store sees sequential
+// writes instead of random ones in LRU order.
+//
+// Writer is called as writer(const Handle_t* handles, size_t n) with handles
+// sorted by key (Key_t must provide operator<); the dirty flags are cleared
+// after it returns. A parked page is still cached, so a lookup hits it (and
+// returns it to the LRU list) until it is written back and recycled.
+//
+// It provides the same init/insert/lookup/pin/release APIs as LRUCache, but not
+// erase/install.
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table = NodeTable,
+          typename Alloc = HeapAlloc>
+class WriteBackCache {
+ public:
+  using DirtyValue_t = DirtyValue<Value_t>;
+  using LRUCache_t = LRUCache<Key_t, DirtyValue_t, Hash, Table, Alloc>;
+  using Node_t = typename LRUCache_t::Node_t;
+  using Handle_t = WriteBackHandle<Key_t, Value_t>;
+
+  explicit WriteBackCache(Writer writer, size_t batch_size = 64)
+      : writer_(std::move(writer)), batch_size_(batch_size), num_parked_(0) {}
+  ~WriteBackCache() = default;
+  WriteBackCache(const WriteBackCache&) = delete;
+  WriteBackCache(WriteBackCache&&) = delete;
+  WriteBackCache& operator=(const WriteBackCache&) = delete;
+  WriteBackCache& operator=(WriteBackCache&&) = delete;
+
+  void init(size_t capacity) {
+    cache_.init(capacity, [](Node_t* e) { e->value.dirty = false; });
+  }
+  template <typename Fn>
+  void init(size_t capacity, Fn&& fn) {
+    cache_.init(capacity, [&fn](Node_t* e) {
+      e->value.dirty = false;
+      fn(Handle_t(e));
+    });
+  }
+
+  [[nodiscard]] size_t size() const { return cache_.size(); }
+  [[nodiscard]] size_t capacity() const { return cache_.capacity(); }
+
+  // For each item in the cache (including the parked ones), call fn(handle)
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    cache_.for_each([&fn](Node_t* e) { fn(Handle_t(e)); });
+  }
+
+  // Same semantics as LRUCache, except that a dirty victim is never recycled
+  // before written back. A newly inserted node is clean.
+  Handle_t insert(Key_t key, bool pin = false);
+  Handle_t lookup(Key_t key, bool pin = false) {
+    return cache_.lookup_impl(key, Hash{}(key), pin);
+  }
+  void release(Handle_t handle) { cache_.release(handle.untagged()); }
+  void pin(Handle_t handle) { cache_.pin(handle.untagged()); }
+
+  // Write back all parked victims, which are then next to be recycled; return
+  // the number of pages written.
+  size_t flush();
+  // Write back all dirty pages, parked or not, e.g., before shutdown; return
+  // the number of pages written.
+  size_t flush_all();
+
+ private:
+  // Sort batch_ by key, write it back, and mark the pages clean.
+  void write_back();
+
+  LRUCache_t cache_;
+  Writer writer_;
+  size_t batch_size_;
+  // Number of victims parked since the last flush; an upper bound of the
+  // parked list's length, as a lookup may return a parked one to LRU.
+  size_t num_parked_;
+  std::vector<Handle_t> batch_;
+
+ public:  // for debugging
+  std::ostream& print(std::ostream& os, int indent = 0) const {
+    return cache_.print(os, indent);
+  }
+  friend std::ostream& operator<<(std::ostream& os, const WriteBackCache& c) {
+    return c.print(os);
+  }
+};
+
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline typename WriteBackCache<Key_t, Value_t, Hash, Writer, Table,
+                               Alloc>::Handle_t
+WriteBackCache<Key_t, Value_t, Hash, Writer, Table, Alloc>::insert(Key_t key,
+                                                                   bool pin) {
+  auto victim_fn = [this](Node_t* e) {
+    if (!e->value.dirty) return true;
+    ++num_parked_;
+    return false;
+  };
+  uint32_t hash = Hash{}(key);
+  Node_t* e = cache_.insert_impl(key, hash, pin, false, victim_fn);
+  if (!e && num_parked_ > 0) {  // all victims are dirty
+    flush();
+    e = cache_.insert_impl(key, hash, pin, /*hint_nonexist*/ true, victim_fn);
+  }
+  if (num_parked_ >= batch_size_) flush();
+  return e;
+}
+
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t
+WriteBackCache<Key_t, Value_t, Hash, Writer, Table, Alloc>::flush() {
+  batch_.clear();
+  cache_.for_each_parked([this](Node_t* e) { batch_.emplace_back(e); });
+  num_parked_ = 0;
+  if (batch_.empty()) return 0;
+  write_back();
+  for (auto h : batch_) cache_.unpark(h.untagged());
+  return batch_.size();
+}
+
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline size_t
+WriteBackCache<Key_t, Value_t, Hash, Writer, Table, Alloc>::flush_all() {
+  size_t n = flush();
+  batch_.clear();
+  cache_.for_each([this](Node_t* e) {
+    if (e->value.dirty) batch_.emplace_back(e);
+  });
+  if (batch_.empty()) return n;
+  write_back();
+  return n + batch_.size();
+}
+
+template <typename Key_t, typename Value_t, typename Hash, typename Writer,
+          template <typename, typename, typename> class Table, typename Alloc>
+inline void
+WriteBackCache<Key_t, Value_t, Hash, Writer, Table, Alloc>::write_back() {
+  std::sort(batch_.begin(), batch_.end(),
+            [](const Handle_t& a, const Handle_t& b) {
+              return a.get_key() < b.get_key();
+            });
+  writer_(static_cast<const Handle_t*>(batch_.data()), batch_.size());
+  for (auto& h : batch_) {
+    assert(h.is_dirty());
+    h.untagged()->dirty = false;
+  }
+}
+
+}  // namespace gcache
@@ -12,19 +12,17 @@ run_cmd() {
 	result_dir=results/sr${sr}_${name}_sd${seed}
 	mkdir -p ${result_dir}
 
-	./build-SR${sr}/gcache_bench_ghost --workload=${wl} --working_set=${ws} \
+	./build/gcache_bench_ghost --workload=${wl} --working_set=${ws} \
 		--zipf_theta=${theta} --cache_tick=${cache_tick} --rand_seed=${seed}\
-		--result_dir=${result_dir} > ${result_dir}/log
+		--sample_shift=${sr} --result_dir=${result_dir} > ${result_dir}/log
 }
 
-for sr in 3 4 5 6 7 8; do
-	echo "Compile with sample rate: ${sr}"
-	mkdir -p build-SR${sr}
-	cd build-SR${sr}
-	cmake -DSAMPLE_SHIFT=${sr} -DCMAKE_BUILD_TYPE=Release ..
-	make -j
-	cd ..
-done
+# the sample rate is a runtime flag, so one build covers all rates
+mkdir -p build
+cd build
+cmake -DCMAKE_BUILD_TYPE=Release ..
+make -j
+cd ..
 
 for seed in {0..999}; do  # 1000 times
 	for sr in 3 4 5 6 7 8; do
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+// Fixtures shared by the tests of eviction policies, e.g. ClockCache.
+
+// A node that eviction met while pinned must be evictable once released, even
+// if the cache never runs out of unpinned nodes.
+template <typename Cache_t>
+void test_release_parked() {
+  Cache_t cache;
+  cache.init(4);
+  auto h = cache.insert(1, /*pin*/ true);
+  for (uint32_t i = 2; i <= 5; ++i) cache.insert(i);  // 1 is moved aside
+  cache.release(h);
+  for (uint32_t i = 100; i < 100100; ++i) cache.insert(i);
+  if (cache.lookup(1))
+    throw std::runtime_error("Released node is never evicted!");
+  assert(cache.size() == 4);
+}
+
+// Threads mix pinned inserts and pinned lookups on a thread-safe Cache_t (e.g.
+// ShardedLRUCache over the policy); every pinned handle must stay consistent.
+template <typename Cache_t>
+void test_concurrent_pinned(uint32_t num_threads, uint32_t num_ops) {
+  Cache_t cache;
+  cache.init(4096, [](typename Cache_t::Handle_t h) { *h = 0; });
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, t, num_threads, num_ops]() {
+      for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+        uint32_t key = (i * 7 + t) % 8192;
+        auto h = i % 2 ? cache.lookup(key, /*pin*/ true)
+                       : cache.insert(key, /*pin*/ true);
+        if (!h) continue;  // not cached, or all nodes in the shard are pinned
+        if (h.get_key() != key)
+          throw std::runtime_error("Inconsistent key in pinned handle!");
+        *h = key;
+        cache.release(h);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  assert(cache.size() == 4096);
+  cache.for_each([](typename Cache_t::Handle_t h) {
+    if (*h != h.get_key())
+      throw std::runtime_error("Inconsistent value after concurrent updates!");
+  });
+}
+
+// Single-threaded latency of hits on a full cache and of misses that evict.
+template <typename Cache_t>
+void bench_hit(const char* name, uint32_t num_ops) {
+  constexpr uint32_t bench_size = 256 * 1024;
+  Cache_t cache;
+  cache.init(bench_size);
+  for (uint32_t i = 0; i < bench_size; ++i) cache.insert(i);
+
+  auto ts0 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i) cache.lookup((i * 17) % bench_size);
+  auto ts1 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i) cache.insert(bench_size + i);
+  auto ts2 = rdtsc();
+
+  std::cout << name << ":\n";
+  std::cout << "Hit:  " << (ts1 - ts0) / num_ops << " cycles/op\n";
+  std::cout << "Miss: " << (ts2 - ts1) / num_ops << " cycles/op\n";
+}
+
+// Latency of lookups on a full thread-safe Cache_t (e.g. ShardedLRUCache over
+// the policy) from concurrent threads; with `pin`, every hit is pinned and
+// released.
+template <typename Cache_t>
+void bench_concurrent(const char* name, uint32_t num_threads, uint32_t num_ops,
+                      bool pin) {
+  constexpr uint32_t bench_size = 256 * 1024;  // #blocks for 1GB working set
+  Cache_t cache;
+  cache.init(bench_size);
+  for (uint32_t i = 0; i < bench_size; ++i) cache.insert(i);
+
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> cycles(num_threads, 0);
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, &cycles, t, num_threads, num_ops, pin]() {
+      auto ts0 = rdtsc();
+      for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+        auto h = cache.lookup((i * 17 + t) % bench_size, pin);
+        if (pin && h) cache.release(h);
+      }
+      cycles[t] = rdtsc() - ts0;
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  uint64_t total = 0;
+  for (auto c : cycles) total += c;
+  std::cout << name << (pin ? " pinned lookup (" : " lookup (") << num_threads
+            << " threads): " << total / num_ops << " cycles/op\n";
+}
+
+// Replay offsets (e.g. Offsets from benchmarks/workload.h) on cache, inserting
+// every miss; return the hit ratio.
+template <typename Cache_t, typename Offsets_t>
+double hit_ratio(Cache_t& cache, Offsets_t&& offsets) {
+  uint64_t num_ops = 0;
+  uint64_t num_hits = 0;
+  for (auto off : offsets) {
+    ++num_ops;
+    if (cache.lookup(off))
+      ++num_hits;
+    else
+      cache.insert(off);
+  }
+  return static_cast<double>(num_hits) / num_ops;
+}
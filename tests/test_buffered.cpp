@@ -0,0 +1,145 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "benchmarks/workload.h"
+#include "gcache/buffered_lru_cache.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/sharded_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+template <typename Cache_t>
+std::vector<uint32_t> lru_keys(const Cache_t& cache) {
+  std::vector<uint32_t> keys;
+  cache.for_each_lru([&keys](typename Cache_t::Handle_t h) {
+    keys.emplace_back(h.get_key());
+  });
+  return keys;
+}
+
+// peek never refreshes LRU
+void test1() {
+  LRUCache<uint32_t, uint32_t, idhash> lru;
+  BufferedLRUCache<uint32_t, uint32_t, idhash> buffered;
+  lru.init(3);
+  buffered.init(3);
+  for (uint32_t i = 1; i <= 3; ++i) {
+    lru.insert(i);
+    buffered.insert(i);
+  }
+  if (!lru.peek(1) || !buffered.peek(1) || lru.peek(4) || buffered.peek(4))
+    throw std::runtime_error("Peek: wrong result!");
+  lru.insert(4);
+  buffered.insert(4);
+  if (lru.lookup(1) || buffered.lookup(1))
+    throw std::runtime_error("Peek: LRU refreshed!");
+
+  auto h = buffered.peek(2, /*pin*/ true);
+  buffered.insert(5);
+  buffered.insert(6);
+  if (buffered.lookup(2) != h) throw std::runtime_error("Peek: not pinned!");
+  buffered.release(h);
+  buffered.drain();
+  std::cout << "Expect: lru: [5, 6, 2]\n";
+  std::cout << buffered << std::endl;
+}
+
+// With a single thread, buffered promotion is exactly LRU.
+void test2() {
+  LRUCache<uint32_t, uint32_t, ghash> lru;
+  BufferedLRUCache<uint32_t, uint32_t, ghash> buffered;
+  lru.init(4096);
+  buffered.init(4096);
+  Offsets offsets(num_ops, OffsetType::ZIPF, /*size*/ 64 * 1024, 1, 0.99,
+                  0x537);
+  uint64_t num_hits = 0;
+  for (auto off : offsets) {
+    bool hit = static_cast<bool>(lru.lookup(off));
+    if (hit != static_cast<bool>(buffered.lookup(off)))
+      throw std::runtime_error("Buffered: hit mismatch!");
+    if (hit) {
+      ++num_hits;
+    } else {
+      lru.insert(off);
+      buffered.insert(off);
+    }
+  }
+  buffered.drain();
+  if (lru_keys(lru) != lru_keys(buffered.get_cache()))
+    throw std::runtime_error("Buffered: LRU mismatch!");
+  std::cout << "Buffered: hit ratio " << static_cast<double>(num_hits) / num_ops
+            << " (exact LRU)\n";
+}
+
+// With concurrent readers, some hits may be dropped, but the hit ratio stays
+// close to LRU's.
+void test3() {
+  using LRU_t = ShardedLRUCache<uint32_t, uint32_t, ghash, 2>;
+  using Buffered_t =
+      ShardedLRUCache<uint32_t, uint32_t, ghash, 2,
+                      BufferedLRUCache<uint32_t, uint32_t, ghash>>;
+  static_assert(Buffered_t::LRUCache_t::kConcurrentLookup);
+  std::vector<uint32_t> keys;
+  for (auto off : Offsets(num_ops, OffsetType::ZIPF, /*size*/ 64 * 1024, 1,
+                          0.99, 0x537))
+    keys.emplace_back(off);
+  auto run = [&keys]<typename Cache_t>(Cache_t& cache) {
+    cache.init(4096);
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> num_hits(num_threads, 0);
+    for (uint32_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (uint32_t i = t; i < num_ops; i += num_threads) {
+          uint32_t key = keys[i];
+          auto h = cache.lookup(key, /*pin*/ true);
+          if (h) {
+            ++num_hits[t];
+          } else {
+            h = cache.insert(key, /*pin*/ true);
+            if (!h) continue;  // all nodes in the shard are pinned
+          }
+          if (h.get_key() != key)
+            throw std::runtime_error("Inconsistent key in pinned handle!");
+          cache.release(h);
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    uint64_t total = 0;
+    for (auto n : num_hits) total += n;
+    return static_cast<double>(total) / num_ops;
+  };
+  LRU_t lru;
+  Buffered_t buffered;
+  double lru_ratio = run(lru);
+  double buffered_ratio = run(buffered);
+  std::cout << "Zipf hit ratio (" << num_threads
+            << " threads): LRU=" << lru_ratio
+            << ", Buffered=" << buffered_ratio << std::endl;
+  if (std::abs(buffered_ratio - lru_ratio) > 0.01)
+    throw std::runtime_error("Buffered: hit ratio too far from LRU!");
+}
+
+int main() {
+  test1();  // for peek
+  test2();  // for exactness with a single thread
+  test3();  // for hit ratio with concurrent threads
+  bench_concurrent<ShardedLRUCache<uint32_t, uint32_t, ghash>>(
+      "LRUCache", num_threads, num_ops, /*pin*/ true);
+  bench_concurrent<
+      ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                      BufferedLRUCache<uint32_t, uint32_t, ghash>>>(
+      "BufferedLRUCache", num_threads, num_ops, /*pin*/ true);
+  std::cout << std::flush;
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gcache/clock_cache.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/sharded_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+void test1() {
+  ClockCache<uint32_t, uint32_t, idhash> cache;
+  cache.init(4);
+  for (uint32_t i = 1; i <= 4; ++i) *cache.insert(i) = i * 111;
+  assert(cache.size() == 4);
+
+  // 1 and 3 get a second chance; the hand stops at 2 and then 4
+  cache.lookup(1);
+  cache.lookup(3);
+  *cache.insert(5) = 555;
+  if (cache.lookup(2)) throw std::runtime_error("Clock: 2 not evicted!");
+  *cache.insert(6) = 666;
+  if (cache.lookup(4)) throw std::runtime_error("Clock: 4 not evicted!");
+  if (*cache.lookup(1) != 111 || *cache.lookup(3) != 333)
+    throw std::runtime_error("Clock: referenced node evicted!");
+
+  // a pinned node is skipped by the hand even if not referenced
+  auto h = cache.insert(1, /*pin*/ true);
+  cache.lookup(3);
+  cache.lookup(6);
+  *cache.insert(7) = 777;
+  if (cache.lookup(5)) throw std::runtime_error("Clock: 5 not evicted!");
+  if (cache.lookup(1) != h) throw std::runtime_error("Clock: pinned evicted!");
+
+  // all pinned: no victim
+  auto h3 = cache.lookup(3, /*pin*/ true);
+  auto h6 = cache.lookup(6, /*pin*/ true);
+  auto h7 = cache.lookup(7, /*pin*/ true);
+  if (cache.insert(8)) throw std::runtime_error("Clock: evicted pinned!");
+  cache.release(h);
+  cache.release(h3);
+  cache.release(h6);
+  cache.release(h7);
+  assert(cache.size() == 4);
+
+  std::cout << "Expect: pool: [1*, 7*, 3*, 6*]\n";
+  std::cout << cache << std::endl;
+}
+
+// Threads mix pinned inserts and pinned lookups; the latter only take the
+// shard's lock in shared mode.
+void test2() {
+  using Cache_t =
+      ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                      ClockCache<uint32_t, uint32_t, ghash>>;
+  static_assert(Cache_t::LRUCache_t::kConcurrentLookup);
+  test_concurrent_pinned<Cache_t>(num_threads, num_ops);
+}
+
+void bench() {
+  bench_hit<LRUCache<uint32_t, uint32_t, ghash>>("LRUCache", num_ops);
+  bench_hit<ClockCache<uint32_t, uint32_t, ghash>>("ClockCache", num_ops);
+  bench_concurrent<ShardedLRUCache<uint32_t, uint32_t, ghash>>(
+      "Sharded LRU", num_threads, num_ops, /*pin*/ false);
+  bench_concurrent<ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                                   ClockCache<uint32_t, uint32_t, ghash>>>(
+      "Sharded Clock", num_threads, num_ops, /*pin*/ false);
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for thread-safety
+  bench();  // for performance
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "gcache/compact_lru_cache.h"
+#include "gcache/ghost_cache.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+static_assert(sizeof(LRUNode<uint32_t, GhostMeta>) == 40);
+static_assert(sizeof(CompactLRUNode<uint32_t, GhostMeta>) == 28);
+
+void test1() {
+  CompactLRUCache<uint32_t, uint32_t, idhash> cache;
+  cache.init(4);
+
+  for (uint32_t i = 0; i < 4; ++i) *cache.insert(i) = i * 111;
+  auto h = cache.insert(0, /*pin*/ true);  // refresh and pin 0
+  cache.insert(4);                         // evict 1
+  cache.lookup(2);                         // refresh 2
+  assert(cache.size() == 4);
+  std::cout << "Expect: lru: [3, 0, 4, 2]; in_use: []\n";
+  std::cout << cache << std::endl;
+
+  cache.release(h);
+  [[maybe_unused]] bool success = cache.erase(cache.lookup(3));
+  assert(success);
+  assert(cache.size() == 3);
+  assert(cache.capacity() == 3);
+  *cache.install(5) = 555;  // reuse the erased node
+  *cache.install(6) = 666;  // allocate from the arena
+  assert(cache.size() == 5);
+  assert(cache.capacity() == 5);
+  assert(*cache.lookup(6) == 666);
+  [[maybe_unused]] const auto ch = cache.lookup(5);
+  assert(*ch == 555);
+  std::cout << "Expect: lru: [0, 4, 2, 5, 6]; in_use: []\n";
+  std::cout << cache << std::endl;
+}
+
+// Cross-check CompactLRUCache against LRUCache with random operations,
+// including pin/release and erase/install on nodes from the arena
+void test2() {
+  LRUCache<uint32_t, uint32_t, ghash> cache;
+  CompactLRUCache<uint32_t, uint32_t, ghash> compact_cache;
+  cache.init(1000);
+  compact_cache.init(1000);
+
+  srand(0x537);
+  std::vector<std::pair<LRUCache<uint32_t, uint32_t, ghash>::Handle_t,
+                        CompactLRUCache<uint32_t, uint32_t, ghash>::Handle_t>>
+      pinned;
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    uint32_t key = rand() % 4000;
+    switch (rand() % 16) {
+      case 0: {  // pin
+        auto h1 = cache.insert(key, /*pin*/ true);
+        auto h2 = compact_cache.insert(key, /*pin*/ true);
+        if (bool(h1) != bool(h2))
+          throw std::runtime_error("Compact: pin mismatch!");
+        if (!h1) break;
+        *h1 = key;
+        *h2 = key;
+        pinned.emplace_back(h1, h2);
+        break;
+      }
+      case 1:  // release
+        if (pinned.empty()) break;
+        cache.release(pinned.back().first);
+        compact_cache.release(pinned.back().second);
+        pinned.pop_back();
+        break;
+      case 2: {  // erase/install
+        auto h1 = cache.lookup(key);
+        auto h2 = compact_cache.lookup(key);
+        if (bool(h1) != bool(h2))
+          throw std::runtime_error("Compact: lookup mismatch!");
+        if (h1 && cache.erase(h1) != compact_cache.erase(h2))
+          throw std::runtime_error("Compact: erase mismatch!");
+        bool exists = bool(cache.lookup(key + 4000));
+        if (exists != bool(compact_cache.lookup(key + 4000)))
+          throw std::runtime_error("Compact: lookup mismatch!");
+        if (!exists) {
+          *cache.install(key + 4000) = key;
+          *compact_cache.install(key + 4000) = key;
+        }
+        break;
+      }
+      default: {
+        auto h1 = cache.insert(key);
+        auto h2 = compact_cache.insert(key);
+        if (bool(h1) != bool(h2))
+          throw std::runtime_error("Compact: insert mismatch!");
+        if (h1) {
+          *h1 = key;
+          *h2 = key;
+        }
+      }
+    }
+    if (cache.size() != compact_cache.size() ||
+        cache.capacity() != compact_cache.capacity())
+      throw std::runtime_error("Compact: size mismatch!");
+  }
+
+  std::vector<uint32_t> keys1, keys2;
+  cache.for_each_lru([&keys1](LRUHandle<uint32_t, uint32_t> h) {
+    if (*h % 4000 != h.get_key() % 4000)
+      throw std::runtime_error("Compact: value corrupted!");
+    keys1.emplace_back(h.get_key());
+  });
+  compact_cache.for_each_lru([&keys2](CompactLRUHandle<uint32_t, uint32_t> h) {
+    if (*h % 4000 != h.get_key() % 4000)
+      throw std::runtime_error("Compact: value corrupted!");
+    keys2.emplace_back(h.get_key());
+  });
+  if (keys1 != keys2) throw std::runtime_error("Compact: LRU mismatch!");
+}
+
+// CompactGhostCache must produce exactly the same stat as GhostCache
+void test3() {
+  GhostCache<> ghost_cache(1000, 1000, 10000);
+  CompactGhostCache<> compact_ghost_cache(1000, 1000, 10000);
+  srand(0x564);
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    uint32_t block_id = rand() % 20000;
+    ghost_cache.access(block_id);
+    compact_ghost_cache.access(block_id);
+  }
+  for (uint32_t s = 1000; s <= 10000; s += 1000) {
+    if (ghost_cache.get_hit_rate(s) != compact_ghost_cache.get_hit_rate(s))
+      throw std::runtime_error("Compact: hit rate mismatch!");
+  }
+}
+
+void bench() {
+  constexpr uint32_t bench_size = 4 * 1024 * 1024;  // 16 GB cache
+  GhostCache<> ghost_cache(bench_size / 32, bench_size / 32, bench_size);
+  CompactGhostCache<> compact_ghost_cache(bench_size / 32, bench_size / 32,
+                                          bench_size);
+  std::vector<uint32_t> reqs;
+  for (uint32_t i = 0; i < 8 * num_ops; ++i)
+    reqs.emplace_back(rand() % (bench_size * 2));
+
+  uint64_t ts0 = rdtsc();
+  for (auto i : reqs) ghost_cache.access(i);
+  uint64_t ts1 = rdtsc();
+  for (auto i : reqs) compact_ghost_cache.access(i);
+  uint64_t ts2 = rdtsc();
+
+  std::cout << "GhostCache:        "
+            << sizeof(LRUNode<uint32_t, GhostMeta>) << " bytes/node, "
+            << (ts1 - ts0) / reqs.size() << " cycles/op\n";
+  std::cout << "CompactGhostCache: "
+            << sizeof(CompactLRUNode<uint32_t, GhostMeta>) << " bytes/node, "
+            << (ts2 - ts1) / reqs.size() << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for consistency with LRUCache
+  test3();  // for consistency with GhostCache
+  test_release_parked<CompactLRUCache<uint32_t, uint32_t, ghash>>();
+  bench();  // for performance
+  return 0;
+}
@@ -1,9 +1,14 @@
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
+#include "gcache/exact_ghost_cache.h"
 #include "gcache/ghost_cache.h"
 #include "gcache/node.h"
 #include "util.h"
@@ -158,6 +163,342 @@ void test3() {
   std::cout << std::endl;
 }
 
+// access_batch must produce exactly the same LRU order and stat as access
+template <typename Cache_t>
+void test_batch_impl(Cache_t& cache, Cache_t& batch_cache, uint32_t size) {
+  srand(0x537);
+  uint32_t block_ids[64];
+  for (int i = 0; i < 100000; ++i) {
+    size_t n = rand() % 64 + 1;
+    uint32_t begin = rand() % (size * 2);
+    for (size_t j = 0; j < n; ++j) block_ids[j] = begin + j;
+    for (size_t j = 0; j < n; ++j) cache.access(block_ids[j]);
+    batch_cache.access_batch(block_ids, n);
+  }
+  std::vector<uint32_t> keys1, keys2;
+  cache.for_each_lru([&keys1](uint32_t key) { keys1.emplace_back(key); });
+  batch_cache.for_each_lru([&keys2](uint32_t key) { keys2.emplace_back(key); });
+  if (keys1 != keys2) throw std::runtime_error("Batch: LRU mismatch!");
+  for (uint32_t s = cache.get_min_size(); s <= cache.get_max_size();
+       s += cache.get_tick()) {
+    if (cache.get_hit_rate(s) != batch_cache.get_hit_rate(s))
+      throw std::runtime_error("Batch: hit rate mismatch!");
+  }
+}
+
+void test4() {
+  GhostCache<> ghost_cache(1000, 1000, 10000);
+  GhostCache<> batch_ghost_cache(1000, 1000, 10000);
+  test_batch_impl(ghost_cache, batch_ghost_cache, 10000);
+
+  SampledGhostCache<sample_shift> sampled_ghost_cache(1024, 1024, 32768);
+  SampledGhostCache<sample_shift> batch_sampled_ghost_cache(1024, 1024, 32768);
+  test_batch_impl(sampled_ghost_cache, batch_sampled_ghost_cache, 32768);
+}
+
+// 64-bit block ids: ids equal in the low 32 bits must not alias, and sampling
+// must stay accurate on strided ids far beyond 2^32
+void test5() {
+  std::cout << "=== Test 5 ===\n";
+  GhostCache64<> ghost_cache(1, 3, 6);
+  constexpr uint64_t high = uint64_t{1} << 32;
+  for (uint64_t i = 0; i < 3; ++i) {
+    ghost_cache.access(i);
+    ghost_cache.access(i + high);
+  }
+  std::cout << "Ops: Access [0, 2^32, 1, 2^32+1, 2, 2^32+2]" << std::endl;
+  if (ghost_cache.get_stat(6).hit_cnt != 0)
+    throw std::runtime_error("GhostCache64: aliased block ids!");
+  ghost_cache.access(high);
+  if (ghost_cache.get_stat(5).hit_cnt != 1 ||
+      ghost_cache.get_stat(4).hit_cnt != 0)
+    throw std::runtime_error("GhostCache64: wrong reuse distance!");
+
+  // blocks are 1 MB apart starting at 1 PB, accessed uniformly at random
+  constexpr uint32_t size = 64 * 1024;
+  GhostCache64<> exact(size / 8, size / 8, size);
+  SampledGhostCache64<sample_shift> sampled(size / 8, size / 8, size);
+  constexpr uint64_t base = uint64_t{1} << 50;
+  uint32_t num_sampled = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    uint64_t blk_id = base + (uint64_t{i} << 20);
+    num_sampled += sampled.is_sampled(blk_id);
+  }
+  std::cout << "Sampled " << num_sampled << "/" << size << " blocks\n";
+  if (num_sampled < (size >> sample_shift) * 9 / 10 ||
+      num_sampled > (size >> sample_shift) * 11 / 10)
+    throw std::runtime_error("SampledGhostCache64: biased sampling!");
+  srand(0x537);
+  for (uint32_t i = 0; i < 16 * size; ++i) {
+    uint64_t blk_id = base + (uint64_t{rand() % (size * 2)} << 20);
+    exact.access(blk_id);
+    sampled.access(blk_id);
+  }
+  for (uint32_t s = size / 8; s <= size; s += size / 8) {
+    double diff = exact.get_hit_rate(s) - sampled.get_hit_rate(s);
+    if (diff > 0.02 || diff < -0.02)
+      throw std::runtime_error("SampledGhostCache64: inaccurate hit rate!");
+  }
+  std::cout << "Hit rate at " << size / 1024
+            << "K: w/o sampling=" << exact.get_hit_rate(size)
+            << ", w/ sampling=" << sampled.get_hit_rate(size) << "\n\n";
+}
+
+// sample_batch must select exactly the blocks is_sampled selects, in order
+template <typename Key_t>
+void test_sample_batch_impl() {
+  std::vector<Key_t> keys(1000);
+  for (auto& k : keys)
+    k = static_cast<Key_t>((uint64_t(rand()) << 40) ^ (uint64_t(rand()) << 8));
+  std::vector<Key_t> out(keys.size());
+  for (size_t n : {0, 1, 3, 4, 7, 8, 9, 15, 17, 100, 1000}) {
+    size_t m = sample_batch<sample_shift>(keys.data(), n, out.data());
+    std::vector<Key_t> expected;
+    for (size_t i = 0; i < n; ++i)
+      if (SampledGhostCache64<sample_shift>::is_sampled(keys[i]))
+        expected.emplace_back(keys[i]);
+    if (m != expected.size() ||
+        !std::equal(expected.begin(), expected.end(), out.begin()))
+      throw std::runtime_error("sample_batch: mismatch!");
+  }
+  // the runtime shift must select the same as the instance of the shift
+  using Runtime_t = SampledGhostCache64<kRuntimeSampleShift>;
+  for (uint32_t shift : {0, 1, 3, 5, 8}) {
+    size_t m = sample_batch(keys.data(), keys.size(), out.data(), shift);
+    size_t k = 0;
+    for (auto key : keys)
+      if (Runtime_t::is_sampled(key, shift) && (k >= m || out[k++] != key))
+        throw std::runtime_error("sample_batch: runtime shift mismatch!");
+    if (k != m) throw std::runtime_error("sample_batch: runtime shift count!");
+  }
+}
+
+void test6() {
+  srand(0x537);
+  test_sample_batch_impl<uint32_t>();
+  test_sample_batch_impl<uint64_t>();
+
+  GhostCache64<> ghost_cache(1, 2, 4);
+  SampledGhostCache64<0> unsampled(1, 2, 4);
+  uint64_t block_ids[] = {1, 2, 3, 1, 4, 2};
+  unsampled.access_batch(block_ids, 6);
+  for (auto b : block_ids) ghost_cache.access(b);
+  for (uint32_t s = 2; s <= 4; ++s) {
+    if (ghost_cache.get_hit_rate(s) != unsampled.get_hit_rate(s))
+      throw std::runtime_error("SampleShift=0: hit rate mismatch!");
+  }
+}
+
+// A loaded ghost cache must continue exactly as the saved one: same LRU order,
+// boundaries, and stat, before and after more accesses
+template <typename Cache_t>
+void test_snapshot_impl(uint32_t tick, uint32_t min_size, uint32_t max_size) {
+  const char* path = "test_ghost.snapshot";
+  Cache_t cache(tick, min_size, max_size);
+  Cache_t cache2(tick, min_size, max_size);
+  srand(0x537);
+  for (uint32_t i = 0; i < max_size * 4; ++i) cache.access(rand() % max_size);
+  if (!cache.save(path) || !cache2.load(path))
+    throw std::runtime_error("Snapshot: save/load failed!");
+  for (int round = 0; round < 2; ++round) {
+    std::vector<uint32_t> keys1, keys2;
+    cache.for_each_lru([&keys1](uint32_t key) { keys1.emplace_back(key); });
+    cache2.for_each_lru([&keys2](uint32_t key) { keys2.emplace_back(key); });
+    if (keys1 != keys2) throw std::runtime_error("Snapshot: LRU mismatch!");
+    for (uint32_t s = min_size; s <= max_size; s += tick) {
+      if (cache.get_stat(s).hit_cnt != cache2.get_stat(s).hit_cnt ||
+          cache.get_stat(s).miss_cnt != cache2.get_stat(s).miss_cnt)
+        throw std::runtime_error("Snapshot: stat mismatch!");
+    }
+    // boundaries must be restored to keep the stat in sync
+    for (uint32_t i = 0; i < max_size * 4; ++i) {
+      uint32_t block_id = rand() % (max_size * 2);
+      cache.access(block_id);
+      cache2.access(block_id);
+    }
+  }
+  if (cache2.load(path)) throw std::runtime_error("Snapshot: non-empty!");
+  Cache_t cache3(tick, min_size, max_size + tick);
+  if (cache3.load(path)) throw std::runtime_error("Snapshot: bad config!");
+  std::remove(path);
+}
+
+void test7() {
+  test_snapshot_impl<GhostCache<>>(1, 3, 6);
+  test_snapshot_impl<GhostCache<>>(1000, 1000, 10000);
+  test_snapshot_impl<CompactGhostCache<>>(1000, 1000, 10000);
+  test_snapshot_impl<SampledGhostCache<sample_shift>>(1024, 1024, 32768);
+
+  // partially filled: some boundaries are not set yet
+  const char* path = "test_ghost.snapshot";
+  GhostCache<> ghost_cache(1, 3, 6);
+  GhostCache<> ghost_cache2(1, 3, 6);
+  for (uint32_t i = 0; i < 4; ++i) ghost_cache.access(i);
+  ghost_cache.access(1);
+  if (!ghost_cache.save(path) || !ghost_cache2.load(path))
+    throw std::runtime_error("Snapshot: save/load failed!");
+  std::remove(path);
+  std::cout << "=== Test 7 ===\n";
+  std::cout << "Expect: LRU: [0, 2, 3, 1]; Boundaries: [2, 0, (null)]; "
+               "Stat: [1/5, 1/5, 1/5, 1/5]\n";
+  std::cout << ghost_cache2 << std::endl;
+  ghost_cache.access(4);
+  ghost_cache2.access(4);
+  ghost_cache.access(0);
+  ghost_cache2.access(0);
+  for (uint32_t s = 3; s <= 6; ++s) {
+    if (ghost_cache.get_hit_rate(s) != ghost_cache2.get_hit_rate(s))
+      throw std::runtime_error("Snapshot: stat mismatch!");
+  }
+}
+
+// ExactGhostCache must agree with a GhostCache of tick 1 at every size (over
+// many renumberings), and with a coarser one on its grid.
+void test8() {
+  std::cout << "=== Test 8 ===\n";
+  constexpr uint32_t size = 1024;
+  ExactGhostCache<> exact(size);
+  GhostCache<> ghost(1, 2, size);
+  GhostCache<> coarse(size / 16, size / 16, size);
+  srand(0x537);
+  for (uint32_t i = 0; i < size * 16; ++i) {
+    // half of the blocks from a hot set, so distances spread over all sizes
+    uint32_t block_id = rand() % 2 ? rand() % (size / 8) : rand() % (size * 2);
+    AccessMode mode = i % 97 == 0   ? AccessMode::AS_HIT
+                      : i % 89 == 0 ? AccessMode::AS_MISS
+                      : i % 83 == 0 ? AccessMode::NOOP
+                                    : AccessMode::DEFAULT;
+    exact.access(block_id, mode);
+    ghost.access(block_id, mode);
+    coarse.access(block_id, mode);
+  }
+  for (uint32_t s = 2; s <= size; ++s) {
+    auto stat = exact.get_stat(s);
+    auto& expected = ghost.get_stat(s);
+    if (stat.hit_cnt != expected.hit_cnt || stat.miss_cnt != expected.miss_cnt)
+      throw std::runtime_error("Exact: stat mismatch with GhostCache!");
+  }
+  auto stats = exact.get_stats(size / 16, size / 16, size);
+  for (uint32_t i = 0; i < stats.size(); ++i) {
+    auto& expected = coarse.get_stat(size / 16 * (i + 1));
+    if (stats[i].hit_cnt != expected.hit_cnt ||
+        stats[i].miss_cnt != expected.miss_cnt)
+      throw std::runtime_error("Exact: stat mismatch on a coarse grid!");
+  }
+  std::vector<uint32_t> keys, expected_keys;
+  exact.for_each_lru([&keys](uint32_t key) { keys.emplace_back(key); });
+  ghost.for_each_lru(
+      [&expected_keys](uint32_t key) { expected_keys.emplace_back(key); });
+  if (keys != expected_keys)
+    throw std::runtime_error("Exact: LRU mismatch with GhostCache!");
+  std::cout << "Exact: hit rate " << exact.get_hit_rate(size / 2) << " at "
+            << size / 2 << ", " << exact.get_hit_rate(size) << " at " << size
+            << std::endl;
+}
+
+// With a fixed runtime shift, it must behave exactly as the constant one, and
+// so does its access_batch.
+void test9() {
+  constexpr auto kRuntime = kRuntimeSampleShift;
+  SampledGhostCache<sample_shift> constant(1024, 1024, 32768);
+  SampledGhostCache<kRuntime> runtime(1024, 1024, 32768, sample_shift);
+  srand(0x537);
+  for (uint32_t i = 0; i < 32768 * 16; ++i) {
+    uint32_t block_id = rand() % 65536;
+    constant.access(block_id);
+    runtime.access(block_id);
+  }
+  for (uint32_t s = 1024; s <= 32768; s += 1024) {
+    if (constant.get_hit_rate(s) != runtime.get_hit_rate(s))
+      throw std::runtime_error("Runtime shift: hit rate mismatch!");
+  }
+  SampledGhostCache<kRuntime> batch_runtime(1024, 1024, 32768, sample_shift);
+  SampledGhostCache<kRuntime> runtime2(1024, 1024, 32768, sample_shift);
+  test_batch_impl(runtime2, batch_runtime, 32768);
+}
+
+// Adaptive sampling keeps the tracked blocks within the budget by lowering
+// the rate, while the hit rates stay close to the unsampled ones.
+void test10() {
+  std::cout << "=== Test 10 ===\n";
+  constexpr uint32_t max_size = 32768, max_tracked = 1024;
+  GhostCache<> ghost(1024, 1024, max_size);
+  SampledGhostCache<kRuntimeSampleShift> adaptive(1024, 1024, max_size, 0,
+                                                  max_tracked);
+  srand(0x537);
+  for (uint32_t i = 0; i < max_size * 64; ++i) {
+    // 3 in 4 accesses to a hot set, so the curve is not a straight line
+    uint32_t block_id = rand() % 4 ? rand() % (max_size / 2) : rand();
+    ghost.access(block_id);
+    adaptive.access(block_id);
+    if (adaptive.size() > max_tracked)
+      throw std::runtime_error("Adaptive: over the budget!");
+  }
+  if (adaptive.get_sample_shift() == 0)
+    throw std::runtime_error("Adaptive: sample rate not lowered!");
+  double max_err = 0;
+  for (uint32_t s = 1024; s <= max_size; s += 1024)
+    max_err = std::max(
+        max_err, std::abs(ghost.get_hit_rate(s) - adaptive.get_hit_rate(s)));
+  std::cout << "Adaptive: sample_shift=" << adaptive.get_sample_shift()
+            << ", tracked=" << adaptive.size()
+            << ", max_err=" << std::setprecision(4) << max_err
+            << std::endl;
+  if (max_err > 0.03) throw std::runtime_error("Adaptive: hit rate error!");
+}
+
+// A non-uniform grid must report the exact stats at each of its sizes, with
+// or without sampling, and survive a snapshot.
+void test11() {
+  std::cout << "=== Test 11 ===\n";
+  constexpr uint32_t max_size = 32768;
+  // aligned to the sample rate, so the sampled caches share the grid
+  auto sizes = log_sizes(1024, max_size, 16, 1 << sample_shift);
+  GhostCache<> ghost(sizes);
+  ExactGhostCache<> exact(max_size);
+  SampledGhostCache<sample_shift> sampled(sizes);
+  SampledGhostCache<kRuntimeSampleShift> runtime(sizes, sample_shift);
+  if (ghost.get_tick() != 0 || ghost.get_sizes() != sizes ||
+      sampled.get_sizes() != sizes || runtime.get_sizes() != sizes)
+    throw std::runtime_error("Grid: wrong sizes!");
+  srand(0x537);
+  for (uint32_t i = 0; i < max_size * 16; ++i) {
+    uint32_t block_id =
+        rand() % 2 ? rand() % (max_size / 8) : rand() % (max_size * 2);
+    ghost.access(block_id);
+    exact.access(block_id);
+    sampled.access(block_id);
+    runtime.access(block_id);
+  }
+  auto stats = exact.get_stats(sizes);
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    auto& stat = ghost.get_stat(sizes[i]);
+    if (stat.hit_cnt != stats[i].hit_cnt || stat.miss_cnt != stats[i].miss_cnt)
+      throw std::runtime_error("Grid: stat mismatch with ExactGhostCache!");
+    if (sampled.get_hit_rate(sizes[i]) != runtime.get_hit_rate(sizes[i]))
+      throw std::runtime_error("Grid: sampled hit rate mismatch!");
+  }
+
+  const char* path = "test_ghost.snapshot";
+  GhostCache<> ghost2(sizes);
+  GhostCache<> uniform(1024, 1024, max_size);
+  if (!ghost.save(path) || !ghost2.load(path) || uniform.load(path))
+    throw std::runtime_error("Grid: snapshot failed!");
+  std::remove(path);
+  for (auto s : sizes) {
+    if (ghost.get_hit_rate(s) != ghost2.get_hit_rate(s))
+      throw std::runtime_error("Grid: snapshot stat mismatch!");
+  }
+
+  std::cout << "Sizes:     [" << sizes[0];
+  for (size_t i = 1; i < sizes.size(); ++i) std::cout << ", " << sizes[i];
+  std::cout << "]\nHit rate:  [" << std::setprecision(3)
+            << ghost.get_hit_rate(sizes[0]);
+  for (size_t i = 1; i < sizes.size(); ++i)
+    std::cout << ", " << ghost.get_hit_rate(sizes[i]);
+  std::cout << "]\n" << std::endl;
+}
+
 void bench1() {
   GhostCache<> ghost_cache(bench_size / 32, bench_size / 32, bench_size);
 
@@ -380,14 +721,127 @@ void bench5() {
   std::cout << std::endl;
 }
 
+// per-block cost of sampling: filtering alone, and a sampled ghost cache one
+// block at a time vs in batches
+void bench6() {
+  std::vector<uint64_t> reqs;
+  for (uint32_t i = 0; i < num_ops / 4; ++i)
+    reqs.emplace_back(rand() % large_bench_size);
+  std::vector<uint64_t> sampled(reqs.size());
+  SampledGhostCache64<sample_shift> sampled_ghost_cache(
+      large_bench_size / 32, large_bench_size / 32, large_bench_size);
+  SampledGhostCache64<sample_shift> batch_ghost_cache(
+      large_bench_size / 32, large_bench_size / 32, large_bench_size);
+
+  uint64_t ts0 = rdtsc();
+  size_t m1 = 0;
+  for (auto i : reqs)
+    if (SampledGhostCache64<sample_shift>::is_sampled(i)) sampled[m1++] = i;
+  uint64_t ts1 = rdtsc();
+  size_t m2 = sample_batch<sample_shift>(reqs.data(), reqs.size(),
+                                         sampled.data());
+  uint64_t ts2 = rdtsc();
+  if (m1 != m2) throw std::runtime_error("Bench 6: sample count mismatch!");
+
+  for (auto i : reqs) sampled_ghost_cache.access(i);
+  uint64_t ts3 = rdtsc();
+  for (size_t i = 0; i < reqs.size(); i += 4096)
+    batch_ghost_cache.access_batch(reqs.data() + i,
+                                   std::min<size_t>(reqs.size() - i, 4096));
+  uint64_t ts4 = rdtsc();
+  SampledGhostCache64<kRuntimeSampleShift> runtime_ghost_cache(
+      large_bench_size / 32, large_bench_size / 32, large_bench_size,
+      sample_shift);
+  for (auto i : reqs) runtime_ghost_cache.access(i);
+  uint64_t ts5 = rdtsc();
+  for (uint32_t s = large_bench_size / 32; s <= large_bench_size;
+       s += large_bench_size / 32) {
+    if (sampled_ghost_cache.get_hit_rate(s) !=
+            batch_ghost_cache.get_hit_rate(s) ||
+        sampled_ghost_cache.get_hit_rate(s) !=
+            runtime_ghost_cache.get_hit_rate(s))
+      throw std::runtime_error("Bench 6: hit rate mismatch!");
+  }
+
+  std::cout << "=== Bench 6 ===\n";
+  std::cout << "Filter (is_sampled):   " << double(ts1 - ts0) / reqs.size()
+            << " cycles/block\n";
+  std::cout << "Filter (sample_batch): " << double(ts2 - ts1) / reqs.size()
+            << " cycles/block\n";
+  std::cout << "access:                " << double(ts3 - ts2) / reqs.size()
+            << " cycles/block\n";
+  std::cout << "access_batch:          " << double(ts4 - ts3) / reqs.size()
+            << " cycles/block\n";
+  std::cout << "access (runtime shift): " << double(ts5 - ts4) / reqs.size()
+            << " cycles/block\n";
+  std::cout << std::endl;
+}
+
+// exact stack distances vs boundaries: the cost of GhostCache grows with the
+// number of ticks, while ExactGhostCache is O(log n) at any resolution
+void bench7() {
+  std::vector<uint32_t> reqs;
+  for (uint32_t i = 0; i < num_ops / 8; ++i)
+    reqs.emplace_back(rand() % bench_size);
+  auto run = [&reqs]<typename Cache_t>(Cache_t& cache) {
+    for (uint32_t i = 0; i < bench_size; ++i) cache.access(i);
+    uint64_t ts0 = rdtsc();
+    for (auto i : reqs) cache.access(i);
+    return (rdtsc() - ts0) / reqs.size();
+  };
+  GhostCache<> ghost32(bench_size / 32, bench_size / 32, bench_size);
+  GhostCache<> ghost128(bench_size / 128, bench_size / 128, bench_size);
+  ExactGhostCache<> exact(bench_size);
+
+  std::cout << "=== Bench 7 ===\n";
+  std::cout << "GhostCache (32 ticks):  " << run(ghost32) << " cycles/op\n";
+  std::cout << "GhostCache (128 ticks): " << run(ghost128) << " cycles/op\n";
+  std::cout << "ExactGhostCache:        " << run(exact) << " cycles/op\n";
+  std::cout << std::endl;
+}
+
+// a fine resolution at small sizes: an even grid needs many ticks, while a
+// log grid covers the same range with far fewer boundaries to move
+void bench8() {
+  std::vector<uint32_t> reqs;
+  for (uint32_t i = 0; i < num_ops / 32; ++i)
+    reqs.emplace_back(rand() % bench_size);
+  auto run = [&reqs]<typename Cache_t>(Cache_t& cache) {
+    for (uint32_t i = 0; i < bench_size; ++i) cache.access(i);
+    uint64_t ts0 = rdtsc();
+    for (auto i : reqs) cache.access(i);
+    return (rdtsc() - ts0) / reqs.size();
+  };
+  GhostCache<> linear(bench_size / 1024, bench_size / 1024, bench_size);
+  GhostCache<> log(log_sizes(bench_size / 1024, bench_size, 64));
+
+  std::cout << "=== Bench 8 ===\n";
+  std::cout << "GhostCache (1024 even sizes): " << run(linear)
+            << " cycles/op\n";
+  std::cout << "GhostCache (" << log.get_sizes().size()
+            << " log sizes):   " << run(log) << " cycles/op\n";
+  std::cout << std::endl;
+}
+
 int main() {
   test1();
   test2();
   test3();   // test checkpoint and recover
+  test4();   // test batched access
+  test5();   // test 64-bit block ids
+  test6();   // test batched sampling
+  test7();   // test snapshot save/load
+  test8();   // test exact stack distances
+  test9();   // test runtime sample shift
+  test10();  // test adaptive sampling
+  test11();  // test non-uniform sizes
   bench1();  // ghost cache w/o sampling
   bench2();  // ghost cache w/ sampling
   bench3();  // hit rate comparsion
   bench4();  // large bench: may exceed CPU cache size
   bench5();  // real random access
+  bench6();  // batched sampling
+  bench7();  // exact vs boundaries
+  bench8();  // even vs log sizes
   return 0;
 }
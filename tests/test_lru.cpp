@@ -1,11 +1,17 @@
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <ostream>
 #include <stdexcept>
+#include <vector>
 
+#include "gcache/alloc.h"
+#include "gcache/flat_table.h"
+#include "gcache/hash.h"
 #include "gcache/lru_cache.h"
-#include "util.h"
+#include "policy_util.h"
 
 using namespace gcache;
 
@@ -39,13 +45,13 @@ void test() {
   assert(h4);
   assert(cache.size() == 4);
   *h1 = 444;
-  std::cout << "=== Expect: lru: [4], in_use: [1, 2, 3] ===\n";
+  std::cout << "=== Expect: lru: [1, 2, 3, 4], in_use: [] ===\n";
   std::cout << cache;
 
   h4 = cache.lookup(4, true);
   *h4 = 4444;
   assert(cache.size() == 4);
-  std::cout << "=== Expect: lru: [], in_use: [1, 2, 3, 4] ===\n";
+  std::cout << "=== Expect: lru: [1, 2, 3, 4], in_use: [] ===\n";
   std::cout << cache;
 
   auto h5 = cache.insert(5, true);
@@ -58,14 +64,14 @@ void test() {
   assert(h5);
   assert(cache.size() == 4);
   *h5 = 555;
-  std::cout << "\n=== Expect: in_use: [1, 2, 4, 5] ===\n";
+  std::cout << "\n=== Expect: lru: [5], in_use: [1, 2, 4] ===\n";
   std::cout << cache;
 
   cache.release(h5);
   cache.release(h2);
   cache.release(h4);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [5, 2, 4], in_use: [1] ===\n";
+  std::cout << "\n=== Expect: lru: [5], in_use: [1, 2, 4] ===\n";
   std::cout << cache;
 
   h3 = cache.insert(3, true);
@@ -74,33 +80,33 @@ void test() {
   *h3 = 3333;
   h5 = cache.lookup(5, true);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [2, 4], in_use: [1, 3] ===\n";
+  std::cout << "\n=== Expect: lru: [2, 4, 3], in_use: [1] ===\n";
   std::cout << cache;
   if (h5 != nullptr)
     throw std::runtime_error("Expected evicted handle remains in cache!");
 
   h5 = cache.insert(5, true);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [4], in_use: [1, 3, 5] ===\n";
+  std::cout << "\n=== Expect: lru: [4, 3, 5], in_use: [1] ===\n";
   std::cout << cache;
 
   auto h6 = cache.insert(6, true);
   assert(h6);
   assert(cache.size() == 4);
   *h6 = 666;
-  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 5, 6] ===\n";
+  std::cout << "\n=== Expect: lru: [3, 5, 6], in_use: [1] ===\n";
   std::cout << cache;
 
   auto h5_ = cache.insert(5, true);
   assert(h5_ == h5);
   assert(cache.size() == 4);
   *h5_ = 555;
-  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 5, 6] ===\n";
+  std::cout << "\n=== Expect: lru: [3, 6, 5], in_use: [1] ===\n";
   std::cout << cache;
 
   auto h7 = cache.insert(7, true);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 5, 6] ===\n";
+  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 6, 5] ===\n";
   std::cout << cache;
   if (h7) throw std::runtime_error("Overflow handle is not denied!");
 
@@ -109,12 +115,13 @@ void test() {
   cache.release(h5);
   cache.release(h6);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [1, 3, 6], in_use: [5] ===\n";
+  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 6, 5] ===\n";
   std::cout << cache;
 
   cache.release(h5_);
   assert(cache.size() == 4);
-  std::cout << "\n=== Expect: lru: [1, 3, 6, 5], in_use: [] ===\n";
+  // release is lock-free, so released nodes rejoin lru on the next eviction
+  std::cout << "\n=== Expect: lru: [], in_use: [1, 3, 6, 5] ===\n";
   std::cout << cache;
 
   h7 = cache.lookup(7);
@@ -138,7 +145,7 @@ void test() {
   h6 = cache.lookup(6, true);
   assert(h6);
   assert(cache.size() == 3);
-  std::cout << "\n=== Expect: lru: [3, 5], in_use: [6] ===\n";
+  std::cout << "\n=== Expect: lru: [3, 5, 6], in_use: [] ===\n";
   std::cout << cache;
   success = cache.erase(h6);
   if (success) throw std::runtime_error("Erase in-use handle is not denied!");
@@ -146,7 +153,7 @@ void test() {
   auto h8 = cache.insert(8);
   *h8 = 888;
   assert(cache.size() == 3);
-  std::cout << "\n=== Expect: lru: [5, 8], in_use: [6] ===\n";
+  std::cout << "\n=== Expect: lru: [5, 6, 8], in_use: [] ===\n";
   std::cout << cache;
 
   auto h9 = cache.install(9);
@@ -154,11 +161,11 @@ void test() {
   assert(cache.size() == 4);
   assert(cache.capacity() == 4);
   *h9 = 999;
-  std::cout << "\n=== Expect: lru: [5, 8, 9], in_use: [6] ===\n";
+  std::cout << "\n=== Expect: lru: [5, 6, 8, 9], in_use: [] ===\n";
   std::cout << cache;
 
   // test for_each
-  std::cout << "\n=== Expect: { 5: 555, 8: 888, 9: 999, 6: 666, } ===\n";
+  std::cout << "\n=== Expect: { 5: 555, 6: 666, 8: 888, 9: 999, } ===\n";
   std::cout << "{ ";
   cache.for_each([](LRUCache<uint32_t, uint32_t, hash1>::Handle_t h) {
     std::cout << h.get_key() << ": " << *h << ", ";
@@ -181,14 +188,281 @@ void test() {
     *h = value;
     cache_recovered.release(h);
   }
-  std::cout << "\n=== Expect: { 5: 555, 8: 888, 9: 999, 6: 666, } ===\n";
+  std::cout << "\n=== Expect: { 5: 555, 6: 666, 8: 888, 9: 999, } ===\n";
   std::cout << cache_recovered;
 
   std::cout << std::flush;
 }
 
+// Cross-check FlatNodeTable against NodeTable: both must produce exactly the
+// same LRU behavior
+void test_flat_table() {
+  LRUCache<uint32_t, uint32_t, ghash> cache;
+  LRUCache<uint32_t, uint32_t, ghash, FlatNodeTable> flat_cache;
+  cache.init(1000);
+  flat_cache.init(1000);
+
+  srand(0x537);
+  std::vector<LRUCache<uint32_t, uint32_t, ghash>::Handle_t> erased;
+  for (int i = 0; i < 1000000; ++i) {
+    uint32_t key = rand() % 4000;
+    auto h1 = cache.insert(key);
+    auto h2 = flat_cache.insert(key);
+    assert(h1 && h2);
+    *h1 = key;
+    *h2 = key;
+    if (i % 1000 == 0) {  // exercise erase/install to trigger rehash
+      auto e1 = cache.lookup(key);
+      auto e2 = flat_cache.lookup(key);
+      cache.erase(e1);
+      flat_cache.erase(e2);
+    } else if (i % 1000 == 500) {
+      cache.install(key + 4000);
+      flat_cache.install(key + 4000);
+    }
+    if (cache.size() != flat_cache.size())
+      throw std::runtime_error("FlatNodeTable: size mismatch!");
+  }
+  std::vector<uint32_t> keys1, keys2;
+  cache.for_each_lru([&keys1](LRUHandle<uint32_t, uint32_t> h) {
+    keys1.emplace_back(h.get_key());
+  });
+  flat_cache.for_each_lru([&keys2](LRUHandle<uint32_t, uint32_t> h) {
+    keys2.emplace_back(h.get_key());
+  });
+  if (keys1 != keys2) throw std::runtime_error("FlatNodeTable: LRU mismatch!");
+  for (uint32_t key = 0; key < 8000; ++key) {
+    if (bool(cache.lookup(key)) != bool(flat_cache.lookup(key)))
+      throw std::runtime_error("FlatNodeTable: lookup mismatch!");
+  }
+}
+
+// Batched APIs must behave exactly the same as calling the scalar ones in order
+void test_batch() {
+  using Cache_t = LRUCache<uint32_t, uint32_t, ghash>;
+  Cache_t cache, batch_cache;
+  cache.init(1000);
+  batch_cache.init(1000);
+
+  srand(0x564);
+  uint32_t keys[64];
+  Cache_t::Handle_t handles[64];
+  for (int i = 0; i < 20000; ++i) {
+    size_t n = rand() % 64 + 1;
+    for (size_t j = 0; j < n; ++j) keys[j] = rand() % 2000;
+    if (i % 2) {
+      batch_cache.insert_batch(keys, n, handles);
+      for (size_t j = 0; j < n; ++j) {
+        auto h = cache.insert(keys[j]);
+        *h = keys[j];
+        *handles[j] = keys[j];
+      }
+    } else {
+      batch_cache.lookup_batch(keys, n, handles);
+      for (size_t j = 0; j < n; ++j) {
+        auto h = cache.lookup(keys[j]);
+        if (bool(h) != bool(handles[j]) || (h && *handles[j] != keys[j]))
+          throw std::runtime_error("Batch: lookup mismatch!");
+      }
+    }
+  }
+  std::vector<uint32_t> keys1, keys2;
+  cache.for_each_lru([&keys1](LRUHandle<uint32_t, uint32_t> h) {
+    keys1.emplace_back(h.get_key());
+  });
+  batch_cache.for_each_lru([&keys2](LRUHandle<uint32_t, uint32_t> h) {
+    keys2.emplace_back(h.get_key());
+  });
+  if (keys1 != keys2) throw std::runtime_error("Batch: LRU mismatch!");
+}
+
+template <typename Cache_t>
+std::vector<uint32_t> lru_keys(const Cache_t& cache) {
+  std::vector<uint32_t> keys;
+  cache.for_each_lru([&keys](typename Cache_t::Handle_t h) {
+    keys.emplace_back(h.get_key());
+  });
+  return keys;
+}
+
+// A loaded cache must have the same keys in the same LRU order; a smaller
+// cache keeps the most recently used ones.
+void test_snapshot() {
+  using Cache_t = LRUCache<uint32_t, uint32_t, ghash>;
+  const char* path = "test_lru.snapshot";
+  Cache_t cache;
+  cache.init(1000);
+  srand(0x537);
+  for (int i = 0; i < 5000; ++i) cache.insert(rand() % 2000);
+  auto h = cache.lookup(lru_keys(cache)[0], /*pin*/ true);
+  for (uint32_t i = 2000; i < 3000; ++i) cache.insert(i);  // h is in use
+  if (!cache.save(path)) throw std::runtime_error("Snapshot: save failed!");
+  std::vector<uint32_t> keys = lru_keys(cache);
+  keys.insert(keys.begin(), h.get_key());  // in-use ones come first
+  cache.release(h);
+
+  Cache_t cache2;
+  cache2.init(1000);
+  if (!cache2.load(path) || cache2.size() != 1000 || lru_keys(cache2) != keys)
+    throw std::runtime_error("Snapshot: LRU mismatch!");
+  for (auto k : keys)
+    if (!cache2.lookup(k)) throw std::runtime_error("Snapshot: key missing!");
+  if (cache2.load(path))
+    throw std::runtime_error("Snapshot: loaded into non-empty cache!");
+
+  Cache_t small_cache;
+  small_cache.init(100);
+  if (!small_cache.load(path) ||
+      lru_keys(small_cache) != std::vector(keys.end() - 100, keys.end()))
+    throw std::runtime_error("Snapshot: wrong keys kept!");
+  small_cache.insert(5000);
+  if (small_cache.size() != 100 || small_cache.lookup(keys[900]))
+    throw std::runtime_error("Snapshot: wrong eviction after load!");
+
+  LRUCache<uint64_t, uint32_t, ghash64> cache64;
+  cache64.init(1000);
+  if (cache64.load(path)) throw std::runtime_error("Snapshot: key mismatch!");
+  if (cache64.load("nonexistent.snapshot"))
+    throw std::runtime_error("Snapshot: loaded nonexistent file!");
+  std::remove(path);
+}
+
+struct Object {
+  uint32_t charge;  // size in bytes
+  char* data;
+};
+
+// Objects of mixed sizes: the usage never exceeds the budget, no matter how
+// many nodes are free.
+void test_charge() {
+  using Cache_t = LRUCache<uint32_t, Object, idhash>;
+  static_assert(Cache_t::kCharged);
+  static_assert(!LRUCache<uint32_t, uint32_t, idhash>::kCharged);
+  Cache_t cache;
+  cache.init(8);
+  cache.set_budget(100);
+  cache.insert_charged(1, 40);
+  cache.insert_charged(2, 40);
+  cache.insert_charged(3, 30);  // evict 1
+  cache.lookup(2);
+  cache.insert_charged(4, 50);  // evict 3
+  if (cache.lookup(1) || cache.lookup(3) || cache.usage() != 90)
+    throw std::runtime_error("Charge: wrong eviction!");
+  auto h = cache.lookup(2, /*pin*/ true);
+  cache.insert_charged(5, 60);  // evict 4 but not the pinned 2
+  cache.insert_charged(5, 10);  // update the charge
+  if (cache.usage() != 50 || cache.size() != 2)
+    throw std::runtime_error("Charge: wrong usage!");
+  // 5 cannot grow to 70, as 2 is pinned; it keeps its charge
+  if (cache.insert_charged(5, 70) || cache.usage() != 50 ||
+      cache.lookup(5)->charge != 10)
+    throw std::runtime_error("Charge: grown over budget!");
+  if (cache.insert_charged(6, 101) || cache.size() != 2)
+    throw std::runtime_error("Charge: larger than budget!");
+  cache.release(h);
+  cache.set_budget(20);  // evict 2
+  std::cout << "Expect: lru: [5], usage=10\n";
+  std::cout << cache << std::endl;
+
+  // 512 B to 1 MB, log-uniform
+  constexpr size_t budget = 64 * 1024 * 1024;
+  Cache_t big_cache;
+  big_cache.init(4096);
+  big_cache.set_budget(budget);
+  srand(0x537);
+  for (int i = 0; i < 100000; ++i) {
+    uint32_t charge = (512u << (rand() % 11)) + rand() % 512;
+    if (!big_cache.insert_charged(rand() % 10000, charge))
+      throw std::runtime_error("Charge: insert failed!");
+    if (big_cache.usage() > budget)
+      throw std::runtime_error("Charge: over budget!");
+  }
+  size_t usage = 0;
+  big_cache.for_each([&usage](Cache_t::Handle_t h) { usage += h->charge; });
+  if (usage != big_cache.usage())
+    throw std::runtime_error("Charge: usage mismatch!");
+  std::cout << "Charge: " << big_cache.size() << " objects in "
+            << big_cache.usage() << "/" << budget << " bytes\n";
+}
+
+// Install far beyond the capacity so that NodeTable must grow, and then erase
+// most of them so that it must shrink; all lookups must stay correct while
+// the table is being resized.
+template <template <typename, typename, typename> class Table>
+void test_resize() {
+  LRUCache<uint32_t, uint32_t, ghash, Table> cache;
+  cache.init(1000);
+  for (uint32_t i = 0; i < 1000; ++i) *cache.insert(i) = i;
+  for (uint32_t i = 1000; i < 100000; ++i) {
+    *cache.install(i) = i;
+    if (i % 997 == 0) {  // check a few keys in the middle of resizing
+      for (uint32_t k = 0; k <= i; k += 101) {
+        auto h = cache.lookup(k);
+        if (!h || *h != k) throw std::runtime_error("Resize: lookup failed!");
+      }
+    }
+  }
+  if (cache.size() != 100000) throw std::runtime_error("Resize: size error!");
+
+  for (uint32_t i = 0; i < 99500; ++i) {
+    auto h = cache.lookup(i);
+    if (!h || !cache.erase(h))
+      throw std::runtime_error("Resize: erase failed!");
+    if (i % 997 == 0) {
+      if (cache.lookup(i)) throw std::runtime_error("Resize: erased found!");
+      for (uint32_t k = i + 1; k < 100000; k += 101) {
+        auto h = cache.lookup(k);
+        if (!h || *h != k) throw std::runtime_error("Resize: lookup failed!");
+      }
+    }
+  }
+  if (cache.size() != 500) throw std::runtime_error("Resize: size error!");
+  for (uint32_t i = 99500; i < 100000; ++i) {
+    auto h = cache.lookup(i);
+    if (!h || *h != i) throw std::runtime_error("Resize: lookup failed!");
+  }
+}
+
+// The pool and the table are large enough to be mmap-ed; cross-check against
+// a heap-allocated cache, including installs that make the table grow. The
+// hugetlb pool is usually empty, which exercises the fallback to THP.
+template <template <typename, typename, typename> class Table, typename Alloc>
+void test_alloc() {
+  constexpr uint32_t capacity = 256 * 1024;
+  LRUCache<uint32_t, uint32_t, ghash, Table> cache;
+  LRUCache<uint32_t, uint32_t, ghash, Table, Alloc> mmap_cache;
+  cache.init(capacity);
+  mmap_cache.init(capacity);
+
+  uint32_t* arr = Alloc::template allocate<uint32_t>(capacity * 4);
+  if (reinterpret_cast<uintptr_t>(arr) % (2 << 20) != 0)
+    throw std::runtime_error("Alloc: not aligned to huge page!");
+  for (uint32_t i = 0; i < capacity * 4; ++i) arr[i] = i;
+  Alloc::deallocate(arr, capacity * 4);
+
+  srand(0x537);
+  for (uint32_t i = 0; i < 4 * capacity; ++i) {
+    uint32_t key = rand() % (2 * capacity);
+    auto h1 = cache.lookup(key);
+    auto h2 = mmap_cache.lookup(key);
+    if (bool(h1) != bool(h2)) throw std::runtime_error("Alloc: hit mismatch!");
+    if (h1) {
+      if (*h1 != *h2) throw std::runtime_error("Alloc: value mismatch!");
+    } else if (i % 8 == 0) {
+      *cache.install(key) = key;
+      *mmap_cache.install(key) = key;
+    } else {
+      *cache.insert(key) = key;
+      *mmap_cache.insert(key) = key;
+    }
+  }
+  if (cache.size() != mmap_cache.size())
+    throw std::runtime_error("Alloc: size mismatch!");
+}
+
+template <template <typename, typename, typename> class Table>
 void bench() {
-  LRUCache<uint32_t, uint32_t, hash2> cache;
+  LRUCache<uint32_t, uint32_t, hash2, Table> cache;
   cache.init(256 * 1024);  // #blocks for 1GB working set
 
   // filling the cache
@@ -210,8 +484,106 @@ void bench() {
   std::cout << std::flush;
 }
 
+// Random lookups on a cache much larger than the TLB reach, where huge pages
+// save most of the page walks.
+template <typename Alloc>
+void bench_alloc() {
+  constexpr uint32_t capacity = 4 * 1024 * 1024;  // 160 MB pool, 32 MB table
+  LRUCache<uint32_t, uint32_t, ghash, NodeTable, Alloc> cache;
+  cache.init(capacity);
+  for (uint32_t i = 0; i < capacity; ++i) cache.insert(i);
+  std::vector<uint32_t> keys;
+  for (uint32_t i = 0; i < capacity; ++i) keys.emplace_back(rand() % capacity);
+
+  auto ts0 = rdtsc();
+  for (auto k : keys) cache.lookup(k);
+  auto ts1 = rdtsc();
+  std::cout << "Lookup: " << (ts1 - ts0) / capacity << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+// Grow the cache by install and shrink it by erase repeatedly, as resizing a
+// page cache under memory pressure does; installed nodes come from the arena
+// and are reused after erase.
+void bench_install() {
+  constexpr uint32_t num_rounds = 16;
+  constexpr uint32_t round_size = 64 * 1024;
+  LRUCache<uint32_t, uint32_t, ghash> cache;
+  cache.init(1024);
+
+  uint64_t install_cycles = 0, erase_cycles = 0;
+  for (uint32_t r = 0; r < num_rounds; ++r) {
+    auto ts0 = rdtsc();
+    for (uint32_t i = 0; i < round_size; ++i)
+      *cache.install(r * round_size + i) = i;
+    auto ts1 = rdtsc();
+    for (uint32_t i = 0; i < round_size; ++i)
+      cache.erase(cache.lookup(r * round_size + i));
+    auto ts2 = rdtsc();
+    install_cycles += ts1 - ts0;
+    erase_cycles += ts2 - ts1;
+  }
+  if (cache.capacity() != 1024)
+    throw std::runtime_error("Install: capacity error!");
+  std::cout << "Install: " << install_cycles / (num_rounds * round_size)
+            << " cycles/op\n";
+  std::cout << "Erase:   " << erase_cycles / (num_rounds * round_size)
+            << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+// Warm up a cache from a snapshot vs inserting the same keys
+void bench_snapshot() {
+  constexpr uint32_t capacity = 1024 * 1024;
+  const char* path = "bench_lru.snapshot";
+  LRUCache<uint32_t, uint32_t, ghash> cache, cache2, cache3;
+  cache.init(capacity);
+  cache2.init(capacity);
+  cache3.init(capacity);
+  for (uint32_t i = 0; i < capacity; ++i) cache.insert(rand());
+  std::vector<uint32_t> keys = lru_keys(cache);
+
+  auto ts0 = rdtsc();
+  cache.save(path);
+  auto ts1 = rdtsc();
+  cache2.load(path);
+  auto ts2 = rdtsc();
+  for (auto k : keys) cache3.insert(k);
+  auto ts3 = rdtsc();
+  if (lru_keys(cache2) != lru_keys(cache3))
+    throw std::runtime_error("Snapshot: LRU mismatch!");
+  std::remove(path);
+  std::cout << "Save:   " << (ts1 - ts0) / capacity << " cycles/key\n";
+  std::cout << "Load:   " << (ts2 - ts1) / capacity << " cycles/key\n";
+  std::cout << "Insert: " << (ts3 - ts2) / capacity << " cycles/key\n";
+  std::cout << std::flush;
+}
+
 int main() {
-  test();   // for correctness
-  bench();  // for performance
+  test();             // for correctness
+  test_release_parked<LRUCache<uint32_t, uint32_t, ghash>>();
+  test_flat_table();  // for correctness of FlatNodeTable
+  test_resize<NodeTable>();
+  test_resize<FlatNodeTable>();
+  test_batch();
+  test_snapshot();
+  test_charge();
+  test_alloc<NodeTable, MmapAlloc<>>();
+  test_alloc<FlatNodeTable, MmapAlloc<HugePage::HUGETLB_2MB, true>>();
+  test_alloc<NodeTable, MmapAlloc<HugePage::HUGETLB_1GB>>();
+  std::cout << "=== NodeTable ===\n";
+  bench<NodeTable>();  // for performance
+  std::cout << "=== FlatNodeTable ===\n";
+  bench<FlatNodeTable>();
+  std::cout << "=== HeapAlloc ===\n";
+  bench_alloc<HeapAlloc>();
+  std::cout << "=== MmapAlloc (THP) ===\n";
+  bench_alloc<MmapAlloc<>>();
+  std::cout << "=== MmapAlloc (THP, prefault) ===\n";
+  bench_alloc<MmapAlloc<HugePage::THP, true>>();
+  std::cout << "=== Install/Erase ===\n";
+  bench_install();
+  std::cout << "=== Snapshot ===\n";
+  bench_snapshot();
   return 0;
 }
@@ -0,0 +1,170 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "gcache/alloc.h"
+#include "gcache/hash.h"
+#include "gcache/numa_cache.h"
+#include "util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+// Simulate a 2-node machine and specify the local node explicitly
+void test1() {
+  NumaLRUCache<uint32_t, uint32_t, idhash> cache(2);
+  cache.init(8);
+  assert(cache.num_nodes() == 2);
+  assert(cache.capacity_of(0) == 4);
+  assert(cache.capacity_of(1) == 4);
+
+  for (uint32_t i = 0; i < 4; ++i) *cache.insert_on(0, i) = i * 111;
+  for (uint32_t i = 10; i < 14; ++i) *cache.insert_on(1, i) = i * 111;
+
+  // a remote hit must not create a duplicate in the local shard
+  auto h = cache.insert_on(0, 10, /*pin*/ true);
+  if (h.get_tag() != 1 || *h != 1110)
+    throw std::runtime_error("NUMA: remote hit failed!");
+  h = cache.lookup_on(1, 3);
+  if (!h || h.get_tag() != 0 || *h != 333)
+    throw std::runtime_error("NUMA: remote lookup failed!");
+  assert(cache.size() == 8);
+
+  // node 1 is full except the pinned 10, so 11 is evicted
+  *cache.insert_on(1, 20) = 2020;
+  if (cache.lookup_on(1, 11)) throw std::runtime_error("NUMA: not evicted!");
+  h = cache.lookup_on(0, 10);
+  cache.release(h);
+
+  h = cache.lookup_on(0, 0);
+  [[maybe_unused]] bool success = cache.erase(h);
+  assert(success);
+  assert(cache.capacity_of(0) == 3);
+  h = cache.install_on(1, 30);
+  assert(h.get_tag() == 1);
+  *h = 3030;
+  assert(cache.capacity_of(1) == 5);
+  assert(cache.size() == 8);
+
+  std::cout << "Expect: Node 0: lru: [1, 2, 3]; Node 1: lru: [12, 13, 20, "
+               "10, 30]\n";
+  std::cout << cache << std::endl;
+}
+
+// Threads on all (simulated) nodes insert overlapping keys concurrently; a key
+// must never be cached by two shards.
+template <typename Alloc>
+void test2(uint32_t num_nodes) {
+  using Cache_t = NumaLRUCache<uint32_t, uint32_t, ghash, NodeTable, Alloc>;
+  Cache_t cache(num_nodes);
+  cache.init(4096, [](Cache_t::Handle_t h) { *h = 0; });
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, t, num_nodes]() {
+      for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+        uint32_t key = (i * 7 + t) % 8192;
+        auto h = cache.insert_on(t % num_nodes, key, /*pin*/ true);
+        if (!h) continue;  // all nodes in the shard are pinned
+        if (h.get_key() != key)
+          throw std::runtime_error("Inconsistent key in pinned handle!");
+        *h = key;
+        cache.release(h);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  assert(cache.size() == 4096);
+  std::unordered_set<uint32_t> keys;
+  cache.for_each([&keys](Cache_t::Handle_t h) {
+    if (*h != h.get_key())
+      throw std::runtime_error("Inconsistent value after concurrent updates!");
+    if (!keys.emplace(h.get_key()).second)
+      throw std::runtime_error("Key cached by multiple shards!");
+  });
+}
+
+// Miss-heavy: threads on all (simulated) nodes insert the same fresh keys at
+// the same time, so most inserts race with an insert of the same key on
+// another node; each key must still be cached by exactly one shard.
+void test3(uint32_t num_nodes) {
+  using Cache_t = NumaLRUCache<uint32_t, uint32_t, ghash>;
+  constexpr uint32_t num_keys = 4096;
+  Cache_t cache(num_nodes);
+  // every shard can hold all keys, so none is evicted
+  cache.init(num_keys * num_nodes, [](Cache_t::Handle_t h) { *h = 0; });
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, t, num_nodes]() {
+      for (uint32_t key = 0; key < num_keys; ++key) {
+        auto h = cache.insert_on(t % num_nodes, key, /*pin*/ true);
+        if (!h) throw std::runtime_error("NUMA: insert failed!");
+        if (h.get_key() != key)
+          throw std::runtime_error("Inconsistent key in pinned handle!");
+        *h = key;
+        cache.release(h);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  if (cache.size() != num_keys)
+    throw std::runtime_error("Key cached by multiple shards!");
+  std::unordered_set<uint32_t> keys;
+  cache.for_each([&keys](Cache_t::Handle_t h) {
+    if (*h != h.get_key())
+      throw std::runtime_error("Inconsistent value after concurrent inserts!");
+    if (!keys.emplace(h.get_key()).second)
+      throw std::runtime_error("Key cached by multiple shards!");
+  });
+}
+
+// Every thread looks up its local shard; compare it with the same cache but
+// all lookups starting from a fixed shard.
+void bench() {
+  using Cache_t = NumaLRUCache<uint32_t, uint32_t, ghash>;
+  Cache_t cache;
+  cache.init(256 * 1024);  // #blocks for 1GB working set
+  for (uint32_t i = 0; i < 256 * 1024; ++i) cache.insert(i);
+
+  for (bool local : {true, false}) {
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> cycles(num_threads, 0);
+    for (uint32_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&cache, &cycles, t, local]() {
+        uint32_t node = local ? cache.local_node() : 0;
+        auto ts0 = rdtsc();
+        for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+          auto h = cache.lookup_on(node, (i * 17 + t) % (512 * 1024), true);
+          if (h) cache.release(h);
+        }
+        cycles[t] = rdtsc() - ts0;
+      });
+    }
+    for (auto& t : threads) t.join();
+
+    uint64_t total = 0;
+    for (auto c : cycles) total += c;
+    std::cout << "Lookup (" << cache.num_nodes() << " nodes, " << num_threads
+              << " threads, " << (local ? "local" : "node 0")
+              << " first): " << total / num_ops << " cycles/op\n";
+  }
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();                // for correctness
+  test2<HeapAlloc>(2);    // for thread-safety
+  test2<MmapAlloc<>>(4);  // ... with more simulated nodes
+  test3(4);               // for racing inserts of the same keys
+  bench();                // for performance
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "benchmarks/workload.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/s3fifo_cache.h"
+#include "gcache/sharded_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+void test1() {
+  S3FifoCache<uint32_t, uint32_t, idhash> cache(/*small_ratio*/ 0.4);
+  cache.init(5);
+  for (uint32_t i = 1; i <= 5; ++i) *cache.insert(i) = i * 111;
+  assert(cache.small_size() == 5);
+
+  // 1 and 2 are referenced in small and moved to main; 3 is evicted to ghost
+  cache.lookup(1);
+  cache.lookup(2);
+  *cache.insert(6) = 666;
+  if (cache.lookup(3)) throw std::runtime_error("S3FIFO: 3 not evicted!");
+
+  // 3 is found in ghost, so it goes to main directly, while 4 is evicted
+  *cache.insert(3) = 333;
+  if (cache.lookup(4)) throw std::runtime_error("S3FIFO: 4 not evicted!");
+  assert(cache.small_size() == 2);
+  std::cout << "Expect: small: [5, 6], main: [1*, 2*, 3], ghost: [4]\n";
+  std::cout << cache << std::endl;
+
+  // 5 and 6 are evicted as usual, but the pinned 7 is moved to main; then
+  // main reinserts the referenced 1 and 2 with their frequencies decremented,
+  // and evicts 3
+  auto h7 = cache.insert(7, /*pin*/ true);
+  *h7 = 777;
+  *cache.insert(8) = 888;
+  if (cache.lookup(6)) throw std::runtime_error("S3FIFO: 6 not evicted!");
+  *cache.insert(9) = 999;
+  if (cache.lookup(3)) throw std::runtime_error("S3FIFO: 3 not evicted!");
+  if (cache.lookup(7) != h7) throw std::runtime_error("S3FIFO: pinned lost!");
+  if (*cache.lookup(1) != 111 || *cache.lookup(2) != 222)
+    throw std::runtime_error("S3FIFO: referenced node evicted!");
+
+  // all pinned: no victim
+  std::vector<S3FifoCache<uint32_t, uint32_t, idhash>::Handle_t> handles;
+  for (uint32_t k : {1, 2, 8, 9}) handles.push_back(cache.lookup(k, true));
+  if (cache.insert(10)) throw std::runtime_error("S3FIFO: evicted pinned!");
+  cache.release(h7);
+  for (auto h : handles) cache.release(h);
+  if (!cache.insert(10)) throw std::runtime_error("S3FIFO: no victim!");
+  assert(cache.size() == 5);
+}
+
+// Hits only bump the atomic frequency, so S3FifoCache shards take concurrent
+// lookups under the shared lock.
+void test2() {
+  using Cache_t =
+      ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                      S3FifoCache<uint32_t, uint32_t, ghash>>;
+  static_assert(Cache_t::LRUCache_t::kConcurrentLookup);
+  test_concurrent_pinned<Cache_t>(num_threads, num_ops);
+}
+
+// On a Zipfian workload, S3-FIFO should be no worse than LRU.
+void test3() {
+  LRUCache<uint32_t, uint32_t, ghash> lru;
+  lru.init(4096);
+  S3FifoCache<uint32_t, uint32_t, ghash> s3fifo;
+  s3fifo.init(4096);
+
+  auto zipf = [] {
+    return Offsets(num_ops, OffsetType::ZIPF, /*size*/ 64 * 1024, 1, 0.99,
+                   0x537);
+  };
+  double lru_ratio = hit_ratio(lru, zipf());
+  double s3fifo_ratio = hit_ratio(s3fifo, zipf());
+  std::cout << "Zipf hit ratio: LRU=" << lru_ratio
+            << ", S3FIFO=" << s3fifo_ratio << std::endl;
+  if (s3fifo_ratio < lru_ratio)
+    throw std::runtime_error("S3FIFO: lower hit ratio than LRU!");
+}
+
+void bench() {
+  bench_hit<LRUCache<uint32_t, uint32_t, ghash>>("LRUCache", num_ops);
+  bench_hit<S3FifoCache<uint32_t, uint32_t, ghash>>("S3FifoCache", num_ops);
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for thread-safety
+  test3();  // for hit ratio
+  bench();  // for performance
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gcache/hash.h"
+#include "gcache/sharded_cache.h"
+#include "util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+void test1() {
+  ShardedLRUCache<uint32_t, uint32_t, ghash, 2> cache;
+  cache.init(10);
+  assert(cache.size() == 0);
+  assert(cache.capacity() == 10);
+
+  for (uint32_t i = 0; i < 10; ++i) {
+    auto h = cache.insert(i);
+    assert(h);
+    *h = i * 111;
+  }
+  assert(cache.size() <= 10);
+
+  // pinned node must survive no matter how many insertions follow
+  auto h = cache.insert(100, /*pin*/ true);
+  assert(h);
+  *h = 100100;
+  for (uint32_t i = 1000; i < 2000; ++i) cache.insert(i);
+  auto h_ = cache.lookup(100);
+  if (h_ != h) throw std::runtime_error("Pinned handle is evicted!");
+  if (*h_ != 100100) throw std::runtime_error("Pinned value is corrupted!");
+  cache.release(h);
+
+  // every shard must be full after enough insertions
+  assert(cache.size() == 10);
+  assert(cache.capacity() == 10);
+
+  h = cache.lookup(1999);
+  assert(h);
+  [[maybe_unused]] bool success = cache.erase(h);
+  assert(success);
+  assert(cache.size() == 9);
+  assert(cache.capacity() == 9);
+  h = cache.install(1999);
+  assert(h);
+  assert(cache.size() == 10);
+  assert(cache.capacity() == 10);
+
+  std::cout << cache << std::endl;
+}
+
+void test2() {
+  using Cache_t = ShardedLRUCache<uint32_t, uint32_t, ghash>;
+  Cache_t cache;
+  cache.init(4096, [](Cache_t::Handle_t h) { *h = 0; });
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+        uint32_t key = (i * 7 + t) % 8192;
+        auto h = cache.insert(key, /*pin*/ true);
+        if (!h) continue;  // all nodes in the shard are pinned
+        if (h.get_key() != key)
+          throw std::runtime_error("Inconsistent key in pinned handle!");
+        *h = key;
+        cache.release(h);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  assert(cache.size() == 4096);
+  cache.for_each([](Cache_t::Handle_t h) {
+    if (*h != h.get_key())
+      throw std::runtime_error("Inconsistent value after concurrent updates!");
+  });
+}
+
+// idhash has no entropy in the top bits of small keys; they must still spread
+// over all shards, or they would all fit in shard 0 (1/16 of the capacity)
+void test3() {
+  using Cache_t = ShardedLRUCache<uint32_t, uint32_t, idhash>;
+  Cache_t cache;
+  cache.init(1024);
+
+  for (uint32_t i = 0; i < 512; ++i) cache.insert(i);
+  if (cache.size() != 512)
+    throw std::runtime_error("idhash keys are evicted from a skewed shard!");
+}
+
+void bench() {
+  using Cache_t = ShardedLRUCache<uint32_t, uint32_t, ghash>;
+  Cache_t cache;
+  cache.init(256 * 1024);  // #blocks for 1GB working set
+
+  for (uint32_t i = 0; i < 256 * 1024; ++i) cache.insert(i);
+
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> cycles(num_threads, 0);
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&cache, &cycles, t]() {
+      auto ts0 = rdtsc();
+      for (uint32_t i = 0; i < num_ops / num_threads; ++i) {
+        auto h = cache.lookup((i * 17 + t) % (512 * 1024), /*pin*/ true);
+        if (h) cache.release(h);
+      }
+      cycles[t] = rdtsc() - ts0;
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  uint64_t total = 0;
+  for (auto c : cycles) total += c;
+  std::cout << "Lookup (" << num_threads
+            << " threads): " << total / num_ops << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for thread-safety
+  test3();  // for shard routing
+  bench();  // for performance
+  return 0;
+}
@@ -1,6 +1,10 @@
 #include <cassert>
+#include <cstdio>
+#include <stdexcept>
 #include <vector>
 
+#include "gcache/alloc.h"
+#include "gcache/hash.h"
 #include "gcache/shared_cache.h"
 #include "util.h"
 
@@ -122,7 +126,161 @@ void test1() {
   std::cout << shared_cache << std::endl;
 }
 
+// Batched APIs must behave the same as calling the scalar ones in order
+void test2() {
+  SharedCache<int, int, int, hash1> shared_cache;
+  std::vector<std::pair<int, size_t>> tenant_configs;
+  tenant_configs.emplace_back(537, 3);
+  tenant_configs.emplace_back(564, 2);
+  shared_cache.init(tenant_configs);
+
+  int keys[] = {1, 2, 3, 4};
+  SharedCache<int, int, int, hash1>::Handle_t handles[4];
+  shared_cache.insert_batch(537, keys, 3, handles);
+  for (int i = 0; i < 3; ++i) {
+    assert(handles[i]);
+    assert(handles[i].get_tag() == 537);
+    assert(handles[i].get_key() == keys[i]);
+    *handles[i] = keys[i] * 111;
+  }
+  // key 2 and 3 already exist, so they stay in 537; only key 4 goes to 564
+  shared_cache.insert_batch(564, keys + 1, 3, handles);
+  assert(handles[0].get_tag() == 537);
+  assert(handles[2].get_tag() == 564);
+  *handles[2] = 444;
+  assert(handles[1].get_tag() == 537);
+  assert(shared_cache.size_of(537) == 3);
+  assert(shared_cache.size_of(564) == 1);
+
+  int lookup_keys[] = {1, 2, 4, 5};
+  shared_cache.lookup_batch(lookup_keys, 4, handles);
+  assert(handles[0] && *handles[0] == 111);
+  assert(handles[1] && *handles[1] == 222);
+  assert(handles[2] && *handles[2] == 444);
+  assert(!handles[3]);
+  std::cout << "Expect: { 537: [3, 1, 2], 564: [4] }" << std::endl;
+  std::cout << shared_cache << std::endl;
+}
+
+// The shared pool and table are mmap-ed; relocate across tenants and
+// erase/install must work the same as with the heap
+void test3() {
+  SharedCache<int, int, int, ghash, NodeTable, MmapAlloc<>> shared_cache;
+  std::vector<std::pair<int, size_t>> tenant_configs;
+  tenant_configs.emplace_back(537, 64 * 1024);
+  tenant_configs.emplace_back(564, 64 * 1024);
+  shared_cache.init(tenant_configs);
+
+  for (int i = 0; i < 128 * 1024; ++i) *shared_cache.insert(537, i) = i;
+  if (shared_cache.size_of(537) != 64 * 1024)
+    throw std::runtime_error("Shared: size error!");
+  shared_cache.relocate(564, 537, 32 * 1024);
+  // now 537 can hold the last 96K keys
+  for (int i = 0; i < 128 * 1024; ++i) *shared_cache.insert(537, i) = i;
+  for (int i = 32 * 1024; i < 128 * 1024; ++i) {
+    auto h = shared_cache.lookup(i);
+    if (!h || *h != i) throw std::runtime_error("Shared: lookup failed!");
+  }
+  for (int i = 0; i < 1024; ++i) {
+    shared_cache.erase(shared_cache.lookup(i + 64 * 1024));
+    *shared_cache.install(564, i + 128 * 1024) = i;
+  }
+  if (shared_cache.size_of(564) != 1024)
+    throw std::runtime_error("Shared: size error!");
+}
+
+// A loaded SharedCache must restore each tenant's capacity, keys, and tags
+void test4() {
+  using Cache_t = SharedCache<int, int, int, ghash>;
+  const char* path = "test_shared.snapshot";
+  std::vector<std::pair<int, size_t>> tenant_configs;
+  tenant_configs.emplace_back(537, 100);
+  tenant_configs.emplace_back(564, 100);
+  tenant_configs.emplace_back(777, 100);
+  Cache_t shared_cache;
+  shared_cache.init(tenant_configs);
+  for (int i = 0; i < 1000; ++i) shared_cache.insert(537, i);
+  for (int i = 0; i < 1000; ++i) shared_cache.insert(564, i + 1000);
+  shared_cache.relocate(564, 537, 60);
+  shared_cache.relocate(777, 537, 30);
+  shared_cache.insert(777, 2000);
+  shared_cache.lookup(950);
+  if (!shared_cache.save(path))
+    throw std::runtime_error("Shared: save failed!");
+
+  auto lru_keys = [](const Cache_t& c, int tag) {
+    std::vector<int> keys;
+    c.get_cache(tag).for_each_lru([&keys](Cache_t::LRUCache_t::Handle_t h) {
+      keys.emplace_back(h.get_key());
+    });
+    return keys;
+  };
+  Cache_t shared_cache2;
+  shared_cache2.init(tenant_configs);
+  if (!shared_cache2.load(path))
+    throw std::runtime_error("Shared: load failed!");
+  for (auto [tag, capacity] : tenant_configs) {
+    if (shared_cache2.capacity_of(tag) != shared_cache.capacity_of(tag) ||
+        lru_keys(shared_cache2, tag) != lru_keys(shared_cache, tag))
+      throw std::runtime_error("Shared: tenant mismatch!");
+    for (int k : lru_keys(shared_cache2, tag)) {
+      auto h = shared_cache2.lookup(k);
+      if (!h || h.get_tag() != tag) throw std::runtime_error("Shared: tag!");
+    }
+  }
+  assert(shared_cache2.capacity_of(537) == 190);
+
+  // tenants must match
+  Cache_t shared_cache3;
+  tenant_configs.back().first = 778;
+  shared_cache3.init(tenant_configs);
+  if (shared_cache3.load(path)) throw std::runtime_error("Shared: bad tag!");
+  std::remove(path);
+}
+
+struct Object {
+  uint32_t charge;  // size in bytes
+  char* data;
+};
+
+// Relocation of a weighted cache moves budget, and handles along with it
+void test5() {
+  using Cache_t = SharedCache<int, uint32_t, Object, idhash>;
+  std::vector<std::pair<int, size_t>> tenant_configs;
+  tenant_configs.emplace_back(537, 100);
+  tenant_configs.emplace_back(564, 100);
+  Cache_t shared_cache;
+  shared_cache.init(tenant_configs);
+  shared_cache.set_budget(537, 10000);
+  shared_cache.set_budget(564, 10000);
+  for (uint32_t i = 0; i < 200; ++i) shared_cache.insert_charged(537, i, 100);
+  if (shared_cache.size_of(537) != 100 || shared_cache.usage_of(537) != 10000)
+    throw std::runtime_error("Shared: wrong usage!");
+
+  if (shared_cache.relocate(537, 564, 5000) != 5000 ||
+      shared_cache.budget_of(537) != 5000 ||
+      shared_cache.budget_of(564) != 15000 ||
+      shared_cache.capacity_of(537) != 50 ||
+      shared_cache.capacity_of(564) != 150 ||
+      shared_cache.usage_of(537) != 5000)
+    throw std::runtime_error("Shared: wrong relocation!");
+  for (uint32_t i = 1000; i < 1200; ++i)
+    shared_cache.insert_charged(564, i, 100);
+  if (shared_cache.size_of(564) != 150 || shared_cache.usage_of(564) != 15000)
+    throw std::runtime_error("Shared: budget not used!");
+
+  // the owner's charge is updated, and its own LRU victim is evicted
+  auto h = shared_cache.insert_charged(564, 199, 200);
+  if (h.get_tag() != 537 || shared_cache.usage_of(537) != 5000 ||
+      shared_cache.size_of(537) != 49 || shared_cache.lookup(150))
+    throw std::runtime_error("Shared: wrong charge update!");
+}
+
 int main() {
   test1();
+  test2();
+  test3();
+  test4();
+  test5();
   return 0;
 }
@@ -0,0 +1,100 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gcache/hash.h"
+#include "gcache/sharded_cache.h"
+#include "gcache/sieve_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_threads = 8;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+void test1() {
+  SieveCache<uint32_t, uint32_t, idhash> cache;
+  cache.init(4);
+  for (uint32_t i = 1; i <= 4; ++i) *cache.insert(i) = i * 111;
+  assert(cache.size() == 4);
+
+  // the hand clears 1's visited bit and evicts 2, then clears 3's and
+  // evicts 4; visited nodes stay in place instead of moving to the head
+  cache.lookup(1);
+  cache.lookup(3);
+  *cache.insert(5) = 555;
+  if (cache.lookup(2)) throw std::runtime_error("SIEVE: 2 not evicted!");
+  *cache.insert(6) = 666;
+  if (cache.lookup(4)) throw std::runtime_error("SIEVE: 4 not evicted!");
+  cache.lookup(1);
+  *cache.insert(7) = 777;
+  if (cache.lookup(5)) throw std::runtime_error("SIEVE: 5 not evicted!");
+  std::cout << "Expect: hand=6, queue: [1*, 3, 6, 7]\n";
+  std::cout << cache << std::endl;
+
+  // a pinned node is skipped by the hand even if not visited
+  auto h8 = cache.insert(8, /*pin*/ true);  // evict 6
+  *h8 = 888;
+  *cache.insert(9) = 999;    // evict 7
+  *cache.insert(10) = 1000;  // skip 8, evict 9
+  if (cache.lookup(9)) throw std::runtime_error("SIEVE: 9 not evicted!");
+  if (cache.lookup(8) != h8) throw std::runtime_error("SIEVE: pinned evicted!");
+
+  // erase/install as in LRUCache
+  if (cache.erase(h8)) throw std::runtime_error("SIEVE: erased pinned!");
+  cache.release(h8);
+  if (!cache.erase(h8)) throw std::runtime_error("SIEVE: erase failed!");
+  assert(cache.size() == 3 && cache.capacity() == 3);
+  if (cache.lookup(8)) throw std::runtime_error("SIEVE: erased still found!");
+  *cache.install(11) = 1100;
+  *cache.install(12) = 1200;  // from extra_pool_
+  assert(cache.size() == 5 && cache.capacity() == 5);
+  for (uint32_t k = 13; k < 20; ++k) *cache.insert(k) = k * 100;
+  assert(cache.size() == 5);
+  uint32_t n = 0;
+  cache.for_each([&n](SieveCache<uint32_t, uint32_t, idhash>::Handle_t h) {
+    if (*h != h.get_key() * 100 && *h != h.get_key() * 111)
+      throw std::runtime_error("SIEVE: inconsistent value!");
+    ++n;
+  });
+  assert(n == 5);
+
+  // all pinned: no victim
+  std::vector<SieveCache<uint32_t, uint32_t, idhash>::Handle_t> handles;
+  cache.for_each([&](SieveCache<uint32_t, uint32_t, idhash>::Handle_t h) {
+    handles.push_back(h);
+  });
+  for (auto h : handles) cache.pin(h);
+  if (cache.insert(20)) throw std::runtime_error("SIEVE: evicted pinned!");
+  for (auto h : handles) cache.release(h);
+  if (!cache.insert(20)) throw std::runtime_error("SIEVE: no victim!");
+}
+
+// Hits only set the visited bit, so SieveCache shards take concurrent lookups
+// under the shared lock.
+void test2() {
+  using Cache_t =
+      ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                      SieveCache<uint32_t, uint32_t, ghash>>;
+  static_assert(Cache_t::LRUCache_t::kConcurrentLookup);
+  test_concurrent_pinned<Cache_t>(num_threads, num_ops);
+}
+
+void bench() {
+  bench_concurrent<ShardedLRUCache<uint32_t, uint32_t, ghash>>(
+      "Sharded LRU", num_threads, num_ops, /*pin*/ true);
+  bench_concurrent<ShardedLRUCache<uint32_t, uint32_t, ghash, 4,
+                                   SieveCache<uint32_t, uint32_t, ghash>>>(
+      "Sharded SIEVE", num_threads, num_ops, /*pin*/ true);
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for thread-safety
+  bench();  // for performance
+  return 0;
+}
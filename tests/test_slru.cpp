@@ -0,0 +1,109 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#include "benchmarks/workload.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/sharded_cache.h"
+#include "gcache/slru_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+void test1() {
+  SLRUCache<uint32_t, uint32_t, idhash> cache(/*protected_ratio*/ 0.5);
+  cache.init(4);
+  assert(cache.protected_capacity() == 2);
+  for (uint32_t i = 1; i <= 4; ++i) *cache.insert(i) = i * 111;
+
+  // 1 and 2 are re-referenced and promoted; the new 5 evicts 3 in probation
+  cache.lookup(1);
+  cache.lookup(2);
+  *cache.insert(5) = 555;
+  if (cache.lookup(3)) throw std::runtime_error("SLRU: 3 not evicted!");
+
+  // promoting 4 overflows protected, which demotes 1 to probation
+  cache.lookup(4);
+  assert(cache.protected_size() == 2);
+  *cache.insert(6) = 666;
+  if (cache.lookup(5)) throw std::runtime_error("SLRU: 5 not evicted!");
+  auto h1 = cache.lookup(1, /*pin*/ true);
+  if (*h1 != 111) throw std::runtime_error("SLRU: demoted node evicted!");
+  std::cout << "Expect: probation: [6, 2], protected: [4, 1]\n";
+  std::cout << cache << std::endl;
+
+  // all pinned: no victim
+  auto h2 = cache.lookup(2, /*pin*/ true);
+  auto h4 = cache.lookup(4, /*pin*/ true);
+  auto h6 = cache.lookup(6, /*pin*/ true);
+  if (cache.insert(7)) throw std::runtime_error("SLRU: evicted pinned!");
+  cache.release(h1);
+  cache.release(h2);
+  cache.release(h4);
+  cache.release(h6);
+  if (!cache.insert(7)) throw std::runtime_error("SLRU: released not reused!");
+  assert(cache.size() == 4);
+  assert(cache.protected_size() <= 2);
+}
+
+// Return the hit ratio of a hot set that fits in the cache, while a sequential
+// scan (e.g. a backup) reads 4 blocks per hot access.
+template <typename Cache_t>
+double hot_hit_ratio(Cache_t& cache) {
+  constexpr uint32_t hot_size = 512;
+  constexpr uint32_t scan_size = 64 * 1024;
+  Offsets hot(num_ops, OffsetType::UNIF, hot_size, 1, 0, 0x537);
+  Offsets scan(4 * num_ops, OffsetType::SEQ, scan_size, 1, 0, 0);
+
+  auto scan_it = scan.begin();
+  uint64_t num_hits = 0;
+  for (auto hot_it = hot.begin(); hot_it != hot.end(); ++hot_it) {
+    if (cache.lookup(*hot_it))
+      ++num_hits;
+    else
+      cache.insert(*hot_it);
+    for (int i = 0; i < 4; ++i, ++scan_it) cache.insert(hot_size + *scan_it);
+  }
+  return static_cast<double>(num_hits) / num_ops;
+}
+
+void test2() {
+  LRUCache<uint32_t, uint32_t, ghash> lru;
+  lru.init(1024);
+  SLRUCache<uint32_t, uint32_t, ghash> slru;
+  slru.init(1024);
+  ShardedLRUCache<uint32_t, uint32_t, ghash, 2,
+                  SLRUCache<uint32_t, uint32_t, ghash>>
+      sharded_slru;
+  sharded_slru.init(1024);
+
+  double lru_ratio = hot_hit_ratio(lru);
+  double slru_ratio = hot_hit_ratio(slru);
+  double sharded_ratio = hot_hit_ratio(sharded_slru);
+  std::cout << "Hot set hit ratio under scan: LRU=" << lru_ratio
+            << ", SLRU=" << slru_ratio << ", Sharded SLRU=" << sharded_ratio
+            << std::endl;
+  if (slru_ratio < 0.9 || slru_ratio <= lru_ratio)
+    throw std::runtime_error("SLRU: hot set flushed by scan!");
+  if (sharded_ratio < 0.9)
+    throw std::runtime_error("Sharded SLRU: hot set flushed by scan!");
+}
+
+void bench() {
+  bench_hit<LRUCache<uint32_t, uint32_t, ghash>>("LRUCache", num_ops);
+  bench_hit<SLRUCache<uint32_t, uint32_t, ghash>>("SLRUCache", num_ops);
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for scan resistance
+  test_release_parked<SLRUCache<uint32_t, uint32_t, ghash>>();
+  bench();  // for performance
+  return 0;
+}
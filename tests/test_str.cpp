@@ -0,0 +1,154 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/str_lru_cache.h"
+#include "util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+// Count heap allocations to check there is none after warm-up
+static uint64_t num_allocs = 0;
+
+void* operator new(size_t size) {
+  ++num_allocs;
+  if (void* p = malloc(size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// A key of 1 to 64 bytes that is unique for each i
+std::string make_key(uint32_t i) {
+  std::string key = std::to_string(i);
+  key.resize(key.size() + i % 57, 'x');
+  return key;
+}
+
+void test1() {
+  StrLRUCache<uint32_t> cache;
+  cache.init(4);
+
+  // the short keys are inline, while the long ones are copied into the arena
+  std::string long_key(20, 'a');
+  *cache.insert("apple") = 1;
+  *cache.insert("banana") = 2;
+  *cache.insert(long_key) = 3;
+  long_key[0] = 'b';  // the cache must have its own copy
+  *cache.insert(long_key) = 4;
+  assert(cache.size() == 4);
+  long_key[0] = 'a';
+  auto h = cache.lookup(long_key);
+  if (!h || *h != 3 || h.get_key() != long_key)
+    throw std::runtime_error("Str: long key lookup failed!");
+  // same length and prefix, differ in the last byte
+  if (cache.lookup(std::string(19, 'a') + "b"))
+    throw std::runtime_error("Str: false positive!");
+
+  h = cache.insert("apple", /*pin*/ true);
+  if (*h != 1) throw std::runtime_error("Str: short key lookup failed!");
+  *cache.insert("a much longer key than inline") = 5;  // evict "banana"
+  if (cache.lookup("banana")) throw std::runtime_error("Str: not evicted!");
+  cache.release(h);
+
+  h = cache.lookup(long_key);
+  [[maybe_unused]] bool success = cache.erase(h);
+  assert(success);
+  assert(cache.capacity() == 3);
+  *cache.install("cherry") = 6;
+  assert(cache.capacity() == 4);
+  assert(*cache.lookup("cherry") == 6);
+
+  std::cout << "Expect: lru: [baaaaaaaaaaaaaaaaaaa, apple, a much longer key "
+               "than inline, cherry]\n";
+  std::cout << cache << std::endl;
+}
+
+// Cross-check with LRUCache keyed by the index of the string
+void test2() {
+  LRUCache<uint32_t, uint32_t, ghash> cache;
+  StrLRUCache<uint32_t> str_cache;
+  cache.init(1000);
+  str_cache.init(1000);
+
+  srand(0x537);
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    uint32_t k = rand() % 4000;
+    std::string key = make_key(k);
+    auto h1 = cache.insert(k);
+    auto h2 = str_cache.insert(key);
+    if (h2.get_key() != key) throw std::runtime_error("Str: key mismatch!");
+    *h1 = k;
+    *h2 = k;
+  }
+
+  std::vector<std::string> keys1, keys2;
+  cache.for_each_lru([&keys1](LRUHandle<uint32_t, uint32_t> h) {
+    keys1.emplace_back(make_key(*h));
+  });
+  str_cache.for_each_lru([&keys2](StrHandle<uint32_t> h) {
+    if (h.get_key() != make_key(*h))
+      throw std::runtime_error("Str: value corrupted!");
+    keys2.emplace_back(h.get_key());
+  });
+  if (keys1 != keys2) throw std::runtime_error("Str: LRU mismatch!");
+}
+
+// Once every node has a large enough key buffer, insertion must not allocate
+void test3() {
+  StrLRUCache<uint32_t> cache;
+  cache.init(1000);
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < num_ops; ++i) keys.emplace_back(make_key(i));
+
+  for (uint32_t i = 0; i < num_ops / 2; ++i) cache.insert(keys[i]);
+  uint64_t allocs = num_allocs;
+  for (uint32_t i = num_ops / 2; i < num_ops; ++i) cache.insert(keys[i]);
+  if (num_allocs != allocs)
+    throw std::runtime_error("Str: heap allocation after warm-up!");
+}
+
+void bench() {
+  constexpr uint32_t bench_size = 256 * 1024;
+  StrLRUCache<uint32_t> cache;
+  cache.init(bench_size);
+  std::vector<std::string> short_keys, long_keys;
+  for (uint32_t i = 0; i < 2 * bench_size; ++i) {
+    short_keys.emplace_back(std::to_string(i));
+    long_keys.emplace_back(std::string(24, '0') + std::to_string(i));
+  }
+
+  for (auto keys : {&short_keys, &long_keys}) {
+    auto ts0 = rdtsc();
+    for (uint32_t i = 0; i < bench_size; ++i) cache.insert((*keys)[i]);
+    auto ts1 = rdtsc();
+    for (uint32_t i = 0; i < bench_size; ++i) cache.insert((*keys)[i]);
+    auto ts2 = rdtsc();
+    for (uint32_t i = bench_size; i < 2 * bench_size; ++i)
+      cache.insert((*keys)[i]);
+    auto ts3 = rdtsc();
+
+    std::cout << (keys == &short_keys ? "Short" : "Long") << " keys:\n";
+    std::cout << "Fill: " << (ts1 - ts0) / bench_size << " cycles/op\n";
+    std::cout << "Hit:  " << (ts2 - ts1) / bench_size << " cycles/op\n";
+    std::cout << "Miss: " << (ts3 - ts2) / bench_size << " cycles/op\n";
+  }
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for correctness
+  test2();  // for consistency with LRUCache
+  test3();  // for no allocation after warm-up
+  bench();  // for performance
+  return 0;
+}
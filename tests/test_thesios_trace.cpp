@@ -18,14 +18,15 @@
 using namespace gcache;
 
 // tuple should be in the order of min_offset, max_size
-typedef std::tuple<uint32_t, uint32_t> trace_tuple;
+typedef std::tuple<uint64_t, uint64_t> trace_tuple;
 
 std::map <std::string, trace_tuple> mapping; 
 
-uint32_t max_size = 0;
-uint32_t min_offset = -1;
+uint64_t max_size = 0;
+uint64_t min_offset = -1;
 
-GhostCache<> test_cache(TICK, MIN, MAX);
+// block ids of all files are packed into one space, which may exceed 2^32
+GhostCache64<> test_cache(TICK, MIN, MAX);
 
 void parse_csv(std::string filename, std::string app_of_interest){
 	std::ifstream file(filename);
@@ -61,9 +62,9 @@ void parse_csv(std::string filename, std::string app_of_interest){
 
 		}
 		count = 0;
-		uint32_t file_offset = 0;
-		uint32_t rs = 0;
-		uint32_t total_size = 0;
+		uint64_t file_offset = 0;
+		uint64_t rs = 0;
+		uint64_t total_size = 0;
 		std::string filename;
 		bool skip_row = false; 
 		while (std::getline(ss, cell, ',')) {
@@ -75,9 +76,9 @@ void parse_csv(std::string filename, std::string app_of_interest){
 			} else if (count == fname_col) {
 				filename = cell;
 			} else if (count == rs_col) {
-				rs = (uint32_t) std::atoi(cell.c_str());
+				rs = std::strtoull(cell.c_str(), nullptr, 10);
 			} else if(count == offset_col) {
-				file_offset = (uint32_t) std::atoi(cell.c_str());
+				file_offset = std::strtoull(cell.c_str(), nullptr, 10);
 			}
 			count++;
 		}
@@ -88,7 +89,7 @@ void parse_csv(std::string filename, std::string app_of_interest){
 			if (!mapping.count(filename)) {
 				mapping.insert(std::make_pair(filename,
 					       std::make_tuple(
-						       0xFFFFFFFF,
+						       UINT64_MAX,
 						       0)));
 			}
 			total_size = rs + file_offset;
@@ -104,16 +105,16 @@ void parse_csv(std::string filename, std::string app_of_interest){
 	}
 }
 
-uint32_t warm_cache() {
-	uint32_t prev_boundary = 0; 
+uint64_t warm_cache() {
+	uint64_t prev_boundary = 0; 
 	for (auto it = mapping.cbegin(); it != mapping.cend(); ++it) {
 		if (it->first.empty())
 			continue;
-		uint32_t curr_min_offset = std::get<0>(it->second);
-		uint32_t curr_max_size = std::get<1>(it->second);
-		uint32_t boundary = ((curr_max_size - curr_min_offset) / BLK_SIZE) + prev_boundary;
+		uint64_t curr_min_offset = std::get<0>(it->second);
+		uint64_t curr_max_size = std::get<1>(it->second);
+		uint64_t boundary = ((curr_max_size - curr_min_offset) / BLK_SIZE) + prev_boundary;
 		std::cout << "Warming up all blks of: " << it->first << std::endl;
-		for (uint32_t i = prev_boundary; i < boundary; i++){
+		for (uint64_t i = prev_boundary; i < boundary; i++){
 			test_cache.access(i); 
 			std::cout << '\t' << i << std::endl;
 		}
@@ -139,9 +140,9 @@ void print_trace_data(){
 
 }
 
-void access_all_entries(uint32_t boundary) {
-	for (uint32_t i = 0; i < boundary; i++){
-		uint32_t entry = rand() % boundary;
+void access_all_entries(uint64_t boundary) {
+	for (uint64_t i = 0; i < boundary; i++){
+		uint64_t entry = (((uint64_t) rand() << 31) | rand()) % boundary;
 		std::cout << "Accessing entry " << entry << std::endl;
 		test_cache.access(entry);
 		for (uint32_t s = test_cache.get_min_size(); s <= test_cache.get_max_size(); s+=TICK){ 
@@ -159,7 +160,7 @@ int main(int argc, char *argv[]) {
 	} else {
 		parse_csv(argv[1], "bigtable"); // Pass in "" if you want *all* entries to be considered
 		print_trace_data();
-		uint32_t boundary = warm_cache();
+		uint64_t boundary = warm_cache();
 		std::cout << boundary << std::endl;
 		access_all_entries(boundary);
 	}
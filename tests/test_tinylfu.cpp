@@ -0,0 +1,139 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "benchmarks/workload.h"
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/sketch.h"
+#include "gcache/tinylfu_cache.h"
+#include "policy_util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+// The sketch never underestimates before aging, saturates at 15, and halves
+// all counters once the sample size is reached.
+void test1() {
+  FrequencySketch<> sketch;
+  sketch.init(1024);
+  ghash hash;
+  for (uint32_t k = 0; k < 512; ++k) {
+    for (uint32_t i = 0; i < k % 16; ++i) sketch.increment(hash(k));
+  }
+  uint32_t num_exact = 0;
+  for (uint32_t k = 0; k < 512; ++k) {
+    uint32_t est = sketch.estimate(hash(k));
+    if (est < k % 16) throw std::runtime_error("Sketch: underestimate!");
+    if (est == k % 16) ++num_exact;
+  }
+  std::cout << "Sketch: " << num_exact << "/512 exact estimates\n";
+  if (num_exact < 480) throw std::runtime_error("Sketch: too inaccurate!");
+
+  for (uint32_t i = 0; i < 100; ++i) sketch.increment(hash(7));
+  if (sketch.estimate(hash(7)) != FrequencySketch<>::kMaxCount)
+    throw std::runtime_error("Sketch: not saturated!");
+  // fill up the sample with other keys until the counters are halved
+  for (uint32_t k = 1 << 20; sketch.estimate(hash(7)) == 15; ++k)
+    sketch.increment(hash(k));
+  if (sketch.estimate(hash(7)) != 7)
+    throw std::runtime_error("Sketch: not aged!");
+}
+
+// Run a hot set of 9 keys interleaved with 1000 one-hit wonders on a cache of
+// capacity 10; return the number of hits on the hot set (out of 500).
+template <typename Cache_t>
+uint32_t run_hot_set(Cache_t& cache) {
+  for (uint32_t k = 1; k <= 9; ++k) *cache.insert(k) = k;
+  for (uint32_t i = 0; i < 3; ++i)
+    for (uint32_t k = 1; k <= 9; ++k) cache.lookup(k);
+  uint32_t num_hits = 0;
+  for (uint32_t k = 100; k < 1100; ++k) {
+    *cache.insert(k) = k;
+    if (k % 2) continue;
+    uint32_t hot = k / 2 % 9 + 1;
+    if (cache.lookup(hot))
+      ++num_hits;
+    else
+      *cache.insert(hot) = hot;
+  }
+  return num_hits;
+}
+
+// A hot set survives a stream of one-hit wonders, while a newcomer that is
+// accessed often enough is still admitted.
+void test2() {
+  LRUCache<uint32_t, uint32_t, idhash> lru;
+  lru.init(10);
+  TinyLFUCache<uint32_t, uint32_t, idhash> cache(/*window_ratio*/ 0.1);
+  cache.init(10);
+  assert(cache.window_capacity() == 1 && cache.protected_capacity() == 7);
+  uint32_t lru_hits = run_hot_set(lru);
+  uint32_t tinylfu_hits = run_hot_set(cache);
+  std::cout << "Hot set hits: LRU=" << lru_hits << "/500, TinyLFU="
+            << tinylfu_hits << "/500" << std::endl;
+  // each hot key is reused after 18 one-hit wonders, which flush LRU
+  if (tinylfu_hits < 450 || tinylfu_hits < 10 * lru_hits)
+    throw std::runtime_error("TinyLFU: hot evicted!");
+
+  auto h = cache.insert(2000);
+  *h = 2000;
+  for (uint32_t i = 0; i < 10; ++i) cache.lookup(2000);
+  *cache.insert(2001) = 2001;  // 2000 leaves the window and beats the victim
+  *cache.insert(2002) = 2002;  // 2001 leaves the window and loses
+  if (cache.lookup(2000) != h)
+    throw std::runtime_error("TinyLFU: frequent newcomer not admitted!");
+  if (cache.lookup(2001)) throw std::runtime_error("TinyLFU: 2001 admitted!");
+  std::cout << "Expect: window: [2002], probation: [3, 4], "
+               "protected: [5, 6, 7, 8, 9, 1, 2000]\n";
+  std::cout << cache << std::endl;
+
+  // all pinned: no victim
+  std::vector<TinyLFUCache<uint32_t, uint32_t, idhash>::Handle_t> handles;
+  cache.for_each([&](TinyLFUCache<uint32_t, uint32_t, idhash>::Handle_t h) {
+    handles.push_back(h);
+  });
+  for (auto h : handles) cache.pin(h);
+  if (cache.insert(3000)) throw std::runtime_error("TinyLFU: evicted pinned!");
+  for (auto h : handles) cache.release(h);
+  if (!cache.insert(3000)) throw std::runtime_error("TinyLFU: no victim!");
+  assert(cache.size() == 10);
+}
+
+// On a Zipfian workload, W-TinyLFU should beat LRU.
+void test3() {
+  LRUCache<uint32_t, uint32_t, ghash> lru;
+  lru.init(4096);
+  TinyLFUCache<uint32_t, uint32_t, ghash> tinylfu;
+  tinylfu.init(4096);
+
+  auto zipf = [] {
+    return Offsets(num_ops, OffsetType::ZIPF, /*size*/ 64 * 1024, 1, 0.99,
+                   0x537);
+  };
+  double lru_ratio = hit_ratio(lru, zipf());
+  double tinylfu_ratio = hit_ratio(tinylfu, zipf());
+  std::cout << "Zipf hit ratio: LRU=" << lru_ratio
+            << ", TinyLFU=" << tinylfu_ratio << std::endl;
+  if (tinylfu_ratio <= lru_ratio)
+    throw std::runtime_error("TinyLFU: no better than LRU!");
+}
+
+void bench() {
+  bench_hit<LRUCache<uint32_t, uint32_t, ghash>>("LRUCache", num_ops);
+  bench_hit<TinyLFUCache<uint32_t, uint32_t, ghash>>("TinyLFUCache",
+                                                     num_ops);
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for the sketch
+  test2();  // for admission
+  test3();  // for hit ratio
+  test_release_parked<TinyLFUCache<uint32_t, uint32_t, ghash>>();
+  bench();  // for performance
+  return 0;
+}
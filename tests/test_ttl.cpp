@@ -0,0 +1,148 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/timing_wheel.h"
+#include "gcache/ttl_cache.h"
+#include "util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+// Each timer must fire exactly at its expire tick, at any level of the wheel
+// and beyond its range, unless cancelled.
+void test1() {
+  using Node_t = LRUNode<uint32_t, TTLValue<uint32_t, uint32_t>>;
+  using Wheel_t = TimingWheel<Node_t>;
+  constexpr uint32_t num_timers = 4096;
+  std::vector<Node_t> nodes(num_timers);
+  std::vector<uint64_t> expires(num_timers);
+  Wheel_t wheel;
+  srand(0x537);
+  wheel.advance_to(12345, [](Node_t*) {});  // not aligned to any slot
+  for (uint32_t i = 0; i < num_timers; ++i) {
+    nodes[i].key = i;
+    nodes[i].value.timer.pprev = nullptr;
+    // spread over all levels: 1 to ~2 * kRange ticks away
+    uint64_t delta = 1 + rand() % (uint64_t{1} << (rand() % 26));
+    expires[i] = wheel.now() + delta;
+    wheel.schedule(&nodes[i], expires[i]);
+  }
+  for (uint32_t i = 0; i < num_timers; i += 3) {
+    wheel.cancel(&nodes[i]);
+    expires[i] = 0;
+  }
+
+  uint32_t num_fired = 0;
+  auto check = [&](Node_t* e) {
+    if (expires[e->key] != wheel.now())
+      throw std::runtime_error("TimingWheel: fired at a wrong tick!");
+    expires[e->key] = 0;
+    ++num_fired;
+  };
+  wheel.advance_to(wheel.now() + 100, check);
+  // reschedule one that has not fired yet to fire in the next tick
+  for (uint32_t i = 1; i < num_timers; ++i) {
+    if (expires[i] == 0) continue;
+    wheel.cancel(&nodes[i]);
+    expires[i] = wheel.now() + 1;
+    wheel.schedule(&nodes[i], expires[i]);
+    break;
+  }
+  wheel.advance_to(wheel.now() + 3 * Wheel_t::kRange, check);
+  for (auto e : expires)
+    if (e != 0) throw std::runtime_error("TimingWheel: not fired!");
+  if (wheel.size() != 0 || num_fired != num_timers - (num_timers + 2) / 3)
+    throw std::runtime_error("TimingWheel: wrong number of timers!");
+  std::cout << "TimingWheel: " << num_fired << " timers fired on time\n";
+}
+
+// Expired nodes are misses and go to the free list; an LRU victim's timer is
+// cancelled; a pinned node is not freed on expiration.
+void test2() {
+  using Cache_t = TTLCache<uint32_t, uint32_t, idhash>;
+  Cache_t cache;
+  cache.init(4);
+  *cache.insert(1, /*ttl*/ 10) = 111;
+  *cache.insert(2) = 222;
+  *cache.insert(3, /*ttl*/ 5) = 333;
+  *cache.insert(4, /*ttl*/ 5) = 444;
+  if (cache.tick(4) != 0 || !cache.lookup(3))
+    throw std::runtime_error("TTL: expired too early!");
+  auto h4 = cache.lookup(4, /*pin*/ true);
+  if (cache.tick() != 1 || cache.lookup(3) || cache.lookup(4))
+    throw std::runtime_error("TTL: not expired!");
+  assert(cache.size() == 3);  // 4 is pinned, so not freed
+  if (*h4 != 444) throw std::runtime_error("TTL: pinned node recycled!");
+  cache.release(h4);
+
+  // 3's node is free, so neither 1 nor 2 is evicted
+  *cache.insert(5) = 555;
+  if (!cache.lookup(1) || !cache.lookup(2))
+    throw std::runtime_error("TTL: live node evicted!");
+  std::cout << "Expect: lru: [4, 5, 1, 2]\n";
+  std::cout << cache << std::endl;
+
+  // an expired key can be inserted again, with a new TTL
+  if (*cache.insert(4, /*ttl*/ 100) != 444 || !cache.lookup(4))
+    throw std::runtime_error("TTL: expired key not revived!");
+  // reset and cancel TTLs
+  cache.insert(1, /*ttl*/ 100);
+  cache.set_ttl(cache.lookup(4), Cache_t::kNoTTL);
+  if (cache.tick(50) != 0 || !cache.lookup(1) || !cache.lookup(4))
+    throw std::runtime_error("TTL: TTL not reset!");
+
+  // 5 and 1 are evicted by LRU; the node of 1 must not expire 7 at tick 105
+  cache.insert(2, /*ttl*/ 15);
+  *cache.insert(6) = 666;
+  *cache.insert(7) = 777;
+  if (cache.lookup(5) || cache.lookup(1))
+    throw std::runtime_error("TTL: not evicted by LRU!");
+  if (cache.tick(60) != 1 || !cache.lookup(6) || !cache.lookup(7) ||
+      cache.lookup(2) || cache.size() != 3)
+    throw std::runtime_error("TTL: LRU victim's timer fired!");
+  std::cout << "Expect: lru: [4, 6, 7]\n";
+  std::cout << cache << std::endl;
+}
+
+void bench() {
+  constexpr uint32_t bench_size = 256 * 1024;
+  LRUCache<uint32_t, uint32_t, ghash> lru;
+  TTLCache<uint32_t, uint32_t, ghash> cache;
+  lru.init(bench_size);
+  cache.init(bench_size);
+  std::vector<uint32_t> ttls;
+  for (uint32_t i = 0; i < num_ops; ++i) ttls.emplace_back(rand() % 100000);
+
+  auto ts0 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i) lru.insert(i);
+  auto ts1 = rdtsc();
+  uint64_t num_expired = 0;
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    cache.insert(i, ttls[i] + 1);
+    if (i % 16 == 0) num_expired += cache.tick();
+  }
+  auto ts2 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i) cache.lookup(i);
+  auto ts3 = rdtsc();
+
+  std::cout << "LRUCache insert: " << (ts1 - ts0) / num_ops << " cycles/op\n";
+  std::cout << "TTLCache insert: " << (ts2 - ts1) / num_ops
+            << " cycles/op (incl. 1 tick per 16 ops; " << num_expired
+            << " expired)\n";
+  std::cout << "TTLCache lookup: " << (ts3 - ts2) / num_ops << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for the timing wheel
+  test2();  // for TTLCache
+  bench();  // for performance
+  return 0;
+}
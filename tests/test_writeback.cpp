@@ -0,0 +1,145 @@
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "gcache/hash.h"
+#include "gcache/lru_cache.h"
+#include "gcache/writeback_cache.h"
+#include "util.h"
+
+using namespace gcache;
+
+constexpr const uint32_t num_keys = 4096;
+constexpr const uint32_t num_ops = 1024 * 1024;
+
+// Victim callback of LRUCache: reject a victim to park it
+void test1() {
+  using Cache_t = LRUCache<uint32_t, uint32_t, idhash>;
+  Cache_t cache;
+  cache.init(3);
+  for (uint32_t i = 1; i <= 3; ++i) *cache.insert(i) = i * 111;
+
+  std::vector<uint32_t> victims;
+  auto park_odd = [&victims](Cache_t::Handle_t h) {
+    victims.push_back(h.get_key());
+    return h.get_key() % 2 == 0;
+  };
+  cache.insert(4, false, false, park_odd);  // park 1, evict 2
+  if (victims != std::vector<uint32_t>{1, 2})
+    throw std::runtime_error("WriteBack: wrong victims!");
+  assert(cache.size() == 3);
+  auto h = cache.lookup(1);  // a parked node is still cached
+  if (!h || *h != 111) throw std::runtime_error("WriteBack: parked lost!");
+
+  cache.insert(5, false, false, park_odd);  // park 3, evict 4
+  assert(cache.size() == 3);
+  std::cout << "Expect: lru: [1, 5], parked: [3]\n";
+  std::cout << cache << std::endl;
+  std::vector<Cache_t::Handle_t> parked;
+  cache.for_each_parked(
+      [&parked](Cache_t::Handle_t h) { parked.push_back(h); });
+  for (auto h : parked) cache.unpark(h);
+  std::cout << "Expect: lru: [3, 1, 5]\n";
+  std::cout << cache << std::endl;
+}
+
+// Pages are uint64_t values stored in a file at offset key * 8. With random
+// writes, a page must be either cached with its latest value or written back.
+void test2() {
+  FILE* file = tmpfile();
+  if (!file) throw std::runtime_error("WriteBack: tmpfile failed!");
+  int fd = fileno(file);
+  auto read_page = [fd](uint32_t key) {
+    uint64_t v = 0;
+    if (pread(fd, &v, sizeof(v), key * sizeof(v)) < 0)
+      throw std::runtime_error("WriteBack: pread failed!");
+    return v;
+  };
+
+  uint64_t num_batches = 0, num_pages = 0;
+  using Handle_t = WriteBackHandle<uint32_t, uint64_t>;
+  auto writer = [fd, &num_batches, &num_pages](const Handle_t* handles,
+                                               size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (i > 0 && handles[i - 1].get_key() >= handles[i].get_key())
+        throw std::runtime_error("WriteBack: batch not sorted!");
+      if (!handles[i].is_dirty())
+        throw std::runtime_error("WriteBack: clean page written!");
+      uint32_t key = handles[i].get_key();
+      if (pwrite(fd, &*handles[i], 8, key * 8) != 8)
+        throw std::runtime_error("WriteBack: pwrite failed!");
+    }
+    ++num_batches;
+    num_pages += n;
+  };
+  WriteBackCache<uint32_t, uint64_t, ghash, decltype(writer)> cache(writer, 16);
+  cache.init(256);
+
+  std::vector<uint64_t> expected(num_keys, 0);
+  srand(0x537);
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    uint32_t key = rand() % num_keys;
+    if (rand() % 2) {  // write
+      auto h = cache.insert(key, /*pin*/ true);
+      assert(h);
+      *h = expected[key] = i + 1;
+      h.mark_dirty();
+      cache.release(h);
+    } else {  // read
+      auto h = cache.lookup(key);
+      uint64_t v = h ? *h : read_page(key);
+      if (v != expected[key]) throw std::runtime_error("WriteBack: lost!");
+    }
+  }
+  cache.flush_all();
+  cache.for_each([](Handle_t h) {
+    if (h.is_dirty()) throw std::runtime_error("WriteBack: not flushed!");
+  });
+  for (uint32_t key = 0; key < num_keys; ++key) {
+    if (read_page(key) != expected[key])
+      throw std::runtime_error("WriteBack: stale page in file!");
+  }
+  std::cout << "Wrote " << num_pages << " pages in " << num_batches
+            << " batches\n";
+  fclose(file);
+}
+
+void bench() {
+  using Handle_t = WriteBackHandle<uint32_t, uint64_t>;
+  uint64_t num_pages = 0;
+  auto writer = [&num_pages](const Handle_t*, size_t n) { num_pages += n; };
+  WriteBackCache<uint32_t, uint64_t, ghash, decltype(writer)> cache(writer);
+  cache.init(256 * 1024);
+  LRUCache<uint32_t, uint64_t, ghash> lru_cache;
+  lru_cache.init(256 * 1024);
+
+  auto ts0 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    auto h = cache.insert(i * 7 % (512 * 1024));
+    *h = i;
+    h.mark_dirty();
+  }
+  auto ts1 = rdtsc();
+  for (uint32_t i = 0; i < num_ops; ++i)
+    *lru_cache.insert(i * 7 % (512 * 1024)) = i;
+  auto ts2 = rdtsc();
+
+  std::cout << "Dirty insert (write-back): " << (ts1 - ts0) / num_ops
+            << " cycles/op, " << num_pages << " pages written\n";
+  std::cout << "Insert (LRUCache):         " << (ts2 - ts1) / num_ops
+            << " cycles/op\n";
+  std::cout << std::flush;
+}
+
+int main() {
+  test1();  // for victim callback
+  test2();  // for write-back correctness
+  bench();  // for performance
+  return 0;
+}
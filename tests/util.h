@@ -1,3 +1,5 @@
+#pragma once
+
 #include <sys/time.h>
 
 #include <cstddef>